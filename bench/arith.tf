@@ -0,0 +1 @@
+0 200000 0 do i 3 * 7 + 2 / 5 - 4 * 1 + drop 1 + loop .
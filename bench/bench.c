@@ -0,0 +1,378 @@
+/*
+ * ToyForth Benchmark Driver
+ *
+ * Compiles and runs each workload on each engine and prints one line of
+ * tab-separated measurements per run, after a header line naming the
+ * columns, so results can be diffed or loaded into a spreadsheet:
+ *
+ *   workload       file name without .tf
+ *   copies         times the file was repeated to build the input
+ *   engine         list, threaded or jit
+ *   compile_words  tokens in the input
+ *   compile_ns     compile, fold, fuse and pin (and bytecode and native translation)
+ *   compile_ns_per_word, compile_allocs_per_word
+ *   exec_words     objects executed, counted by executeCountingWords()
+ *   exec_ns        one run of the engine
+ *   exec_ns_per_word, exec_allocs_per_word
+ *   peak_rss_kib   peak resident set size of the workload's process
+ *
+ * Times are the best of --runs runs. Each workload runs in a child process
+ * of its own, so definitions, interned symbols and peak RSS never carry
+ * over from one workload to the next. Output printed by the programs is
+ * discarded.
+ *
+ * Usage: bench [--engine=list|threaded|jit] [--runs=N] <file.tf[:copies]>...
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bytecode.h"
+#include "engine.h"
+#include "file_utils.h"
+#include "jit.h"
+#include "list.h"
+#include "mem.h"
+#include "parser.h"
+
+
+/* Runs per workload when --runs is not given */
+#define DEFAULT_RUNS 5
+
+/*
+ * Engine - Engines a workload can be timed on (as in main.c)
+ */
+typedef enum {
+    ENGINE_LIST,
+    ENGINE_THREADED,
+    ENGINE_JIT,
+    ENGINE_COUNT
+} Engine;
+
+static const char *engine_names[ENGINE_COUNT] = {"list", "threaded", "jit"};
+
+/*
+ * Workload - One file given on the command line
+ */
+typedef struct {
+    char path[4096];                /* Path of the .tf file */
+    char name[256];                 /* File name without directory and .tf */
+    size_t copies;                  /* Times the file is repeated */
+} Workload;
+
+/*
+ * Measurement - Best results of all runs of one workload on one engine
+ */
+typedef struct {
+    size_t compile_words;
+    uint64_t compile_ns;
+    size_t compile_allocs;
+    size_t exec_words;
+    uint64_t exec_ns;
+    size_t exec_allocs;
+} Measurement;
+
+
+/*
+ * nowNanoseconds() - Reads the monotonic clock
+ */
+static uint64_t nowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+
+/*
+ * parseWorkload() - Splits "path[:copies]" into a workload
+ *
+ * Returns 0 if the copy count is not a positive number.
+ */
+static int parseWorkload(const char *argument, Workload *workload) {
+    const char *colon = strrchr(argument, ':');
+    size_t path_len = colon != NULL ? (size_t)(colon - argument) : strlen(argument);
+
+    workload->copies = 1;
+    if (colon != NULL) {
+        char *end;
+        long copies = strtol(colon + 1, &end, 10);
+        if (*end != '\0' || copies <= 0) return 0;
+        workload->copies = (size_t)copies;
+    }
+    if (path_len >= sizeof(workload->path)) return 0;
+
+    memcpy(workload->path, argument, path_len);
+    workload->path[path_len] = '\0';
+
+    const char *base = strrchr(workload->path, '/');
+    base = base != NULL ? base + 1 : workload->path;
+    size_t name_len = strlen(base);
+    if (name_len > 3 && strcmp(base + name_len - 3, ".tf") == 0) name_len -= 3;
+    if (name_len >= sizeof(workload->name)) name_len = sizeof(workload->name) - 1;
+    memcpy(workload->name, base, name_len);
+    workload->name[name_len] = '\0';
+
+    return 1;
+}
+
+
+/*
+ * buildInput() - Concatenates copies of a source text, one per line
+ */
+static char *buildInput(const char *text, size_t copies) {
+    size_t len = strlen(text);
+    char *input = wmalloc((len + 1) * copies + 1);
+    char *end = input;
+
+    for (size_t i = 0; i < copies; i++) {
+        memcpy(end, text, len);
+        end += len;
+        *end++ = '\n';
+    }
+    *end = '\0';
+
+    return input;
+}
+
+
+/*
+ * countTokens() - Counts the whitespace-separated tokens of a text
+ */
+static size_t countTokens(const char *text) {
+    size_t count = 0;
+    int in_token = 0;
+
+    for (const char *p = text; *p != '\0'; p++) {
+        int space = isspace((unsigned char)*p);
+        if (!space && !in_token) count++;
+        in_token = !space;
+    }
+
+    return count;
+}
+
+
+/*
+ * runOnce() - Compiles and runs a workload once, keeping the best times
+ *
+ * The first run also executes the program once through
+ * executeCountingWords() to find how many objects an execution runs.
+ * Returns 0 on a compile error (already reported by the compiler).
+ */
+static int runOnce(char *input, Engine engine, int first, Measurement *best) {
+    tfparser parser;
+
+    activateContext(NULL);
+    size_t allocs = allocationCount();
+    uint64_t start = nowNanoseconds();
+
+    parserInit(&parser, input);
+    tfobj *program = compileBatch(&parser, SIZE_MAX);
+    if (program == NULL) return 0;
+    foldConstants(program);
+    fuseSuperinstructions(program);
+    pinLiterals(program);
+    tfbytecode *bytecode = engine != ENGINE_LIST ? compileBytecode(program) : NULL;
+    tfjit *jit = engine == ENGINE_JIT ? compileJit(bytecode) : NULL;
+
+    uint64_t compile_ns = nowNanoseconds() - start;
+    size_t compile_allocs = allocationCount() - allocs;
+    size_t depth = (size_t)parser.analysis.highest;
+
+    tfcontext *context = createContext();
+    if (first) {
+        activateContext(context);
+        listReserve(context->stack, depth);
+        best->exec_words = executeCountingWords(program, context);
+        resetContext(context);
+    }
+
+    activateContext(context);
+    listReserve(context->stack, depth);
+    allocs = allocationCount();
+    start = nowNanoseconds();
+
+    if (jit != NULL) {
+        executeJit(jit, context);
+    } else if (bytecode != NULL) {
+        executeBytecode(bytecode, context);
+    } else {
+        execute(program, context);
+    }
+
+    uint64_t exec_ns = nowNanoseconds() - start;
+    size_t exec_allocs = allocationCount() - allocs;
+
+    freeContext(context);
+    activateContext(NULL);
+    freeJit(jit);
+    freeBytecode(bytecode);
+    decrementReferenceCount(program);
+
+    if (first || compile_ns < best->compile_ns) {
+        best->compile_ns = compile_ns;
+        best->compile_allocs = compile_allocs;
+    }
+    if (first || exec_ns < best->exec_ns) {
+        best->exec_ns = exec_ns;
+        best->exec_allocs = exec_allocs;
+    }
+
+    return 1;
+}
+
+
+/*
+ * perWord() - Divides a total by a word count, 0 for no words
+ */
+static double perWord(double total, size_t words) {
+    return words > 0 ? total / (double)words : 0.0;
+}
+
+
+/*
+ * benchWorkload() - Measures one workload on one engine and prints its line
+ *
+ * Runs in the child process of the workload: stdout is redirected to
+ * /dev/null while the programs run, and the results are written to out.
+ */
+static int benchWorkload(const Workload *workload, Engine engine, int runs, FILE *out) {
+    tfsource *source = loadSource(workload->path);
+    char *input = buildInput(source->text, workload->copies);
+    freeSource(source);
+
+    Measurement best = {countTokens(input), 0, 0, 0, 0, 0};
+    for (int run = 0; run < runs; run++) {
+        if (!runOnce(input, engine, run == 0, &best)) {
+            free(input);
+            return 0;
+        }
+    }
+    free(input);
+    fflush(stdout);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(out, "%s\t%zu\t%s\t%zu\t%llu\t%.2f\t%.3f\t%zu\t%llu\t%.2f\t%.3f\t%ld\n",
+            workload->name, workload->copies, engine_names[engine],
+            best.compile_words, (unsigned long long)best.compile_ns,
+            perWord((double)best.compile_ns, best.compile_words),
+            perWord((double)best.compile_allocs, best.compile_words),
+            best.exec_words, (unsigned long long)best.exec_ns,
+            perWord((double)best.exec_ns, best.exec_words),
+            perWord((double)best.exec_allocs, best.exec_words),
+            usage.ru_maxrss);
+    fflush(out);
+
+    return 1;
+}
+
+
+/*
+ * spawnWorkload() - Runs benchWorkload() in a child process
+ *
+ * Returns 1 if the child measured the workload, 0 if it failed (for
+ * instance on a compile or runtime error, which the child reports).
+ */
+static int spawnWorkload(const Workload *workload, Engine engine, int runs) {
+    fflush(stdout);
+    pid_t child = fork();
+
+    if (child < 0) {
+        fprintf(stderr, "Error. Couldn't start a process for %s.\n", workload->path);
+        return 0;
+    }
+
+    if (child == 0) {
+        FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (out == NULL || null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0) _exit(EXIT_FAILURE);
+        close(null_fd);
+
+        int ok = benchWorkload(workload, engine, runs, out);
+        fclose(out);
+        _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status;
+    if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error. Workload %s failed on the %s engine.\n", workload->name, engine_names[engine]);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/*
+ * printUsage() - Prints the command line synopsis to stderr
+ */
+static void printUsage(const char *program_name) {
+    fprintf(stderr, "Error. How to use: %s [--engine=list|threaded|jit] [--runs=N] <file.tf[:copies]>...\n", program_name);
+}
+
+
+int main(int argc, char **argv) {
+    int engines[ENGINE_COUNT] = {1, 1, 1};
+    int runs = DEFAULT_RUNS;
+    int first_workload = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--engine=", 9) == 0) {
+            int engine = 0;
+            while (engine < ENGINE_COUNT && strcmp(argv[i] + 9, engine_names[engine]) != 0) engine++;
+            if (engine == ENGINE_COUNT) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            for (int other = 0; other < ENGINE_COUNT; other++) engines[other] = other == engine;
+        } else if (strncmp(argv[i], "--runs=", 7) == 0) {
+            runs = atoi(argv[i] + 7);
+            if (runs <= 0) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            first_workload = i;
+            break;
+        }
+    }
+
+    if (first_workload == argc) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("workload\tcopies\tengine\tcompile_words\tcompile_ns\tcompile_ns_per_word\tcompile_allocs_per_word\t"
+           "exec_words\texec_ns\texec_ns_per_word\texec_allocs_per_word\tpeak_rss_kib\n");
+
+    int failed = 0;
+    for (int i = first_workload; i < argc; i++) {
+        Workload workload;
+        if (!parseWorkload(argv[i], &workload)) {
+            fprintf(stderr, "Error. Bad workload %s.\n", argv[i]);
+            failed = 1;
+            continue;
+        }
+
+        for (int engine = 0; engine < ENGINE_COUNT; engine++) {
+            if (engines[engine] && !spawnWorkload(&workload, (Engine)engine, runs)) failed = 1;
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,3 @@
+: sq dup * ;
+: step sq 3 + 2 / ;
+0 1000 0 do 100 0 do i step drop 1 + loop loop .
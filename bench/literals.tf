@@ -0,0 +1,2 @@
+-641747 1975635 -1367293 -343991 730217 -1797473 -1696181 1444674 247652 -1605190 -466190 444390 -1756735 1815575 128339 -1099491 -1842732 -1639512 -181159 -246059 -1707006 -990587 -1619523 311259 -219438 -1752073 1468069 371684 -1480737 1973892 -1063668 645036 631645 445266 1974979 -1740532 420545 455938 -336202 -1792008 -1072716 -1804619 334821 1600677 -1441425 -785291 -242004 -1394951 267800 -1505944 394585 -706134 349889 1423082 860526 -1241979 -1567754 439407 395804 679797 -1212012 -438052 -1591347 297406
+64 0 do drop loop
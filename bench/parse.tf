@@ -0,0 +1,2 @@
+12 34 + 56 * 7 - 8 / drop 1 2 swap - dup * drop
+3 4 < if 5 else 6 then dup . 9 swap - drop
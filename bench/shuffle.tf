@@ -0,0 +1,3 @@
+1000 0 do i loop
+200000 0 do swap dup drop swap dup + 2 / dup swap drop loop
+1000 0 do drop loop
@@ -0,0 +1,2 @@
+: strings s" alpha" s" beta" s" gamma" s" delta" drop swap drop strlen swap strlen + drop ;
+200000 0 do strings strings strings strings loop
@@ -1,6 +1,15 @@
 
 EXECUTABLE="./toyforth"
+# Extra interpreter flags, e.g. TOYFORTH_FLAGS=--engine=threaded
+FLAGS="${TOYFORTH_FLAGS:-}"
+# TOYFORTH_IMAGES=1 compiles each test to an image first and runs the image
+IMAGES="${TOYFORTH_IMAGES:-}"
+# TOYFORTH_SERVE=1 pipes each file in tests/serve through --serve, one request per line
+SERVE="${TOYFORTH_SERVE:-}"
 TEST_DIR="tests"
+if [ -n "$SERVE" ]; then
+    TEST_DIR="tests/serve"
+fi
 PASSED=0
 FAILED=0
 
@@ -9,7 +18,7 @@ GREEN='\033[0;32m'
 RED='\033[0;31m'
 NC='\033[0m' # No Color
 
-echo "Running ToyForth Test Suite..."
+echo "Running ToyForth Test Suite...${FLAGS:+ ($FLAGS)}${IMAGES:+ (images)}${SERVE:+ (serve)}"
 echo "------------------------------"
 
 if [ ! -f "$EXECUTABLE" ]; then
@@ -27,7 +36,15 @@ for test_file in "$TEST_DIR"/*.tf; do
         continue
     fi
 
-    $EXECUTABLE "$test_file" > "$out_file" 2>&1
+    if [ -n "$SERVE" ]; then
+        $EXECUTABLE $FLAGS --serve < "$test_file" > "$out_file" 2>&1
+    elif [ -n "$IMAGES" ]; then
+        image_file="$TEST_DIR/$base_name.tfc"
+        $EXECUTABLE --compile "$test_file" -o "$image_file" > "$out_file" 2>&1 &&
+            $EXECUTABLE $FLAGS "$image_file" > "$out_file" 2>&1
+    else
+        $EXECUTABLE $FLAGS "$test_file" > "$out_file" 2>&1
+    fi
 
     if diff -q -w "$expected_file" "$out_file" > /dev/null; then
         echo -e "${GREEN}[PASS]${NC} $base_name"
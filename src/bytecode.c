@@ -0,0 +1,650 @@
+/*
+ * Bytecode Engine Implementation
+ *
+ * Translates a compiled program list into a flat instruction array and
+ * runs it with threaded dispatch. The hot primitives work directly on the
+ * stack's element array when their operands are immediates; any other case
+ * (type mismatch, underflow, division by zero, heap values) falls back to
+ * the regular Operation so behaviour and diagnostics stay identical.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bytecode.h"
+#include "dictionary.h"
+#include "engine.h"
+#include "list.h"
+#include "mem.h"
+#include "ops.h"
+
+
+/* Use computed goto when the compiler supports labels as values */
+#if defined(__GNUC__) && !defined(TF_NO_COMPUTED_GOTO)
+#define TF_COMPUTED_GOTO 1
+#else
+#define TF_COMPUTED_GOTO 0
+#endif
+
+
+/*
+ * Inline arithmetic works on the tagged words themselves. With the tag
+ * cleared, an immediate a is the intptr_t 4a, and 4a + 4b = 4(a + b) is
+ * the sum with room for the tag. It overflows intptr_t exactly when a + b
+ * leaves the immediate range, so a single __builtin_*_overflow() tells
+ * whether the result is still an immediate. Results that are not go out
+ * of line, where the primitive boxes them or reports a 64-bit overflow.
+ */
+#define untagInteger(object) ((intptr_t)(object) - (intptr_t)TF_TAG_INT)
+#define tagInteger(bits) ((tfobj *)((uintptr_t)(bits) | TF_TAG_INT))
+
+/*
+ * divideTagged() - Divides two untagged immediates, for the inline "/"
+ *
+ * The divisor must not be zero. Returns nonzero, like the overflow
+ * builtins, for the one quotient out of the immediate range.
+ */
+static inline int divideTagged(intptr_t x, intptr_t y, intptr_t *result) {
+    intptr_t quotient = (x >> TF_TAG_SHIFT) / (y >> TF_TAG_SHIFT);
+    *result = (intptr_t)((uintptr_t)quotient << TF_TAG_SHIFT);
+    return quotient > TF_IMMEDIATE_MAX;
+}
+
+
+/*
+ * OpcodeEntry - Maps a primitive implementation to its dedicated opcode
+ */
+typedef struct {
+    Operation op;           /* Primitive bound by compile() */
+    TF_OPCODE opcode;       /* Inline opcode executing the same primitive */
+} OpcodeEntry;
+
+static const OpcodeEntry opcodes[] = {
+    {operationAdd, TF_OP_ADD},
+    {operationSub, TF_OP_SUB},
+    {operationMul, TF_OP_MUL},
+    {operationDiv, TF_OP_DIV},
+    {operationPrint, TF_OP_PRINT},
+    {operationDup, TF_OP_DUP},
+    {operationDrop, TF_OP_DROP},
+    {operationSwap, TF_OP_SWAP},
+    {operationSquare, TF_OP_SQUARE},
+    {operationSwapSub, TF_OP_SWAP_SUB}
+};
+
+#define OPCODE_COUNT (sizeof(opcodes) / sizeof(opcodes[0]))
+
+
+/*
+ * OperandOpcodeEntry - Maps a fused operand primitive to its opcode
+ */
+typedef struct {
+    OperandOperation op;    /* Operand primitive of a fused word */
+    TF_OPCODE opcode;       /* Inline opcode; the literal becomes the operand */
+} OperandOpcodeEntry;
+
+static const OperandOpcodeEntry operand_opcodes[] = {
+    {operationAddLiteral, TF_OP_ADD_LIT},
+    {operationSubLiteral, TF_OP_SUB_LIT},
+    {operationMulLiteral, TF_OP_MUL_LIT},
+    {operationDivLiteral, TF_OP_DIV_LIT}
+};
+
+#define OPERAND_OPCODE_COUNT (sizeof(operand_opcodes) / sizeof(operand_opcodes[0]))
+
+
+/*
+ * translateOperandWord() - Builds the instruction for a fused operand word
+ *
+ * The instruction takes its own reference to the literal (or the word).
+ */
+static tfinstr translateOperandWord(tfobj *word) {
+    tfinstr instr;
+
+    for (size_t i = 0; i < OPERAND_OPCODE_COUNT; i++) {
+        if (operand_opcodes[i].op == word->word_obj.operand_op) {
+            instr.opcode = operand_opcodes[i].opcode;
+            instr.operand.object = word->word_obj.operand;
+            incrementReferenceCount(instr.operand.object);
+            return instr;
+        }
+    }
+
+    instr.opcode = TF_OP_WORD;
+    instr.operand.object = word;
+    incrementReferenceCount(word);
+    return instr;
+}
+
+
+/*
+ * translateWord() - Builds the instruction for a resolved primitive
+ */
+static tfinstr translateWord(Operation op) {
+    tfinstr instr;
+
+    for (size_t i = 0; i < OPCODE_COUNT; i++) {
+        if (opcodes[i].op == op) {
+            instr.opcode = opcodes[i].opcode;
+            instr.operand.op = op;
+            return instr;
+        }
+    }
+
+    instr.opcode = TF_OP_CALL;
+    instr.operand.op = op;
+    return instr;
+}
+
+
+/*
+ * stackGrowth() - Net number of items an inline opcode pushes
+ *
+ * Out-of-line fallbacks never push more than this (they only differ on
+ * errors and on non-integer operands, which they drop), so a stretch's
+ * peak growth bounds its real pushes.
+ */
+static int stackGrowth(TF_OPCODE opcode) {
+    switch (opcode) {
+    case TF_OP_PUSH:
+    case TF_OP_PUSH_COUNTED:
+    case TF_OP_DUP:
+        return 1;
+    case TF_OP_ADD:
+    case TF_OP_SUB:
+    case TF_OP_MUL:
+    case TF_OP_DIV:
+    case TF_OP_PRINT:
+    case TF_OP_DROP:
+    case TF_OP_SWAP_SUB:
+    case TF_OP_BRANCH_IF_FALSE:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+
+/*
+ * endsStretch() - Tells whether an opcode reserves for the code after it
+ */
+static int endsStretch(TF_OPCODE opcode) {
+    return opcode == TF_OP_CALL || opcode == TF_OP_WORD || opcode == TF_OP_HALT ||
+           opcode == TF_OP_BRANCH || opcode == TF_OP_BRANCH_IF_FALSE || opcode == TF_OP_LOOP;
+}
+
+
+/*
+ * computeHeadroom() - Records the peak stack growth of every stretch
+ *
+ * Calls may change the depth arbitrarily, and branches may continue at
+ * either of two places, so a stretch runs from the beginning of the
+ * program, a call or a branch up to the next one. Walking backwards,
+ * peak[i] is how far the stack can grow from instruction i to the end of
+ * its stretch. Calls store the peak of the code after them, branches the
+ * larger of the peaks at their two successors.
+ */
+static void computeHeadroom(tfbytecode *bytecode) {
+    size_t len = bytecode->len;
+    int *peak = wmalloc(sizeof(int) * (len + 1));
+
+    peak[len] = 0;
+    for (size_t i = len; i-- > 0;) {
+        TF_OPCODE opcode = bytecode->code[i].opcode;
+        int growth = stackGrowth(opcode) + peak[i + 1];
+        peak[i] = endsStretch(opcode) || growth < 0 ? 0 : growth;
+    }
+
+    bytecode->headroom = (unsigned int)peak[0];
+    for (size_t i = 0; i < len; i++) {
+        tfinstr *instr = &bytecode->code[i];
+        int headroom = 0;
+
+        if (endsStretch(instr->opcode)) headroom = peak[i + 1];
+        if (instr->opcode == TF_OP_BRANCH || instr->opcode == TF_OP_BRANCH_IF_FALSE ||
+            instr->opcode == TF_OP_LOOP) {
+            if (peak[instr->operand.target] > headroom) headroom = peak[instr->operand.target];
+        }
+        instr->headroom = (unsigned int)headroom;
+    }
+
+    free(peak);
+}
+
+
+/*
+ * compileBytecode() implementation
+ *
+ * Emits one instruction per program list element followed by TF_OP_HALT.
+ * Symbols that were not resolved by compile() are looked up here, once.
+ */
+tfbytecode *compileBytecode(tfobj *program_list) {
+    if (program_list == NULL) return NULL;
+
+    size_t len = program_list->list_obj.len;
+    tfbytecode *bytecode = wmalloc(sizeof(tfbytecode));
+    bytecode->code = wmalloc(sizeof(tfinstr) * (len + 1));
+    bytecode->len = 0;
+    bytecode->headroom = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        tfobj *object = program_list->list_obj.element[i];
+        TF_OBJ_TYPE type = getObjectType(object);
+        tfinstr instr;
+
+        if (type == TF_OBJ_INT || type == TF_OBJ_BOOL || type == TF_OBJ_STR) {
+            /* Immortal literals are pushed without touching them at all */
+            int borrowed = isImmediate(object) || object->refcount == TF_REFCOUNT_PINNED;
+            instr.opcode = borrowed ? TF_OP_PUSH : TF_OP_PUSH_COUNTED;
+            instr.operand.object = object;
+            incrementReferenceCount(object);
+        } else if (type == TF_OBJ_WORD && object->word_obj.operand != NULL) {
+            instr = translateOperandWord(object);
+        } else if (type == TF_OBJ_WORD) {
+            instr = translateWord(object->word_obj.op);
+        } else if (type == TF_OBJ_BRANCH) {
+            static const TF_OPCODE branch_opcodes[] = {
+                [TF_BRANCH_ALWAYS] = TF_OP_BRANCH,
+                [TF_BRANCH_IF_FALSE] = TF_OP_BRANCH_IF_FALSE,
+                [TF_BRANCH_LOOP] = TF_OP_LOOP
+            };
+            instr.opcode = branch_opcodes[object->branch_obj.kind];
+            instr.operand.target = object->branch_obj.target;
+        } else if (type == TF_OBJ_SYMBOL) {
+            tfentry *entry = lookupWord(object);
+            if (entry == NULL) {
+                fprintf(stderr, "Unknown word: %.*s\n", (int)object->str_obj.len, object->str_obj.str);
+                freeBytecode(bytecode);
+                return NULL;
+            }
+            if (entry->body != NULL) {
+                /* Bind the call now; the instruction owns the new word */
+                instr.opcode = TF_OP_WORD;
+                instr.operand.object = createOperandWordObject(callWordBody, object, entry->body);
+            } else {
+                instr = translateWord(entry->op);
+            }
+        } else {
+            fprintf(stderr, "Found an unexecutable object during execution.\n");
+            freeBytecode(bytecode);
+            return NULL;
+        }
+
+        bytecode->code[bytecode->len++] = instr;
+    }
+
+    bytecode->code[bytecode->len].opcode = TF_OP_HALT;
+    bytecode->code[bytecode->len].operand.object = NULL;
+    bytecode->len++;
+
+    computeHeadroom(bytecode);
+    return bytecode;
+}
+
+
+/*
+ * executeBytecode() implementation
+ *
+ * Each handler ends by dispatching the next instruction itself, so with
+ * computed goto every primitive gets its own indirect branch (and its own
+ * branch predictor history) instead of sharing one switch jump.
+ */
+void executeBytecode(tfbytecode *bytecode, tfcontext *context) {
+    if (bytecode == NULL || context == NULL) return;
+
+    tfobj *stack = context->stack;
+    const tfinstr *code = bytecode->code;
+    const tfinstr *ip = code;
+
+    /*
+     * Cached stack state: the stack holds depth items, the top one lives
+     * in tos and the others in base[0 .. depth-2]; base[depth-1] is stale
+     * until SPILL(). Capacity is reserved per call-free stretch of code
+     * from its precomputed headroom, so pushes never check it.
+     */
+    tfobj **base;
+    size_t depth;
+    tfobj *tos;
+
+#define RELOAD()                                                                \
+    do {                                                                        \
+        base = stack->list_obj.element;                                         \
+        depth = stack->list_obj.len;                                            \
+        tos = depth > 0 ? base[depth - 1] : NULL;                               \
+    } while (0)
+
+#define SPILL()                                                                 \
+    do {                                                                        \
+        if (depth > 0) base[depth - 1] = tos;                                   \
+        stack->list_obj.len = depth;                                            \
+    } while (0)
+
+#define RESERVE(headroom)                                                       \
+    do {                                                                        \
+        if (depth + (headroom) > stack->list_obj.capacity) {                    \
+            listReserve(stack, depth + (headroom));                             \
+            base = stack->list_obj.element;                                     \
+        }                                                                       \
+    } while (0)
+
+/* Runs a primitive out of line on the spilled stack */
+#define OUT_OF_LINE(call)                                                       \
+    do {                                                                        \
+        SPILL();                                                                \
+        call;                                                                   \
+        RELOAD();                                                               \
+    } while (0)
+
+#if TF_COMPUTED_GOTO
+    /* Indexed by TF_OPCODE: keep in the same order as the enum */
+    static void *const dispatch_table[] = {
+        &&op_TF_OP_PUSH,
+        &&op_TF_OP_PUSH_COUNTED,
+        &&op_TF_OP_ADD,
+        &&op_TF_OP_SUB,
+        &&op_TF_OP_MUL,
+        &&op_TF_OP_DIV,
+        &&op_TF_OP_PRINT,
+        &&op_TF_OP_DUP,
+        &&op_TF_OP_DROP,
+        &&op_TF_OP_SWAP,
+        &&op_TF_OP_SQUARE,
+        &&op_TF_OP_SWAP_SUB,
+        &&op_TF_OP_ADD_LIT,
+        &&op_TF_OP_SUB_LIT,
+        &&op_TF_OP_MUL_LIT,
+        &&op_TF_OP_DIV_LIT,
+        &&op_TF_OP_CALL,
+        &&op_TF_OP_WORD,
+        &&op_TF_OP_BRANCH,
+        &&op_TF_OP_BRANCH_IF_FALSE,
+        &&op_TF_OP_LOOP,
+        &&op_TF_OP_HALT
+    };
+#define TARGET(opcode) op_##opcode:
+#define DISPATCH() goto *dispatch_table[ip->opcode]
+#else
+#define TARGET(opcode) case opcode:
+#define DISPATCH() goto dispatch
+#endif
+
+/*
+ * Binary arithmetic on two immediate integers: the result replaces them in
+ * tos. overflows computes the untagged result r from the untagged x and y
+ * and is true when it is no immediate (see untagInteger()).
+ */
+#define INLINE_ARITHMETIC(overflows, fallback)                                  \
+    do {                                                                        \
+        if (depth >= 2) {                                                       \
+            tfobj *a = base[depth - 2];                                         \
+            if (((uintptr_t)a & TF_TAG_MASK) == TF_TAG_INT &&                   \
+                ((uintptr_t)tos & TF_TAG_MASK) == TF_TAG_INT) {                 \
+                intptr_t x = untagInteger(a), y = untagInteger(tos), r;         \
+                if (!(overflows)) {                                             \
+                    tos = tagInteger(r);                                        \
+                    depth--;                                                    \
+                    break;                                                      \
+                }                                                               \
+            }                                                                   \
+        }                                                                       \
+        OUT_OF_LINE(fallback(context));                                         \
+    } while (0)
+
+/* Arithmetic of the top of stack with an immediate literal, in tos */
+#define INLINE_LITERAL(overflows, fallback)                                     \
+    do {                                                                        \
+        tfobj *literal = ip->operand.object;                                    \
+        if (depth >= 1 && ((uintptr_t)literal & TF_TAG_MASK) == TF_TAG_INT &&   \
+            ((uintptr_t)tos & TF_TAG_MASK) == TF_TAG_INT) {                     \
+            intptr_t x = untagInteger(tos), y = untagInteger(literal), r;       \
+            if (!(overflows)) {                                                 \
+                tos = tagInteger(r);                                            \
+                break;                                                          \
+            }                                                                   \
+        }                                                                       \
+        OUT_OF_LINE(fallback(context, literal));                                \
+    } while (0)
+
+    RELOAD();
+    RESERVE(bytecode->headroom);
+
+    /* Enter the first handler */
+    DISPATCH();
+
+#if !TF_COMPUTED_GOTO
+dispatch:
+    switch (ip->opcode) {
+#endif
+
+    TARGET(TF_OP_PUSH) {
+        if (depth > 0) base[depth - 1] = tos;
+        tos = ip->operand.object;
+        depth++;
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_PUSH_COUNTED) {
+        tfobj *object = ip->operand.object;
+        if (depth > 0) base[depth - 1] = tos;
+        tos = object;
+        depth++;
+        incrementReferenceCount(object);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_ADD) {
+        INLINE_ARITHMETIC(__builtin_add_overflow(x, y, &r), operationAdd);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_SUB) {
+        INLINE_ARITHMETIC(__builtin_sub_overflow(x, y, &r), operationSub);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_MUL) {
+        INLINE_ARITHMETIC(__builtin_mul_overflow(x, y >> TF_TAG_SHIFT, &r), operationMul);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_DIV) {
+        /* Zero divisors take the slow path, which reports the error */
+        if (depth >= 2 && tos != createIntegerImmediate(0)) {
+            INLINE_ARITHMETIC(divideTagged(x, y, &r), operationDiv);
+        } else {
+            OUT_OF_LINE(operationDiv(context));
+        }
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_PRINT) {
+        OUT_OF_LINE(operationPrint(context));
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_DUP) {
+        /* dup of an empty stack is a no-op, as in operationDup() */
+        if (depth > 0) {
+            base[depth - 1] = tos;
+            depth++;
+            if (!isImmediate(tos)) incrementReferenceCount(tos);
+        }
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_DROP) {
+        if (depth > 0) {
+            tfobj *top = tos;
+            depth--;
+            tos = depth > 0 ? base[depth - 1] : NULL;
+            if (!isImmediate(top)) decrementReferenceCount(top);
+        } else {
+            OUT_OF_LINE(operationDrop(context));
+        }
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_SWAP) {
+        if (depth >= 2) {
+            tfobj *second = base[depth - 2];
+            base[depth - 2] = tos;
+            tos = second;
+        } else {
+            OUT_OF_LINE(operationSwap(context));
+        }
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_SQUARE) {
+        intptr_t x = untagInteger(tos), r;
+        if (depth > 0 && ((uintptr_t)tos & TF_TAG_MASK) == TF_TAG_INT &&
+            !__builtin_mul_overflow(x, x >> TF_TAG_SHIFT, &r)) {
+            tos = tagInteger(r);
+        } else {
+            OUT_OF_LINE(operationSquare(context));
+        }
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_SWAP_SUB) {
+        INLINE_ARITHMETIC(__builtin_sub_overflow(y, x, &r), operationSwapSub);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_ADD_LIT) {
+        INLINE_LITERAL(__builtin_add_overflow(x, y, &r), operationAddLiteral);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_SUB_LIT) {
+        INLINE_LITERAL(__builtin_sub_overflow(x, y, &r), operationSubLiteral);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_MUL_LIT) {
+        INLINE_LITERAL(__builtin_mul_overflow(x, y >> TF_TAG_SHIFT, &r), operationMulLiteral);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_DIV_LIT) {
+        /* A zero literal takes the slow path, which reports the error */
+        if (ip->operand.object != createIntegerImmediate(0)) {
+            INLINE_LITERAL(divideTagged(x, y, &r), operationDivLiteral);
+        } else {
+            OUT_OF_LINE(operationDivLiteral(context, ip->operand.object));
+        }
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_CALL) {
+        /* The callee may push any number of items: reserve for what follows */
+        OUT_OF_LINE(ip->operand.op(context));
+        RESERVE(ip->headroom);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_WORD) {
+        tfobj *word = ip->operand.object;
+        OUT_OF_LINE(word->word_obj.operand_op(context, word->word_obj.operand));
+        RESERVE(ip->headroom);
+        ip++;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_BRANCH) {
+        RESERVE(ip->headroom);
+        ip = code + ip->operand.target;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_BRANCH_IF_FALSE) {
+        int flag;
+        /* Immediate flags are false exactly when their payload is 0 */
+        if (depth > 0 && isImmediate(tos)) {
+            flag = ((uintptr_t)tos >> TF_TAG_SHIFT) != 0;
+            depth--;
+            tos = depth > 0 ? base[depth - 1] : NULL;
+        } else {
+            OUT_OF_LINE(flag = popFlag(context));
+        }
+        RESERVE(ip->headroom);
+        ip = flag ? ip + 1 : code + ip->operand.target;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_LOOP) {
+        /* The loop stack is separate from the data stack: no spill needed */
+        tfobj *loops = context->loops;
+        tfobj **frame = loops->list_obj.element + loops->list_obj.len - 2;
+        int again;
+        if (((uintptr_t)frame[0] & TF_TAG_MASK) == TF_TAG_INT &&
+            ((uintptr_t)frame[1] & TF_TAG_MASK) == TF_TAG_INT) {
+            /* index < limit, so index + 1 stays an immediate */
+            intptr_t index = ((intptr_t)frame[1] >> TF_TAG_SHIFT) + 1;
+            again = index < ((intptr_t)frame[0] >> TF_TAG_SHIFT);
+            if (again) frame[1] = createIntegerImmediate(index);
+            else loops->list_obj.len -= 2;
+        } else {
+            again = stepLoop(context);
+        }
+        RESERVE(ip->headroom);
+        ip = again ? code + ip->operand.target : ip + 1;
+        DISPATCH();
+    }
+
+    TARGET(TF_OP_HALT) {
+        SPILL();
+        return;
+    }
+
+#if !TF_COMPUTED_GOTO
+    }
+#endif
+
+#undef INLINE_ARITHMETIC
+#undef INLINE_LITERAL
+#undef OUT_OF_LINE
+#undef RESERVE
+#undef SPILL
+#undef RELOAD
+#undef TARGET
+#undef DISPATCH
+}
+
+
+/*
+ * freeBytecode() implementation
+ *
+ * Drops the references held by object operands, then the arrays.
+ */
+void freeBytecode(tfbytecode *bytecode) {
+    if (bytecode == NULL) return;
+
+    for (size_t i = 0; i < bytecode->len; i++) {
+        TF_OPCODE opcode = bytecode->code[i].opcode;
+        if (opcode == TF_OP_PUSH || opcode == TF_OP_PUSH_COUNTED || opcode == TF_OP_WORD ||
+            (opcode >= TF_OP_ADD_LIT && opcode <= TF_OP_DIV_LIT)) {
+            decrementReferenceCount(bytecode->code[i].operand.object);
+        }
+    }
+
+    free(bytecode->code);
+    free(bytecode);
+}
@@ -0,0 +1,127 @@
+/*
+ * Bytecode Engine Module
+ *
+ * Implements a second execution engine: the compiled program list is
+ * translated into a flat array of instructions (opcode + inline operand)
+ * and run by a token-threaded interpreter. Core primitives are executed
+ * inline in the dispatch loop instead of through an Operation call.
+ *
+ * Dispatch uses GCC/Clang computed goto ("&&label") when available, and
+ * falls back to a portable switch loop otherwise (or when built with
+ * -DTF_NO_COMPUTED_GOTO).
+ */
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "tforth.h"
+
+
+/*
+ * TF_OPCODE - Instruction set of the bytecode engine
+ *
+ * TF_OP_PUSH:  Pushes operand.object, an immediate or a pinned literal, onto
+ *              the data stack as a borrowed reference: no refcount is touched
+ * TF_OP_PUSH_COUNTED: Pushes operand.object, an ordinary boxed literal,
+ *              taking a new reference
+ * TF_OP_ADD..TF_OP_SWAP: Inlined versions of the core primitives
+ * TF_OP_SQUARE, TF_OP_SWAP_SUB: Inlined fused superinstructions
+ * TF_OP_ADD_LIT..TF_OP_DIV_LIT: Fused "<lit> op", literal in operand.object
+ * TF_OP_CALL:  Calls operand.op (any primitive without a dedicated opcode)
+ * TF_OP_WORD:  Runs the operand word held in operand.object
+ * TF_OP_BRANCH: Jumps to instruction operand.target
+ * TF_OP_BRANCH_IF_FALSE: Pops a flag and jumps to operand.target if false
+ * TF_OP_LOOP:  Steps the innermost do loop, jumps to operand.target while it runs
+ * TF_OP_HALT:  Ends execution (always the last instruction)
+ */
+typedef enum {
+    TF_OP_PUSH,
+    TF_OP_PUSH_COUNTED,
+    TF_OP_ADD,
+    TF_OP_SUB,
+    TF_OP_MUL,
+    TF_OP_DIV,
+    TF_OP_PRINT,
+    TF_OP_DUP,
+    TF_OP_DROP,
+    TF_OP_SWAP,
+    TF_OP_SQUARE,
+    TF_OP_SWAP_SUB,
+    TF_OP_ADD_LIT,
+    TF_OP_SUB_LIT,
+    TF_OP_MUL_LIT,
+    TF_OP_DIV_LIT,
+    TF_OP_CALL,
+    TF_OP_WORD,
+    TF_OP_BRANCH,
+    TF_OP_BRANCH_IF_FALSE,
+    TF_OP_LOOP,
+    TF_OP_HALT
+} TF_OPCODE;
+
+/*
+ * tfinstr - A single bytecode instruction
+ */
+typedef struct {
+    TF_OPCODE opcode;               /* What to execute */
+    unsigned int headroom;          /* Calls and branches: pushes until the next one */
+    union {
+        tfobj *object;              /* For the pushes, *_LIT and TF_OP_WORD (referenced) */
+        Operation op;               /* For TF_OP_CALL */
+        size_t target;              /* For branches: index of the instruction jumped to */
+    } operand;
+} tfinstr;
+
+/*
+ * tfbytecode - A program translated for the bytecode engine
+ */
+typedef struct {
+    tfinstr *code;                  /* Instructions, terminated by TF_OP_HALT */
+    size_t len;                     /* Number of instructions including TF_OP_HALT */
+    unsigned int headroom;          /* Pushes from the start until the first call */
+} tfbytecode;
+
+
+/*
+ * compileBytecode() - Translates a compiled program list into bytecode
+ *
+ * Maps every word bound to a core primitive onto its dedicated opcode and
+ * any other word onto TF_OP_CALL. Literals are referenced, not copied.
+ * Branch objects keep their targets, since list elements and instructions
+ * correspond one to one. Also records, for each stretch of code between
+ * calls and branches, how far above its starting depth the stack can
+ * grow, so the engine can reserve the capacity once per stretch.
+ *
+ * Args:
+ *   program_list - Compiled program produced by compile()
+ *
+ * Returns:
+ *   Newly allocated bytecode (free with freeBytecode()), or NULL if the
+ *   program contains an unknown word or unexecutable object
+ */
+tfbytecode *compileBytecode(tfobj *program_list);
+
+/*
+ * executeBytecode() - Runs a bytecode program on the virtual machine
+ *
+ * Produces exactly the same results and diagnostics as execute() on the
+ * program list the bytecode was compiled from. The top of the stack is
+ * kept in a local across instructions and only written back around
+ * primitives that run out of line.
+ *
+ * Args:
+ *   bytecode - Program returned by compileBytecode()
+ *   context  - VM execution context (contains the data stack)
+ */
+void executeBytecode(tfbytecode *bytecode, tfcontext *context);
+
+/*
+ * freeBytecode() - Releases a bytecode program and its literal references
+ *
+ * Args:
+ *   bytecode - Program to free (may be NULL; no-op if so)
+ */
+void freeBytecode(tfbytecode *bytecode);
+
+
+#endif
@@ -1,70 +1,344 @@
-/*
- * Operation Dictionary Implementation
- *
- * Implements a static lookup table of all built-in Forth primitives.
- * The dictionary is defined at compile-time and provides O(n) lookup
- * where n is the number of primitive operations.
- *
- * NOTE: All operation names are case-sensitive. Comparison uses strcmp().
- */
-
-#include <string.h>
-
-#include "dictionary.h"
-#include "ops.h"
-
-
-
-/* 
- * OperationEntry - Maps a Forth operation to its C implementation
- *
- * This structure pairs a string operation with a function pointer to the
- * corresponding operation implementation.
- */
-typedef struct {
-    const char *operation;  /* Forth operation name (NUL-terminated) */
-    Operation op;      /* Function pointer to the C implementation */
-} OperationEntry;
-
-
-
-/*
- * operations[] - Static dictionary of all built-in Forth primitives
- *
- * This table contains all primitive operations available in ToyForth.
- * The table is searched linearly by lookupOperation().
- *
- * NOTE: Operation names are lowercase and case-sensitive.
- *       "dup" is found; "DUP" or "Dup" will fail to resolve.
- */
-static const OperationEntry operations[] = {
-    {"+", operationAdd},
-    {"-", operationSub},
-    {"*", operationMul},
-    {"/", operationDiv},
-    {".", operationPrint},
-    {"dup", operationDup},
-    {"drop", operationDrop},
-    {"swap", operationSwap}
-};
-
-
-/* Calculate the number of operations in the dictionary */
-#define OP_COUNT (sizeof(operations) / sizeof(operations[0]))
-
-
-/*
- * lookupOperation() implementation
- *
- * Searches the operation dictionary for an operation name and returns the
- * corresponding function pointer. Uses linear search with strcmp().
- */
-Operation lookupOperation(const char *operation) {
-    for (size_t i = 0; i < OP_COUNT; i++) {
-        if (strcmp(operation, operations[i].operation) == 0) {
-            return operations[i].op;
-        }
-    }
-
-    return NULL;
-}
\ No newline at end of file
+/*
+ * Operation Dictionary Implementation
+ *
+ * Implements the dictionary as an open-addressing hash table with linear
+ * probing. It is seeded with every built-in primitive on first use, and
+ * user-defined words are added to the same table by defineWord(). The
+ * table doubles before it gets 70% full, so lookups stay O(1).
+ *
+ * NOTE: All operation names are case-sensitive.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dictionary.h"
+#include "mem.h"
+#include "ops.h"
+
+
+/* Initial number of slots; always a power of two */
+#define DICTIONARY_INITIAL_CAPACITY 64
+
+
+/* 
+ * OperationEntry - Maps a Forth operation to its C implementation
+ *
+ * This structure pairs a string operation with a function pointer to the
+ * corresponding operation implementation.
+ */
+typedef struct {
+    const char *operation;  /* Forth operation name (NUL-terminated) */
+    Operation op;      /* Function pointer to the C implementation */
+    tfeffect effect;        /* Stack effect, as documented in ops.h */
+} OperationEntry;
+
+
+
+/*
+ * operations[] - Static list of all built-in Forth primitives
+ *
+ * This table contains all primitive operations available in ToyForth.
+ * It seeds the hash table the first time the dictionary is used.
+ *
+ * NOTE: Operation names are lowercase and case-sensitive.
+ *       "dup" is found; "DUP" or "Dup" will fail to resolve.
+ */
+static const OperationEntry operations[] = {
+    {"+", operationAdd, {2, 1, 0}},
+    {"-", operationSub, {2, 1, 0}},
+    {"*", operationMul, {2, 1, 0}},
+    {"/", operationDiv, {2, 1, 0}},
+    {".", operationPrint, {1, 0, 0}},
+    {"dup", operationDup, {1, 2, 1}},
+    {"drop", operationDrop, {1, 0, 0}},
+    {"swap", operationSwap, {2, 2, 0}},
+    {"=", operationEqual, {2, 1, 0}},
+    {"<", operationLess, {2, 1, 0}},
+    {">", operationGreater, {2, 1, 0}},
+    {"do", operationDo, {2, 0, 0}},
+    {"i", operationLoopIndex, {0, 1, 1}},
+    {"flush", operationFlush, {0, 0, 0}},
+    {"pick", operationPick, {TF_EFFECT_UNKNOWN, 0, 0}},
+    {"roll", operationRoll, {TF_EFFECT_UNKNOWN, 0, 0}},
+    {"rot", operationRot, {3, 3, 0}},
+    {"ndrop", operationNDrop, {TF_EFFECT_UNKNOWN, 0, 0}},
+    {"ndup", operationNDup, {TF_EFFECT_UNKNOWN, 0, 0}},
+    {"array", operationArray, {TF_EFFECT_UNKNOWN, 0, 0}},
+    {"iota", operationIota, {1, 1, 0}},
+    {"length", operationLength, {1, 1, 0}},
+    {"at", operationAt, {2, 1, 0}},
+    {"sum", operationSum, {1, 1, 0}},
+    {"map+", operationMapAdd, {2, 1, 0}},
+    {"map*", operationMapMul, {2, 1, 0}},
+    {"dot", operationDot, {2, 1, 0}},
+    {"concat", operationConcat, {2, 1, 0}},
+    {"substr", operationSubstr, {3, 1, 0}},
+    {"split", operationSplit, {TF_EFFECT_UNKNOWN, 0, 0}},
+    {"strlen", operationStrlen, {1, 1, 0}}
+};
+
+
+/* Calculate the number of operations in the dictionary */
+#define OP_COUNT (sizeof(operations) / sizeof(operations[0]))
+
+
+/*
+ * ControlEntry - Marks a word as a control-flow word
+ */
+typedef struct {
+    const char *operation;  /* Forth word name */
+    TF_CONTROL control;     /* Role in the compiler */
+} ControlEntry;
+
+/*
+ * control_words[] - Words compiled into branches instead of calls
+ *
+ * "do" is also in operations[], since it compiles a call as well.
+ */
+static const ControlEntry control_words[] = {
+    {"if", TF_CONTROL_IF},
+    {"else", TF_CONTROL_ELSE},
+    {"then", TF_CONTROL_THEN},
+    {"begin", TF_CONTROL_BEGIN},
+    {"until", TF_CONTROL_UNTIL},
+    {"do", TF_CONTROL_DO},
+    {"loop", TF_CONTROL_LOOP}
+};
+
+#define CONTROL_COUNT (sizeof(control_words) / sizeof(control_words[0]))
+
+
+/*
+ * OperandOperationEntry - Maps a fused operand primitive to its implementation
+ */
+typedef struct {
+    const char *operation;  /* Internal name, e.g. "(lit+)" */
+    OperandOperation op;    /* Function pointer to the C implementation */
+} OperandOperationEntry;
+
+/*
+ * operand_operations[] - Superinstructions that carry an inline literal
+ *
+ * Kept apart from operations[] because they have a different signature and
+ * only exist in programs rewritten by fuseSuperinstructions().
+ */
+static const OperandOperationEntry operand_operations[] = {
+    {"(lit+)", operationAddLiteral},
+    {"(lit-)", operationSubLiteral},
+    {"(lit*)", operationMulLiteral},
+    {"(lit/)", operationDivLiteral}
+};
+
+#define OPERAND_OP_COUNT (sizeof(operand_operations) / sizeof(operand_operations[0]))
+
+
+/*
+ * fused_operations[] - Superinstructions replacing a pair of words
+ *
+ * Not in the dictionary either: they are primitives, but programs can only
+ * get them from fuseSuperinstructions(), never by writing their names.
+ */
+static const OperationEntry fused_operations[] = {
+    {"(dup*)", operationSquare, {1, 1, 0}},
+    {"(swap-)", operationSwapSub, {2, 1, 0}},
+    {"(dup.)", operationDupPrint, {1, 1, 0}}
+};
+
+#define FUSED_OP_COUNT (sizeof(fused_operations) / sizeof(fused_operations[0]))
+
+
+/*
+ * Dictionary table state
+ *
+ * A power-of-two array of entries; a slot is empty when its name is NULL.
+ */
+static tfentry *table = NULL;
+static size_t table_capacity = 0;
+static size_t table_count = 0;
+
+
+/*
+ * findSlot() - Returns the slot holding a name, or the empty slot ending its probe
+ */
+static tfentry *findSlot(const char *name, size_t len, unsigned int hash) {
+    size_t mask = table_capacity - 1;
+    size_t i = hash & mask;
+
+    while (table[i].name != NULL) {
+        if (table[i].hash == hash && table[i].len == len && memcmp(table[i].name, name, len) == 0) {
+            return &table[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    return &table[i];
+}
+
+
+/*
+ * growTable() - Doubles the table and reinserts every entry
+ */
+static void growTable(void) {
+    tfentry *old_table = table;
+    size_t old_capacity = table_capacity;
+
+    table_capacity = old_capacity ? old_capacity * 2 : DICTIONARY_INITIAL_CAPACITY;
+    table = wmalloc(sizeof(tfentry) * table_capacity);
+    memset(table, 0, sizeof(tfentry) * table_capacity);
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_table[i].name != NULL) {
+            *findSlot(old_table[i].name, old_table[i].len, old_table[i].hash) = old_table[i];
+        }
+    }
+
+    free(old_table);
+}
+
+
+/*
+ * insertEntry() - Returns the entry for a name, creating an empty one if needed
+ *
+ * New entries take a private copy of the name.
+ */
+static tfentry *insertEntry(const char *name, size_t len, unsigned int hash) {
+    if ((table_count + 1) * 10 > table_capacity * 7) growTable();
+
+    tfentry *entry = findSlot(name, len, hash);
+    if (entry->name == NULL) {
+        char *copy = wmalloc(len + 1);
+        memcpy(copy, name, len);
+        copy[len] = '\0';
+
+        entry->name = copy;
+        entry->len = len;
+        entry->hash = hash;
+        entry->op = NULL;
+        entry->body = NULL;
+        entry->effect.in = TF_EFFECT_UNKNOWN;
+        entry->control = TF_CONTROL_NONE;
+        table_count++;
+    }
+
+    return entry;
+}
+
+
+/*
+ * ensureDictionary() - Seeds the table with the primitives on first use
+ */
+static void ensureDictionary(void) {
+    if (table != NULL) return;
+
+    growTable();
+    for (size_t i = 0; i < OP_COUNT; i++) {
+        const char *name = operations[i].operation;
+        size_t len = strlen(name);
+        tfentry *entry = insertEntry(name, len, hashString(name, len));
+        entry->op = operations[i].op;
+        entry->effect = operations[i].effect;
+    }
+    for (size_t i = 0; i < CONTROL_COUNT; i++) {
+        const char *name = control_words[i].operation;
+        size_t len = strlen(name);
+        insertEntry(name, len, hashString(name, len))->control = control_words[i].control;
+    }
+}
+
+
+/*
+ * lookupOperation() implementation
+ *
+ * Hashes the name and probes the table. Only primitives are returned.
+ */
+Operation lookupOperation(const char *operation) {
+    ensureDictionary();
+
+    size_t len = strlen(operation);
+    tfentry *entry = findSlot(operation, len, hashString(operation, len));
+
+    return entry->name != NULL ? entry->op : NULL;
+}
+
+
+/*
+ * lookupWord() implementation
+ *
+ * Probes with the symbol's precomputed hash.
+ */
+tfentry *lookupWord(tfobj *symbol) {
+    ensureDictionary();
+
+    tfentry *entry = findSlot(symbol->str_obj.str, symbol->str_obj.len, symbol->str_obj.hash);
+
+    return entry->name != NULL ? entry : NULL;
+}
+
+
+/*
+ * defineWord() implementation
+ *
+ * A redefinition drops the previous body (or shadows the primitive);
+ * words already compiled against it hold their own reference.
+ */
+void defineWord(tfobj *symbol, tfobj *body, tfeffect effect) {
+    ensureDictionary();
+
+    tfentry *entry = insertEntry(symbol->str_obj.str, symbol->str_obj.len, symbol->str_obj.hash);
+
+    incrementReferenceCount(body);
+    decrementReferenceCount(entry->body);
+    entry->body = body;
+    entry->op = NULL;
+    entry->effect = effect;
+    entry->control = TF_CONTROL_NONE;
+}
+
+
+/*
+ * freezeDictionary() implementation
+ *
+ * Also seeds the table, so that concurrent lookups find it built.
+ */
+void freezeDictionary(void) {
+    ensureDictionary();
+
+    for (size_t i = 0; i < table_capacity; i++) {
+        if (table[i].name == NULL) continue;
+        decrementReferenceCount(internSymbol(table[i].name, table[i].len));
+        pinObject(table[i].body);
+    }
+}
+
+
+/*
+ * lookupOperandOperation() implementation
+ *
+ * Linear search over the handful of operand primitives.
+ */
+OperandOperation lookupOperandOperation(const char *operation) {
+    for (size_t i = 0; i < OPERAND_OP_COUNT; i++) {
+        if (strcmp(operation, operand_operations[i].operation) == 0) {
+            return operand_operations[i].op;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * lookupFusedOperation() implementation
+ *
+ * Linear search, like lookupOperandOperation().
+ */
+Operation lookupFusedOperation(const char *operation) {
+    for (size_t i = 0; i < FUSED_OP_COUNT; i++) {
+        if (strcmp(operation, fused_operations[i].operation) == 0) {
+            return fused_operations[i].op;
+        }
+    }
+
+    return NULL;
+}
@@ -1,39 +1,140 @@
-/*
- * Operation Dictionary Module
- *
- * Implements a static lookup table mapping Forth word names (strings) to
- * their corresponding C implementations. The dictionary is built at compile
- * time and provides O(n) lookup where n is the number of primitives.
- */
-
-#ifndef DICTIONARY_H
-#define DICTIONARY_H
-
-#include "tforth.h"
-
-
-/*
- * Operation - Function pointer type for built-in Forth operations
- *
- * All Forth primitives have the same signature: they take a context pointer
- * and modify the VM state (typically by popping operands, computing, and
- * pushing results onto the stack).
- */
-typedef void (*Operation)(tfcontext *context);
-
-/*
- * lookupOperation() - Resolves a Forth operation to its implementation
- *
- * Searches the built-in primitive dictionary for the given operation.
- * Comparison is case-sensitive ("dup" ≠ "DUP").
- *
- * Args:
- *   operation - Operation to look up (NUL-terminated string)
- *
- * Returns:
- *   Function pointer to the operation if found, or NULL if unknown
- */
-Operation lookupOperation(const char *operation);
-
-
-#endif 
\ No newline at end of file
+/*
+ * Operation Dictionary Module
+ *
+ * Implements the dictionary mapping Forth word names to their definitions:
+ * built-in primitives (C implementations) and user-defined words created
+ * with ": name ... ;" (compiled program lists). The dictionary is an
+ * open-addressing hash table, so lookup stays constant-time as libraries
+ * add hundreds of words.
+ */
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include "tforth.h"
+
+
+/*
+ * TF_CONTROL - Control-flow role of a dictionary word
+ *
+ * Control words are not executed: the compiler turns them into branch
+ * objects with resolved targets. TF_CONTROL_DO is the exception, it also
+ * compiles a call to its primitive, which starts the loop at runtime.
+ */
+typedef enum {
+    TF_CONTROL_NONE,               /* Ordinary word */
+    TF_CONTROL_IF,                 /* if:    branch past the true part on false */
+    TF_CONTROL_ELSE,               /* else:  start of the false part */
+    TF_CONTROL_THEN,               /* then:  end of an if */
+    TF_CONTROL_BEGIN,              /* begin: start of an until loop */
+    TF_CONTROL_UNTIL,              /* until: branch back to begin on false */
+    TF_CONTROL_DO,                 /* do:    start of a counted loop */
+    TF_CONTROL_LOOP                /* loop:  step the index, branch back to do */
+} TF_CONTROL;
+
+
+/*
+ * tfentry - A dictionary entry (primitive or user-defined word)
+ *
+ * Exactly one of op and body is set, except for control words other than
+ * do, which have neither. Entries live in the table until the
+ * program ends; a redefinition replaces the body in place, while words
+ * compiled earlier keep a reference to the body they were bound to.
+ */
+typedef struct {
+    const char *name;               /* NUL-terminated word name, NULL for an empty slot */
+    size_t len;                     /* Length of name in bytes */
+    unsigned int hash;              /* hashString() of name */
+    Operation op;                   /* Primitive implementation, or NULL */
+    tfobj *body;                    /* Compiled TF_OBJ_LIST of a user word, or NULL */
+    tfeffect effect;                /* Static stack effect, for compile-time checks */
+    TF_CONTROL control;             /* Control-flow role, TF_CONTROL_NONE for most words */
+} tfentry;
+
+
+/*
+ * lookupOperation() - Resolves a Forth operation to its implementation
+ *
+ * Searches the dictionary for a built-in primitive with the given name.
+ * Comparison is case-sensitive ("dup" ≠ "DUP"). User-defined words are
+ * not primitives and yield NULL; use lookupWord() to find them.
+ *
+ * Args:
+ *   operation - Operation to look up (NUL-terminated string)
+ *
+ * Returns:
+ *   Function pointer to the operation if found, or NULL if unknown
+ */
+Operation lookupOperation(const char *operation);
+
+/*
+ * lookupWord() - Resolves a symbol to its dictionary entry
+ *
+ * Uses the hash precomputed when the symbol was created, so the lookup
+ * costs one probe sequence and a single string comparison on a hit.
+ *
+ * Args:
+ *   symbol - TF_OBJ_SYMBOL naming the word
+ *
+ * Returns:
+ *   The entry (primitive or user word), or NULL if the word is unknown
+ */
+tfentry *lookupWord(tfobj *symbol);
+
+/*
+ * defineWord() - Adds or redefines a user word
+ *
+ * Binds the name to a compiled program list. Redefining a primitive, a
+ * control word or a user word shadows it for code compiled afterwards.
+ *
+ * Args:
+ *   symbol - TF_OBJ_SYMBOL naming the word
+ *   body   - Compiled TF_OBJ_LIST (the dictionary takes a reference)
+ *   effect - Stack effect of body, as computed by the compiler
+ */
+void defineWord(tfobj *symbol, tfobj *body, tfeffect effect);
+
+/*
+ * freezeDictionary() - Readies the dictionary for concurrent compilation
+ *
+ * Interns the name of every word, so that threads can resolve names with
+ * findSymbol(), and pins the bodies of all user words defined so far
+ * (see pinObject()), so that compiling a use of one writes nothing to
+ * it. Threads can then compile against the dictionary concurrently,
+ * provided none of them defines a word. Bodies replaced later by a
+ * redefinition are never freed.
+ */
+void freezeDictionary(void);
+
+/*
+ * lookupOperandOperation() - Resolves a fused operand primitive by name
+ *
+ * Searches the table of operand primitives such as "(lit+)". These names
+ * are only produced by the superinstruction pass; lookupOperation() does
+ * not know them, so they can never appear as tokens in a program.
+ *
+ * Args:
+ *   operation - Operation to look up (NUL-terminated string)
+ *
+ * Returns:
+ *   Function pointer to the operation if found, or NULL if unknown
+ */
+OperandOperation lookupOperandOperation(const char *operation);
+
+/*
+ * lookupFusedOperation() - Resolves a fused pair primitive by name
+ *
+ * Searches the table of superinstructions such as "(dup*)" that replace
+ * a pair of words. Like the operand primitives, they are only produced by
+ * the superinstruction pass and cannot be written in a program.
+ *
+ * Args:
+ *   operation - Operation to look up (NUL-terminated string)
+ *
+ * Returns:
+ *   Function pointer to the operation if found, or NULL if unknown
+ */
+Operation lookupFusedOperation(const char *operation);
+
+
+#endif
@@ -1,41 +1,527 @@
-/*
- * Execution Engine Implementation
- *
- * Implements the core interpreter loop that executes a pre-compiled program
- * list on a ToyForth virtual machine. The engine maintains VM state through
- * an execution context and processes each compiled object in sequence.
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-
-#include "engine.h"
-#include "dictionary.h"
-#include "stack.h"
-
-
-void execute(tfobj *program_list, tfcontext *context) {
-    if (program_list == NULL || context == NULL) return;
-     
-    for (size_t i = 0; i < program_list->list_obj.len; i++) {
-        tfobj *object = program_list->list_obj.element[i];
-
-        if (object->type == TF_OBJ_INT || object->type == TF_OBJ_BOOL) {
-            stackPush(context, object);
-        } 
-        else if (object->type == TF_OBJ_SYMBOL) {
-            Operation op = lookupOperation(object->str_obj.str);
-            
-            if (op != NULL) {
-                op(context);
-            } else {
-                fprintf(stderr, "Unknown word: %s\n", object->str_obj.str);
-                exit(EXIT_FAILURE);
-            }
-        }
-        else {
-            fprintf(stderr, "Found an unexecutable object during execution.\n");
-            exit(EXIT_FAILURE);
-        }
-    }
-}
\ No newline at end of file
+/*
+ * Execution Engine Implementation
+ *
+ * Implements the core interpreter loop that executes a pre-compiled program
+ * list on a ToyForth virtual machine. The engine maintains VM state through
+ * an execution context and processes the compiled objects in sequence,
+ * following branch objects to their precomputed targets.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "engine.h"
+#include "dictionary.h"
+#include "stack.h"
+#include "mem.h"
+#include "ops.h"
+#include "output.h"
+
+
+/* Number of entries printed by the pair counter report */
+#define PAIR_REPORT_LIMIT 20
+
+/* Initial slots of the profiler's table (a power of two) */
+#define PROFILE_INITIAL_CAPACITY 64
+
+/*
+ * tfrecovery - Where runtime errors of a context return to
+ */
+struct tfrecovery {
+    sigjmp_buf jump;                /* Saved by executeRecovering() */
+};
+
+
+/*
+ * executeObject() - Executes a single compiled object
+ *
+ * Shared by execute() and executeCountingPairs() so both interpret the
+ * program identically. Returns the index of the next object to run:
+ * ip + 1, or the target of a taken branch.
+ */
+static inline size_t executeObject(tfobj *object, size_t ip, tfcontext *context) {
+    if (isImmediate(object)) {
+        /* Tagged integers and booleans: no refcount, no allocation */
+        stackPush(context, object);
+    } 
+    else if (object->type == TF_OBJ_INT || object->type == TF_OBJ_BOOL || object->type == TF_OBJ_STR) {
+        stackPush(context, object);
+    } 
+    else if (object->type == TF_OBJ_WORD) {
+        /* Resolved at compile time: a direct call, no dictionary search */
+        if (object->word_obj.operand != NULL) {
+            object->word_obj.operand_op(context, object->word_obj.operand);
+        } else {
+            object->word_obj.op(context);
+        }
+    }
+    else if (object->type == TF_OBJ_BRANCH) {
+        int taken;
+
+        switch (object->branch_obj.kind) {
+        case TF_BRANCH_IF_FALSE: taken = !popFlag(context); break;
+        case TF_BRANCH_LOOP:     taken = stepLoop(context); break;
+        default:                 taken = 1; break;
+        }
+        if (taken) return object->branch_obj.target;
+    }
+    else if (object->type == TF_OBJ_SYMBOL) {
+        tfentry *entry = lookupWord(object);
+        
+        if (entry != NULL && entry->body != NULL) {
+            callWordBody(context, entry->body);
+        } else if (entry != NULL) {
+            entry->op(context);
+        } else {
+            runtimeError(context, "Unknown word: %.*s", (int)object->str_obj.len, object->str_obj.str);
+        }
+    }
+    else {
+        runtimeError(context, "Found an unexecutable object during execution.");
+    }
+
+    return ip + 1;
+}
+
+
+/*
+ * runtimeError() implementation
+ */
+void runtimeError(tfcontext *context, const char *format, ...) {
+    va_list arguments;
+
+    outputFlush(&context->output);
+    va_start(arguments, format);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+    fputc('\n', stderr);
+
+    recoverContext(context);
+    exit(EXIT_FAILURE);
+}
+
+
+/*
+ * executeRecovering() implementation
+ *
+ * The signal mask is saved as well, so that an error raised from a
+ * signal handler (see stack.c) leaves the signal unblocked.
+ */
+int executeRecovering(tfcontext *context, void (*run)(tfcontext *context, void *argument), void *argument) {
+    struct tfrecovery recovery;
+    struct tfrecovery *outer = context->recovery;
+
+    context->recovery = &recovery;
+    if (sigsetjmp(recovery.jump, 1) != 0) {
+        context->recovery = outer;
+        return 0;
+    }
+
+    run(context, argument);
+    context->recovery = outer;
+    return 1;
+}
+
+
+/*
+ * recoverContext() implementation
+ */
+void recoverContext(tfcontext *context) {
+    if (context->recovery != NULL) siglongjmp(context->recovery->jump, 1);
+}
+
+
+/*
+ * execute() implementation
+ *
+ * An instruction-pointer loop: branch targets are list indices resolved
+ * by the compiler, so a jump is a plain assignment.
+ */
+void execute(tfobj *program_list, tfcontext *context) {
+    if (program_list == NULL || context == NULL) return;
+
+    size_t ip = 0;
+    while (ip < program_list->list_obj.len) {
+        ip = executeObject(program_list->list_obj.element[ip], ip, context);
+    }
+}
+
+
+/*
+ * executeCountingWords() implementation
+ *
+ * Calls are stepped into here rather than through callWordBody(), so the
+ * objects of every body run are counted as well.
+ */
+size_t executeCountingWords(tfobj *program_list, tfcontext *context) {
+    if (program_list == NULL || context == NULL) return 0;
+
+    size_t count = 0;
+    size_t ip = 0;
+    while (ip < program_list->list_obj.len) {
+        tfobj *object = program_list->list_obj.element[ip];
+        count++;
+
+        if (!isImmediate(object) && object->type == TF_OBJ_WORD &&
+            object->word_obj.operand_op == callWordBody && object->word_obj.operand != NULL) {
+            count += executeCountingWords(object->word_obj.operand, context);
+            ip++;
+        } else {
+            ip = executeObject(object, ip, context);
+        }
+    }
+
+    return count;
+}
+
+
+/*
+ * callWordBody() implementation
+ *
+ * A user word call is a nested run of the engine over the callee's list.
+ */
+void callWordBody(tfcontext *context, tfobj *body) {
+    execute(body, context);
+}
+
+
+/*
+ * PairCount - Number of times one object was executed right after another
+ *
+ * Objects are labelled by interned symbols, so pairs match by pointer.
+ */
+typedef struct {
+    tfobj *first;           /* Label of the first object */
+    tfobj *second;          /* Label of the object executed next */
+    size_t count;           /* Occurrences in the trace */
+} PairCount;
+
+
+/*
+ * objectLabel() - Names an executed object for the pair report
+ *
+ * All literals share the "<lit>" label, since fusions match any literal.
+ * Returns a borrowed reference; the intern table keeps labels alive.
+ */
+static tfobj *objectLabel(tfobj *object, tfobj *literal, tfobj *other) {
+    TF_OBJ_TYPE type = getObjectType(object);
+
+    if (type == TF_OBJ_INT || type == TF_OBJ_BOOL || type == TF_OBJ_STR) return literal;
+    if (type == TF_OBJ_WORD) return object->word_obj.symbol;
+    if (type == TF_OBJ_SYMBOL) return object;
+    if (type == TF_OBJ_BRANCH) return object->branch_obj.symbol;
+    return other;
+}
+
+
+/*
+ * compareLabels() - Orders two labels by name, like strcmp()
+ */
+static int compareLabels(tfobj *a, tfobj *b) {
+    if (a == b) return 0;
+    return strcmp(a->str_obj.str, b->str_obj.str);
+}
+
+
+/*
+ * comparePairCounts() - qsort() comparator, most frequent pair first
+ */
+static int comparePairCounts(const void *a, const void *b) {
+    const PairCount *x = a;
+    const PairCount *y = b;
+
+    if (x->count != y->count) return x->count < y->count ? 1 : -1;
+    int order = compareLabels(x->first, y->first);
+    return order != 0 ? order : compareLabels(x->second, y->second);
+}
+
+
+/*
+ * executeCountingPairs() implementation
+ *
+ * Runs the program like execute() while counting every adjacent pair of
+ * executed objects. The number of distinct pairs is small (bounded by the
+ * dictionary size squared), so a linear table is enough for a diagnostic
+ * mode.
+ */
+void executeCountingPairs(tfobj *program_list, tfcontext *context) {
+    if (program_list == NULL || context == NULL) return;
+
+    size_t len = 0, capacity = INITIAL_STACK_CAPACITY;
+    PairCount *pairs = wmalloc(sizeof(PairCount) * capacity);
+    tfobj *literal = internSymbol("<lit>", 5);
+    tfobj *other = internSymbol("<obj>", 5);
+    tfobj *previous = NULL;
+
+    size_t ip = 0;
+    while (ip < program_list->list_obj.len) {
+        tfobj *object = program_list->list_obj.element[ip];
+        tfobj *label = objectLabel(object, literal, other);
+
+        if (previous != NULL) {
+            size_t j = 0;
+            while (j < len && (pairs[j].first != previous || pairs[j].second != label)) {
+                j++;
+            }
+            if (j == len) {
+                if (len == capacity) {
+                    capacity *= 2;
+                    pairs = wrealloc(pairs, sizeof(PairCount) * capacity);
+                }
+                pairs[len].first = previous;
+                pairs[len].second = label;
+                pairs[len].count = 0;
+                len++;
+            }
+            pairs[j].count++;
+        }
+
+        ip = executeObject(object, ip, context);
+        previous = label;
+    }
+
+    qsort(pairs, len, sizeof(PairCount), comparePairCounts);
+
+    /* The program's own output comes before the report */
+    outputFlush(&context->output);
+    fprintf(stderr, "Most frequent word pairs:\n");
+    for (size_t j = 0; j < len && j < PAIR_REPORT_LIMIT; j++) {
+        fprintf(stderr, "%10zu  %s %s\n", pairs[j].count,
+                pairs[j].first->str_obj.str, pairs[j].second->str_obj.str);
+    }
+
+    free(pairs);
+    decrementReferenceCount(literal);
+    decrementReferenceCount(other);
+}
+
+
+/*
+ * ProfileEntry - Time spent on one label (word, literal or branch)
+ */
+typedef struct {
+    tfobj *label;           /* Interned label, NULL for a free slot */
+    size_t calls;           /* Times executed */
+    uint64_t total_ns;      /* Time including the bodies of user words */
+    uint64_t self_ns;       /* Time excluding the bodies of user words */
+} ProfileEntry;
+
+/*
+ * Profile - State of one executeProfiling() run
+ *
+ * Entries are an open-addressing table keyed by label pointer, so finding
+ * the entry of an executed object takes constant time.
+ */
+typedef struct {
+    ProfileEntry *entry;
+    size_t capacity;        /* Slots, a power of two */
+    size_t len;             /* Slots in use */
+    size_t objects;         /* Objects executed */
+    size_t max_depth;       /* Deepest data stack seen between two objects */
+    tfobj *literal;         /* Label shared by all literals */
+    tfobj *other;           /* Label of anything else */
+} Profile;
+
+
+/*
+ * profileClock() - Reads the monotonic clock in nanoseconds
+ */
+static uint64_t profileClock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+
+/*
+ * profileSlot() - Finds the slot of a label, or the free slot it belongs in
+ */
+static ProfileEntry *profileSlot(ProfileEntry *entry, size_t capacity, tfobj *label) {
+    size_t slot = (size_t)(((uintptr_t)label >> 4) * 2654435761u) & (capacity - 1);
+
+    while (entry[slot].label != NULL && entry[slot].label != label) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+
+    return &entry[slot];
+}
+
+
+/*
+ * profileEntry() - Returns the entry of a label, adding it if needed
+ *
+ * The table is kept at most half full. The returned pointer is only valid
+ * until the next call.
+ */
+static ProfileEntry *profileEntry(Profile *profile, tfobj *label) {
+    ProfileEntry *entry = profileSlot(profile->entry, profile->capacity, label);
+    if (entry->label != NULL) return entry;
+
+    if ((profile->len + 1) * 2 > profile->capacity) {
+        size_t capacity = profile->capacity * 2;
+        ProfileEntry *grown = wmalloc(sizeof(ProfileEntry) * capacity);
+        memset(grown, 0, sizeof(ProfileEntry) * capacity);
+
+        for (size_t i = 0; i < profile->capacity; i++) {
+            if (profile->entry[i].label != NULL) {
+                *profileSlot(grown, capacity, profile->entry[i].label) = profile->entry[i];
+            }
+        }
+        free(profile->entry);
+        profile->entry = grown;
+        profile->capacity = capacity;
+        entry = profileSlot(grown, capacity, label);
+    }
+
+    entry->label = label;
+    profile->len++;
+    return entry;
+}
+
+
+/*
+ * profileList() - Runs a list like execute(), timing every object
+ *
+ * Calls to user words are stepped into, so their bodies are profiled too
+ * and the call is charged with its body's time only in total_ns. Returns
+ * the wall time spent on the list, clock reads included, so a caller's
+ * self time does not absorb the profiling overhead of its callees.
+ */
+static uint64_t profileList(Profile *profile, tfobj *program_list, tfcontext *context) {
+    uint64_t begin = profileClock();
+    size_t ip = 0;
+
+    while (ip < program_list->list_obj.len) {
+        tfobj *object = program_list->list_obj.element[ip];
+        uint64_t nested = 0;
+        uint64_t start = profileClock();
+
+        if (!isImmediate(object) && object->type == TF_OBJ_WORD &&
+            object->word_obj.operand_op == callWordBody && object->word_obj.operand != NULL) {
+            nested = profileList(profile, object->word_obj.operand, context);
+            ip++;
+        } else {
+            ip = executeObject(object, ip, context);
+        }
+
+        uint64_t spent = profileClock() - start;
+        ProfileEntry *entry = profileEntry(profile, objectLabel(object, profile->literal, profile->other));
+        entry->calls++;
+        entry->total_ns += spent;
+        entry->self_ns += spent > nested ? spent - nested : 0;
+
+        profile->objects++;
+        if (context->stack->list_obj.len > profile->max_depth) {
+            profile->max_depth = context->stack->list_obj.len;
+        }
+    }
+
+    return profileClock() - begin;
+}
+
+
+/*
+ * compareProfileEntries() - qsort() comparator, most self time first
+ */
+static int compareProfileEntries(const void *a, const void *b) {
+    const ProfileEntry *x = a;
+    const ProfileEntry *y = b;
+
+    if (x->self_ns != y->self_ns) return x->self_ns < y->self_ns ? 1 : -1;
+    if (x->calls != y->calls) return x->calls < y->calls ? 1 : -1;
+    return 0;
+}
+
+
+/*
+ * writeJsonString() - Writes bytes as a JSON string literal
+ */
+static void writeJsonString(FILE *out, const char *str, size_t len) {
+    fputc('"', out);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+
+/*
+ * executeProfiling() implementation
+ *
+ * The report is sorted by self time. Only the run itself is measured;
+ * the table and the clock reads are the profiler's own overhead.
+ */
+int executeProfiling(tfobj *program_list, tfcontext *context, const char *json_path) {
+    if (program_list == NULL || context == NULL) return 1;
+
+    Profile profile = {NULL, PROFILE_INITIAL_CAPACITY, 0, 0, context->stack->list_obj.len,
+                       internSymbol("<lit>", 5), internSymbol("<obj>", 5)};
+    profile.entry = wmalloc(sizeof(ProfileEntry) * profile.capacity);
+    memset(profile.entry, 0, sizeof(ProfileEntry) * profile.capacity);
+
+    size_t created, freed, created_after, freed_after;
+    objectCounts(&created, &freed);
+    uint64_t elapsed = profileList(&profile, program_list, context);
+    objectCounts(&created_after, &freed_after);
+    outputFlush(&context->output);
+
+    /* Compact the used slots and sort them */
+    size_t len = 0;
+    for (size_t i = 0; i < profile.capacity; i++) {
+        if (profile.entry[i].label != NULL) profile.entry[len++] = profile.entry[i];
+    }
+    qsort(profile.entry, len, sizeof(ProfileEntry), compareProfileEntries);
+
+    int ok = 1;
+    FILE *out = stderr;
+    if (json_path != NULL && (out = fopen(json_path, "w")) == NULL) {
+        fprintf(stderr, "Error. Couldn't write profile %s.\n", json_path);
+        ok = 0;
+    } else if (json_path != NULL) {
+        fprintf(out, "{\n  \"objects\": %zu,\n  \"elapsed_ns\": %llu,\n", profile.objects, (unsigned long long)elapsed);
+        fprintf(out, "  \"objects_created\": %zu,\n  \"objects_freed\": %zu,\n", created_after - created, freed_after - freed);
+        fprintf(out, "  \"max_stack_depth\": %zu,\n  \"words\": [", profile.max_depth);
+        for (size_t i = 0; i < len; i++) {
+            ProfileEntry *entry = &profile.entry[i];
+            fprintf(out, "%s\n    {\"word\": ", i > 0 ? "," : "");
+            writeJsonString(out, entry->label->str_obj.str, entry->label->str_obj.len);
+            fprintf(out, ", \"calls\": %zu, \"total_ns\": %llu, \"self_ns\": %llu}", entry->calls,
+                    (unsigned long long)entry->total_ns, (unsigned long long)entry->self_ns);
+        }
+        fprintf(out, "\n  ]\n}\n");
+
+        if (fclose(out) != 0) {
+            fprintf(stderr, "Error. Couldn't write profile %s.\n", json_path);
+            ok = 0;
+        }
+    } else {
+        fprintf(out, "Profile: %zu objects in %.3f ms, %zu objects created, %zu freed, deepest stack %zu\n",
+                profile.objects, elapsed / 1e6, created_after - created, freed_after - freed, profile.max_depth);
+        fprintf(out, "%12s %12s %12s %7s  %s\n", "calls", "total ms", "self ms", "self %", "word");
+        for (size_t i = 0; i < len; i++) {
+            ProfileEntry *entry = &profile.entry[i];
+            fprintf(out, "%12zu %12.3f %12.3f %6.1f%%  %s\n", entry->calls, entry->total_ns / 1e6,
+                    entry->self_ns / 1e6, elapsed > 0 ? 100.0 * entry->self_ns / elapsed : 0.0,
+                    entry->label->str_obj.str);
+        }
+    }
+
+    free(profile.entry);
+    decrementReferenceCount(profile.literal);
+    decrementReferenceCount(profile.other);
+    return ok;
+}
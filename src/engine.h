@@ -1,30 +1,146 @@
-/*
- * Execution Engine Module
- *
- * Implements the core interpreter loop that executes a compiled program
- * list on a ToyForth virtual machine.
- */
-
-#ifndef ENGINE_H
-#define ENGINE_H
-
-#include "tforth.h"
-
-
-/*
- * execute() - Executes a compiled program list on the virtual machine
- *
- * Iterates through each object in the compiled program list and executes it:
- *   - TF_OBJ_INT/BOOL: Pushed onto the data stack
- *   - TF_OBJ_SYMBOL: Looked up in the operation dictionary and executed
- *
- * Unknown operations cause immediate program termination with error message.
- *
- * Args:
- *   program_list - Compiled program (TF_OBJ_LIST of executable objects)
- *   context      - VM execution context (contains the data stack)
- */
-void execute(tfobj *program_list, tfcontext *context);
-
-
+/*
+ * Execution Engine Module
+ *
+ * Implements the core interpreter loop that executes a compiled program
+ * list on a ToyForth virtual machine.
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stddef.h>
+
+#include "tforth.h"
+
+
+/*
+ * execute() - Executes a compiled program list on the virtual machine
+ *
+ * Iterates through each object in the compiled program list and executes it:
+ *   - TF_OBJ_INT/BOOL: Pushed onto the data stack
+ *   - TF_OBJ_WORD: Executed through its pre-resolved function pointer
+ *                  (fused words receive their inline literal operand)
+ *   - TF_OBJ_SYMBOL: Looked up in the operation dictionary and executed
+ *   - TF_OBJ_BRANCH: Continues at its target if taken (always, on a false
+ *                    flag, or while the innermost do loop runs again)
+ *
+ * Unknown operations cause immediate program termination with error message.
+ *
+ * Args:
+ *   program_list - Compiled program (TF_OBJ_LIST of executable objects)
+ *   context      - VM execution context (contains the data stack)
+ */
+void execute(tfobj *program_list, tfcontext *context);
+
+/*
+ * runtimeError() - Reports a runtime error and abandons the program
+ *
+ * Flushes the context's output so it comes before the message, then
+ * prints the printf-style message to stderr. Terminates the process,
+ * unless the program runs under executeRecovering(), which then returns.
+ *
+ * Args:
+ *   context - Context of the failing program
+ *   format  - printf() format of the message, without the newline
+ */
+void runtimeError(tfcontext *context, const char *format, ...);
+
+/*
+ * executeRecovering() - Runs code on a context, surviving runtime errors
+ *
+ * A runtime error inside run makes this return 0 instead of ending the
+ * process. The context's stacks are then in no defined state and should
+ * be reset, and objects the failing word was holding are leaked. Calls
+ * may nest; an error returns from the innermost one.
+ *
+ * Args:
+ *   context  - Context run works on
+ *   run      - Code to run, typically execute() or executeBytecode()
+ *   argument - Passed to run
+ *
+ * Returns:
+ *   1 if run returned normally, 0 after a runtime error
+ */
+int executeRecovering(tfcontext *context, void (*run)(tfcontext *context, void *argument), void *argument);
+
+/*
+ * recoverContext() - Abandons a program from a signal handler
+ *
+ * Jumps back into the innermost executeRecovering() running on context,
+ * restoring the signal mask. Async-signal-safe.
+ *
+ * Args:
+ *   context - Context of the failing program
+ *
+ * Returns:
+ *   Only if context is not running under executeRecovering()
+ */
+void recoverContext(tfcontext *context);
+
+/*
+ * callWordBody() - Executes the body of a user-defined word
+ *
+ * Operand primitive bound to every call of a ": name ... ;" word; the
+ * operand is the callee's compiled program list, so a call never
+ * re-parses or looks anything up.
+ *
+ * Args:
+ *   context - VM execution context
+ *   body    - Compiled TF_OBJ_LIST of the called word
+ */
+void callWordBody(tfcontext *context, tfobj *body);
+
+/*
+ * executeCountingPairs() - Executes a program while counting word pairs
+ *
+ * Behaves like execute() and additionally records how often each pair of
+ * adjacent objects was executed (all literals count as "<lit>"). When the
+ * program finishes, the most frequent pairs are printed to stderr. Use it
+ * on unfused programs to pick new superinstructions from real traces.
+ *
+ * Args:
+ *   program_list - Compiled program (TF_OBJ_LIST of executable objects)
+ *   context      - VM execution context (contains the data stack)
+ */
+void executeCountingPairs(tfobj *program_list, tfcontext *context);
+
+/*
+ * executeCountingWords() - Executes a program and counts the objects run
+ *
+ * Behaves like execute() and returns the number of objects dispatched,
+ * counting each call to a user word and every object of the body it
+ * runs. The benchmark driver divides execution times by it, so the same
+ * program gives the same count whichever engine is timed.
+ *
+ * Args:
+ *   program_list - Compiled program (TF_OBJ_LIST of executable objects)
+ *   context      - VM execution context (contains the data stack)
+ *
+ * Returns:
+ *   Number of objects executed
+ */
+size_t executeCountingWords(tfobj *program_list, tfcontext *context);
+
+/*
+ * executeProfiling() - Executes a program while timing every word
+ *
+ * Behaves like execute() and records, per word (user words, primitives,
+ * control words, with all literals sharing "<lit>"), the number of
+ * executions and the time spent: total time includes the bodies of user
+ * words, self time does not. Also reports the objects created and freed
+ * during the run and the deepest the data stack got. Lives beside
+ * execute() rather than inside it, so normal runs pay nothing for it.
+ *
+ * Args:
+ *   program_list - Compiled program (TF_OBJ_LIST of executable objects)
+ *   context      - VM execution context (contains the data stack)
+ *   json_path    - File to write the report to as JSON, or NULL to print
+ *                  a table to stderr
+ *
+ * Returns:
+ *   1 on success, 0 if the JSON report could not be written
+ */
+int executeProfiling(tfobj *program_list, tfcontext *context, const char *json_path);
+
+
 #endif  
\ No newline at end of file
@@ -1,46 +1,162 @@
-/*
- * File I/O Utilities Implementation
- *
- * Provides convenient functions for loading ToyForth source files.
- * Handles file sizing, memory allocation, and error reporting.
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-
-#include "file_utils.h"
-#include "mem.h"
-
-
-/*
- * readFromFile() implementation
- *
- * Opens a file, determines its size, allocates memory, and reads the
- * entire contents into a heap-allocated buffer. Appends a NUL terminator
- * to facilitate string processing. Returns the caller-owned buffer.
- */
-char *readFromFile(const char *filename) {
-    FILE *fp = fopen(filename, "r");
-    if(fp == NULL){
-        fprintf(stderr, "File %s not found.\n", filename);
-        exit(EXIT_FAILURE);
-    }
-
-    /* Move the file pointer to the very end of the file */
-    if(fseek(fp, 0, SEEK_END) != 0) {                                               
-        fprintf(stderr, "Error: Cannot seek in file '%s'.\n", filename);
-        fclose(fp);
-        exit(EXIT_FAILURE);
-    }
-
-    long size = ftell(fp);
-    rewind(fp);
-
-    char *buffer = wmalloc(size + 1);                                               
-
-    fread(buffer, sizeof(char), size, fp);
-    buffer[size] = '\0';
-    fclose(fp);
-
-    return buffer;
-}
\ No newline at end of file
+/*
+ * File I/O Utilities Implementation
+ *
+ * Provides convenient functions for loading ToyForth source files.
+ * Regular files are memory-mapped; everything else is read in chunks.
+ * Handles memory allocation and error reporting.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_utils.h"
+#include "mem.h"
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Bytes requested per read() when the size of the input is unknown */
+#define READ_CHUNK_SIZE (64 * 1024)
+
+
+/*
+ * openInput() - Opens a file for reading, "-" meaning stdin
+ */
+static int openInput(const char *filename) {
+    if (strcmp(filename, "-") == 0) return STDIN_FILENO;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "File %s not found.\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    return fd;
+}
+
+
+/*
+ * readChunks() - Reads a descriptor to the end in growing chunks
+ *
+ * Returns a NUL-terminated heap buffer and stores its length in *len.
+ */
+static char *readChunks(int fd, const char *filename, size_t *len) {
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t size = 0;
+    char *buffer = wmalloc(capacity + 1);
+
+    while (1) {
+        if (capacity - size < READ_CHUNK_SIZE) {
+            capacity *= 2;
+            buffer = wrealloc(buffer, capacity + 1);
+        }
+
+        ssize_t count = read(fd, buffer + size, capacity - size);
+        if (count == 0) break;
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: Cannot read '%s': %s.\n", filename, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        size += (size_t)count;
+    }
+
+    buffer[size] = '\0';
+    *len = size;
+    return buffer;
+}
+
+
+/*
+ * mapFile() - Maps a regular file followed by a zeroed page
+ *
+ * An anonymous region one byte larger than the file is reserved first and
+ * the file is mapped over its start, so the byte after the last character
+ * is always a zero (the NUL terminator), even when the file size is a
+ * multiple of the page size. Returns NULL if the file cannot be mapped.
+ */
+static char *mapFile(int fd, size_t size, size_t *mapped_len) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t total = (size + 1 + page - 1) / page * page;
+
+    void *region = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) return NULL;
+
+    void *text = mmap(region, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (text == MAP_FAILED) {
+        munmap(region, total);
+        return NULL;
+    }
+
+    *mapped_len = total;
+    return text;
+}
+
+
+/*
+ * loadSource() implementation
+ *
+ * Maps regular, non-empty files and reads anything else in chunks.
+ */
+tfsource *loadSource(const char *filename) {
+    int fd = openInput(filename);
+    tfsource *source = wmalloc(sizeof(tfsource));
+    source->text = NULL;
+    source->mapped_len = 0;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        source->len = (size_t)info.st_size;
+        source->text = mapFile(fd, source->len, &source->mapped_len);
+    }
+
+    if (source->text == NULL) {
+        source->text = readChunks(fd, filename, &source->len);
+    }
+
+    if (fd != STDIN_FILENO) close(fd);
+    return source;
+}
+
+
+/*
+ * freeSource() implementation
+ */
+void freeSource(tfsource *source) {
+    if (source == NULL) return;
+
+    if (source->mapped_len > 0) {
+        munmap(source->text, source->mapped_len);
+    } else {
+        free(source->text);
+    }
+
+    free(source);
+}
+
+
+/*
+ * readFromFile() implementation
+ *
+ * Reads the entire contents into a heap-allocated buffer in chunks, which
+ * works for regular files, pipes and stdin alike. Appends a NUL terminator
+ * to facilitate string processing. Returns the caller-owned buffer.
+ */
+char *readFromFile(const char *filename) {
+    int fd = openInput(filename);
+    size_t len;
+
+    char *buffer = readChunks(fd, filename, &len);
+
+    if (fd != STDIN_FILENO) close(fd);
+    return buffer;
+}
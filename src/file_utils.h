@@ -1,31 +1,72 @@
-/*
- * File I/O Utilities Module
- *
- * Provides convenient file reading functionality for loading ToyForth source
- * programs. Automatically handles file sizing, memory allocation, and error
- * reporting.
- */
-
-#ifndef FILE_UTILS_H
-#define FILE_UTILS_H
-
-/*
- * readFromFile() - Reads entire file contents into memory
- *
- * Opens a file, determines its size, allocates a buffer with wmalloc(),
- * and reads the complete contents. Appends a NUL terminator for safe string
- * processing. Returns a newly allocated buffer that the caller is responsible
- * for freeing.
- *
- * On file open failure, prints error message and terminates the program.
- *
- * Args:
- *   filename - Path to file to read (relative or absolute)
- *
- * Returns:
- *   Heap-allocated buffer (refcount maintained by caller) containing the
- *   file contents as a NUL-terminated string
- */
-char* readFromFile(const char *filename);
-
-#endif  
\ No newline at end of file
+/*
+ * File I/O Utilities Module
+ *
+ * Provides source loading for ToyForth programs. Regular files are
+ * memory-mapped, so the parser tokenizes the page cache in place without
+ * an intermediate copy; pipes and stdin are read in chunks. All failures
+ * (missing files, read errors) are reported and terminate the program.
+ */
+
+#ifndef FILE_UTILS_H
+#define FILE_UTILS_H
+
+#include <stddef.h>
+
+/*
+ * tfsource - A loaded, NUL-terminated program text
+ *
+ * The text is either a private memory mapping of the file (mapped_len > 0)
+ * or a heap buffer. It is writable.
+ */
+typedef struct {
+    char *text;                     /* NUL-terminated program text */
+    size_t len;                     /* Length of text (excluding NUL terminator) */
+    size_t mapped_len;              /* Size of the mapping, or 0 for a heap buffer */
+} tfsource;
+
+/*
+ * loadSource() - Loads a program without copying it when possible
+ *
+ * Regular files are mapped with mmap() into a region at least one byte
+ * larger than the file, whose zeroed tail provides the NUL terminator. Pipes,
+ * terminals and other non-seekable inputs fall back to a chunked read.
+ * The name "-" reads the program from stdin.
+ *
+ * On open or read failure, prints error message and terminates the program.
+ *
+ * Args:
+ *   filename - Path to file to read (relative or absolute), or "-"
+ *
+ * Returns:
+ *   New tfsource, to be released with freeSource()
+ */
+tfsource *loadSource(const char *filename);
+
+/*
+ * freeSource() - Releases a source loaded by loadSource()
+ *
+ * Args:
+ *   source - Source to release (may be NULL; no-op if so)
+ */
+void freeSource(tfsource *source);
+
+/*
+ * readFromFile() - Reads entire file contents into memory
+ *
+ * Reads the complete contents of a file (or stdin for "-") in chunks into
+ * a buffer allocated with wmalloc(), so it also works for pipes. Appends a
+ * NUL terminator for safe string processing. Returns a newly allocated
+ * buffer that the caller is responsible for freeing.
+ *
+ * On open or read failure, prints error message and terminates the program.
+ *
+ * Args:
+ *   filename - Path to file to read (relative or absolute), or "-"
+ *
+ * Returns:
+ *   Heap-allocated buffer (refcount maintained by caller) containing the
+ *   file contents as a NUL-terminated string
+ */
+char* readFromFile(const char *filename);
+
+#endif
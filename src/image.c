@@ -0,0 +1,499 @@
+/*
+ * Program Image Implementation
+ *
+ * Writing walks the program once to collect the user word bodies it
+ * calls (dependencies first, so every call refers to an earlier range)
+ * and the distinct symbols, then emits one fixed-size record per object.
+ * Loading validates every count, index and range against the file size
+ * before trusting it, so a truncated or corrupt image is reported rather
+ * than executed.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "dictionary.h"
+#include "engine.h"
+#include "list.h"
+#include "mem.h"
+#include "parser.h"
+
+
+/* Written into every image, to reject images from other architectures */
+#define TF_IMAGE_BYTE_ORDER 0x01020304u
+
+
+/*
+ * hashSource() - 64-bit FNV-1a of a source text
+ */
+static uint64_t hashSource(const char *text, size_t len) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+
+/*
+ * growArray() - Makes room for one more element in a growable array
+ */
+static void *growArray(void *array, size_t count, size_t *capacity, size_t size) {
+    if (count < *capacity) return array;
+
+    *capacity = *capacity ? *capacity * 2 : 16;
+    return wrealloc(array, size * *capacity);
+}
+
+
+/*
+ * ImageWriter - Tables collected while encoding a program
+ */
+typedef struct {
+    tfobj **symbols;                /* Distinct interned symbols, by pointer */
+    size_t symbol_count, symbol_capacity;
+    tfobj **bodies;                 /* Lists to encode, dependencies first */
+    size_t body_count, body_capacity;
+    tfimageobject *objects;         /* Records of every encoded list */
+    size_t object_count, object_capacity;
+} ImageWriter;
+
+
+/*
+ * symbolIndex() - Returns the index of a symbol, adding it if needed
+ */
+static uint32_t symbolIndex(ImageWriter *writer, tfobj *symbol) {
+    for (size_t i = 0; i < writer->symbol_count; i++) {
+        if (writer->symbols[i] == symbol) return (uint32_t)i;
+    }
+
+    writer->symbols = growArray(writer->symbols, writer->symbol_count, &writer->symbol_capacity, sizeof(tfobj *));
+    writer->symbols[writer->symbol_count] = symbol;
+    return (uint32_t)writer->symbol_count++;
+}
+
+
+/*
+ * bodyIndex() - Returns the index of a collected list, or -1
+ */
+static long bodyIndex(const ImageWriter *writer, tfobj *body) {
+    for (size_t i = 0; i < writer->body_count; i++) {
+        if (writer->bodies[i] == body) return (long)i;
+    }
+    return -1;
+}
+
+
+/*
+ * addBody() - Appends a list to the bodies to encode
+ */
+static void addBody(ImageWriter *writer, tfobj *body) {
+    writer->bodies = growArray(writer->bodies, writer->body_count, &writer->body_capacity, sizeof(tfobj *));
+    writer->bodies[writer->body_count++] = body;
+}
+
+
+/*
+ * collectBodies() - Adds the bodies called from a list, callees first
+ *
+ * Words cannot call themselves, so the recursion always terminates.
+ */
+static void collectBodies(ImageWriter *writer, tfobj *list) {
+    for (size_t i = 0; i < list->list_obj.len; i++) {
+        tfobj *object = list->list_obj.element[i];
+
+        if (getObjectType(object) == TF_OBJ_WORD && object->word_obj.operand != NULL &&
+            object->word_obj.operand_op == callWordBody && bodyIndex(writer, object->word_obj.operand) < 0) {
+            collectBodies(writer, object->word_obj.operand);
+            addBody(writer, object->word_obj.operand);
+        }
+    }
+}
+
+
+/*
+ * encodeObject() - Builds the record of one compiled object
+ *
+ * Returns false for objects an image cannot hold (unresolved symbols).
+ */
+static bool encodeObject(ImageWriter *writer, tfobj *object, tfimageobject *record) {
+    TF_OBJ_TYPE type = getObjectType(object);
+    TF_IMAGE_OBJ kind;
+    uint32_t symbol = 0;
+
+    record->reserved = 0;
+    record->value = 0;
+
+    if (type == TF_OBJ_INT || type == TF_OBJ_BOOL) {
+        kind = type == TF_OBJ_INT ? TF_IMAGE_INT : TF_IMAGE_BOOL;
+        record->value = getObjectNumber(object);
+    } else if (type == TF_OBJ_STR) {
+        /* The bytes go into the symbol table, like a name */
+        kind = TF_IMAGE_STRING;
+        symbol = symbolIndex(writer, object);
+    } else if (type == TF_OBJ_WORD) {
+        tfobj *operand = object->word_obj.operand;
+        symbol = symbolIndex(writer, object->word_obj.symbol);
+
+        if (operand == NULL) {
+            kind = TF_IMAGE_WORD;
+        } else if (object->word_obj.operand_op == callWordBody) {
+            kind = TF_IMAGE_CALL;
+            record->value = (int64_t)bodyIndex(writer, operand);
+        } else if (getObjectType(operand) == TF_OBJ_INT) {
+            kind = TF_IMAGE_OPERAND_WORD;
+            record->value = getObjectNumber(operand);
+        } else {
+            return false;
+        }
+    } else if (type == TF_OBJ_BRANCH) {
+        static const TF_IMAGE_OBJ branch_kinds[] = {
+            [TF_BRANCH_ALWAYS] = TF_IMAGE_BRANCH_ALWAYS,
+            [TF_BRANCH_IF_FALSE] = TF_IMAGE_BRANCH_IF_FALSE,
+            [TF_BRANCH_LOOP] = TF_IMAGE_BRANCH_LOOP
+        };
+        if (object->branch_obj.target > INT32_MAX) return false;
+        kind = branch_kinds[object->branch_obj.kind];
+        symbol = symbolIndex(writer, object->branch_obj.symbol);
+        record->value = (int64_t)object->branch_obj.target;
+    } else {
+        return false;
+    }
+
+    if (symbol >= TF_IMAGE_MAX_SYMBOLS) return false;
+    record->tag = (uint32_t)kind | symbol << TF_IMAGE_KIND_BITS;
+    return true;
+}
+
+
+/*
+ * writeImage() - Encodes a program and writes it to image_path
+ *
+ * Returns false (after reporting it) if the image could not be written.
+ */
+static bool writeImage(tfobj *program, size_t depth, const char *image_path,
+                       const char *source_path, const tfsource *source) {
+    ImageWriter writer = {0};
+    tfimagerange *ranges;
+    tfimageheader header;
+    bool ok = true;
+
+    collectBodies(&writer, program);
+    addBody(&writer, program);
+    ranges = wmalloc(sizeof(tfimagerange) * writer.body_count);
+
+    for (size_t b = 0; b < writer.body_count && ok; b++) {
+        tfobj *list = writer.bodies[b];
+        ranges[b].first = (uint32_t)writer.object_count;
+        ranges[b].len = (uint32_t)list->list_obj.len;
+
+        for (size_t i = 0; i < list->list_obj.len && ok; i++) {
+            writer.objects = growArray(writer.objects, writer.object_count, &writer.object_capacity, sizeof(tfimageobject));
+            ok = encodeObject(&writer, list->list_obj.element[i], &writer.objects[writer.object_count++]);
+        }
+    }
+    if (!ok) fprintf(stderr, "Error. Program %s cannot be saved as an image.\n", source_path);
+
+    /* Source identity, for the staleness check */
+    struct stat info;
+    char *path = strcmp(source_path, "-") != 0 ? realpath(source_path, NULL) : NULL;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TF_IMAGE_MAGIC, sizeof(TF_IMAGE_MAGIC));
+    header.version = TF_IMAGE_VERSION;
+    header.byte_order = TF_IMAGE_BYTE_ORDER;
+    header.source_size = source->len;
+    header.source_hash = hashSource(source->text, source->len);
+    if (path != NULL && stat(path, &info) == 0) {
+        header.source_mtime = (int64_t)info.st_mtim.tv_sec;
+        header.source_mtime_nsec = (int64_t)info.st_mtim.tv_nsec;
+        header.path_len = (uint32_t)strlen(path);
+    }
+    header.depth = depth;
+    header.symbol_count = (uint32_t)writer.symbol_count;
+    header.body_count = (uint32_t)writer.body_count;
+    header.object_count = (uint32_t)writer.object_count;
+
+    tfimagesymbol *symbols = wmalloc(sizeof(tfimagesymbol) * (writer.symbol_count + 1));
+    size_t strings_size = 0;
+    for (size_t s = 0; s < writer.symbol_count; s++) {
+        symbols[s].offset = (uint32_t)strings_size;
+        symbols[s].len = (uint32_t)writer.symbols[s]->str_obj.len;
+        strings_size += writer.symbols[s]->str_obj.len;
+    }
+    header.strings_size = (uint32_t)(strings_size + header.path_len);
+
+    FILE *file = ok ? fopen(image_path, "wb") : NULL;
+    if (ok && file == NULL) {
+        fprintf(stderr, "Error. Couldn't create image %s.\n", image_path);
+        ok = false;
+    }
+    if (ok) {
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(symbols, sizeof(tfimagesymbol), writer.symbol_count, file);
+        fwrite(ranges, sizeof(tfimagerange), writer.body_count, file);
+        fwrite(writer.objects, sizeof(tfimageobject), writer.object_count, file);
+        for (size_t s = 0; s < writer.symbol_count; s++) {
+            fwrite(writer.symbols[s]->str_obj.str, 1, writer.symbols[s]->str_obj.len, file);
+        }
+        fwrite(path, 1, header.path_len, file);
+
+        bool failed = ferror(file) != 0;
+        if (fclose(file) != 0) failed = true;
+        if (failed) {
+            fprintf(stderr, "Error. Couldn't write image %s.\n", image_path);
+            ok = false;
+        }
+    }
+
+    free(path);
+    free(symbols);
+    free(ranges);
+    free(writer.symbols);
+    free(writer.bodies);
+    free(writer.objects);
+    return ok;
+}
+
+
+/*
+ * isImage() implementation
+ */
+int isImage(const tfsource *source) {
+    return source->len >= sizeof(tfimageheader) &&
+           memcmp(source->text, TF_IMAGE_MAGIC, sizeof(TF_IMAGE_MAGIC)) == 0;
+}
+
+
+/*
+ * buildImage() implementation
+ */
+tfobj *buildImage(const char *source_path, const char *image_path, size_t *depth, int *written) {
+    tfsource *source = loadSource(source_path);
+    tfparser parser;
+    bool saved = false;
+
+    parserInit(&parser, source->text);
+    tfobj *program = compileBatch(&parser, SIZE_MAX);
+
+    if (program != NULL) {
+        foldConstants(program);
+        fuseSuperinstructions(program);
+        *depth = (size_t)parser.analysis.highest;
+        if (image_path != NULL) saved = writeImage(program, *depth, image_path, source_path, source);
+    }
+
+    if (written != NULL) *written = saved;
+    freeSource(source);
+    return program;
+}
+
+
+/*
+ * isStale() - Tells whether the source an image was built from has changed
+ *
+ * A source that no longer exists cannot be recompiled, so the image is
+ * used as is. The content hash settles the case of a touched but
+ * unchanged source.
+ */
+static bool isStale(const tfimageheader *header, const char *path) {
+    struct stat info;
+
+    if (stat(path, &info) != 0) return false;
+    if ((uint64_t)info.st_size != header->source_size) return true;
+    if ((int64_t)info.st_mtim.tv_sec == header->source_mtime &&
+        (int64_t)info.st_mtim.tv_nsec == header->source_mtime_nsec) {
+        return false;
+    }
+
+    tfsource *source = loadSource(path);
+    bool changed = hashSource(source->text, source->len) != header->source_hash;
+    freeSource(source);
+    return changed;
+}
+
+
+/*
+ * decodeObject() - Rebuilds one object of range r from its record
+ *
+ * Returns NULL if the record is invalid.
+ */
+static tfobj *decodeObject(const tfimageobject *record, tfobj **symbols, uint32_t symbol_count,
+                           tfobj **built, size_t r, size_t range_len) {
+    TF_IMAGE_OBJ kind = (TF_IMAGE_OBJ)(record->tag & ((1u << TF_IMAGE_KIND_BITS) - 1));
+    uint32_t index = record->tag >> TF_IMAGE_KIND_BITS;
+    bool named = kind != TF_IMAGE_INT && kind != TF_IMAGE_BOOL;
+    if (named && index >= symbol_count) return NULL;
+    tfobj *symbol = named ? symbols[index] : NULL;
+
+    switch (kind) {
+    case TF_IMAGE_INT:
+        return createIntegerObject(record->value);
+
+    case TF_IMAGE_OPERAND_WORD: {
+        OperandOperation op = lookupOperandOperation(symbol->str_obj.str);
+        if (op == NULL) return NULL;
+        tfobj *operand = createIntegerObject(record->value);
+        tfobj *word = createOperandWordObject(op, symbol, operand);
+        decrementReferenceCount(operand);
+        return word;
+    }
+
+    case TF_IMAGE_BOOL:
+        return createBooleanObject(record->value != 0);
+
+    case TF_IMAGE_STRING:
+        return createStringObject(symbol->str_obj.str, symbol->str_obj.len);
+
+    case TF_IMAGE_WORD: {
+        Operation op = lookupOperation(symbol->str_obj.str);
+        if (op == NULL) op = lookupFusedOperation(symbol->str_obj.str);
+        return op != NULL ? createWordObject(op, symbol) : NULL;
+    }
+
+    case TF_IMAGE_CALL:
+        /* Callees always come before their callers */
+        if (record->value < 0 || (size_t)record->value >= r) return NULL;
+        return createOperandWordObject(callWordBody, symbol, built[record->value]);
+
+    case TF_IMAGE_BRANCH_ALWAYS:
+    case TF_IMAGE_BRANCH_IF_FALSE:
+    case TF_IMAGE_BRANCH_LOOP: {
+        static const TF_BRANCH_KIND branch_kinds[] = {TF_BRANCH_ALWAYS, TF_BRANCH_IF_FALSE, TF_BRANCH_LOOP};
+        if (record->value < 0 || (size_t)record->value > range_len) return NULL;
+        tfobj *branch = createBranchObject(branch_kinds[kind - TF_IMAGE_BRANCH_ALWAYS], symbol);
+        branch->branch_obj.target = (size_t)record->value;
+        return branch;
+    }
+
+    default:
+        return NULL;
+    }
+}
+
+
+/*
+ * rangeReach() - Bounds how far running range r can grow the stack
+ *
+ * Every object pushes at most one item more than it pops, except calls,
+ * which can grow the stack as far as their callee (whose bound is in
+ * reach[]). Saturates instead of wrapping around.
+ */
+static uint64_t rangeReach(const tfimageobject *record, size_t len, const uint64_t *reach, size_t r) {
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        TF_IMAGE_OBJ kind = (TF_IMAGE_OBJ)(record[i].tag & ((1u << TF_IMAGE_KIND_BITS) - 1));
+        uint64_t grows = kind == TF_IMAGE_CALL && record[i].value >= 0 && (size_t)record[i].value < r
+                       ? reach[record[i].value] : 1;
+        total = total > UINT64_MAX - grows ? UINT64_MAX : total + grows;
+    }
+
+    return total;
+}
+
+
+/*
+ * loadImage() implementation
+ *
+ * The bodies are rebuilt in range order; once the program (the last
+ * range) is built, the calls inside it hold the only references to them.
+ * The depth only sizes the stack up front, so instead of being trusted it
+ * is capped by what the records can push (see rangeReach()): a corrupt
+ * header cannot ask for more memory than the program itself could use.
+ */
+tfobj *loadImage(const tfsource *image, const char *image_path, size_t *depth) {
+    const tfimageheader *header = (const tfimageheader *)image->text;
+
+    if (header->version != TF_IMAGE_VERSION || header->byte_order != TF_IMAGE_BYTE_ORDER) {
+        fprintf(stderr, "Error. Image %s was made by another version of toyforth.\n", image_path);
+        return NULL;
+    }
+
+    uint64_t size = sizeof(tfimageheader)
+                  + (uint64_t)header->symbol_count * sizeof(tfimagesymbol)
+                  + (uint64_t)header->body_count * sizeof(tfimagerange)
+                  + (uint64_t)header->object_count * sizeof(tfimageobject)
+                  + header->strings_size;
+    if (size > image->len || header->body_count == 0 || header->path_len > header->strings_size) {
+        fprintf(stderr, "Error. Corrupt image %s.\n", image_path);
+        return NULL;
+    }
+
+    const tfimagesymbol *symbol_table = (const tfimagesymbol *)(header + 1);
+    const tfimagerange *ranges = (const tfimagerange *)(symbol_table + header->symbol_count);
+    const tfimageobject *records = (const tfimageobject *)(ranges + header->body_count);
+    const char *strings = (const char *)(records + header->object_count);
+
+    if (header->path_len > 0) {
+        char *path = wmalloc(header->path_len + 1);
+        memcpy(path, strings + header->strings_size - header->path_len, header->path_len);
+        path[header->path_len] = '\0';
+
+        tfobj *program = NULL;
+        bool stale = isStale(header, path);
+        if (stale) program = buildImage(path, strcmp(image_path, "-") != 0 ? image_path : NULL, depth, NULL);
+        free(path);
+        if (stale) return program;
+    }
+
+    tfobj **symbols = wmalloc(sizeof(tfobj *) * (header->symbol_count + 1));
+    tfobj **built = wmalloc(sizeof(tfobj *) * header->body_count);
+    uint64_t *reach = wmalloc(sizeof(uint64_t) * header->body_count);
+    size_t symbol_count = 0, built_count = 0;
+    bool ok = true;
+
+    for (; symbol_count < header->symbol_count && ok; symbol_count++) {
+        const tfimagesymbol *entry = &symbol_table[symbol_count];
+        ok = (uint64_t)entry->offset + entry->len <= header->strings_size - header->path_len;
+        symbols[symbol_count] = ok ? internSymbol(strings + entry->offset, entry->len) : NULL;
+    }
+
+    for (; built_count < header->body_count && ok; built_count++) {
+        const tfimagerange *range = &ranges[built_count];
+        tfobj *list = createListObject();
+        built[built_count] = list;
+
+        ok = (uint64_t)range->first + range->len <= header->object_count;
+        if (ok) {
+            listReserve(list, range->len);
+            reach[built_count] = rangeReach(&records[range->first], range->len, reach, built_count);
+        }
+
+        for (uint32_t i = 0; i < range->len && ok; i++) {
+            tfobj *object = decodeObject(&records[range->first + i], symbols, header->symbol_count,
+                                         built, built_count, range->len);
+            ok = object != NULL;
+            if (ok) {
+                listAppendObject(list, object);
+                decrementReferenceCount(object);
+            }
+        }
+    }
+
+    if (!ok) fprintf(stderr, "Error. Corrupt image %s.\n", image_path);
+
+    /* Keep the program; the bodies live on through the calls into them */
+    tfobj *program = ok ? built[built_count - 1] : NULL;
+    for (size_t b = 0; b < built_count; b++) {
+        if (built[b] != program) decrementReferenceCount(built[b]);
+    }
+    for (size_t s = 0; s < symbol_count; s++) {
+        decrementReferenceCount(symbols[s]);
+    }
+    free(symbols);
+    free(built);
+
+    uint64_t limit = ok ? reach[built_count - 1] : 0;
+    *depth = (size_t)(header->depth < limit ? header->depth : limit);
+    free(reach);
+    return program;
+}
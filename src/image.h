@@ -0,0 +1,164 @@
+/*
+ * Program Image Module
+ *
+ * Saves an optimized program (the folded and fused top-level list plus
+ * the bodies of the user words it calls) as a compact binary image, and
+ * turns an image back into a runnable program without tokenizing or
+ * parsing anything. Images are produced by "toyforth --compile" and run
+ * like source files: main() recognizes them by their magic number.
+ *
+ * Layout (native byte order and word size; images are a cache, not an
+ * interchange format):
+ *
+ *   tfimageheader                      fixed-size header
+ *   tfimagesymbol[symbol_count]        names and string literals, as ranges of the string area
+ *   tfimagerange[body_count]           code ranges; the last is the program
+ *   tfimageobject[object_count]        fixed-size records of every range
+ *   char[strings_size]                 names, then the source path
+ *
+ * Every record is fixed-size and aligned, so the image is read in place
+ * from the file's memory mapping; an object takes 16 bytes.
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tforth.h"
+#include "file_utils.h"
+
+
+/* First bytes of every image, including the NUL */
+#define TF_IMAGE_MAGIC "TFIMAGE"
+
+/* Bumped whenever the layout or the record kinds change */
+#define TF_IMAGE_VERSION 4
+
+
+/*
+ * tfimageheader - Start of an image
+ *
+ * The source fields let an image detect that its source changed: a
+ * matching size and modification time is trusted as is, otherwise the
+ * source is hashed and compared with source_hash.
+ */
+typedef struct {
+    char magic[8];                  /* TF_IMAGE_MAGIC */
+    uint32_t version;               /* TF_IMAGE_VERSION */
+    uint32_t byte_order;            /* 0x01020304 as written by the producer */
+    uint64_t source_size;           /* Size of the source in bytes */
+    int64_t source_mtime;           /* Modification time of the source (seconds) */
+    int64_t source_mtime_nsec;      /* ... and nanoseconds */
+    uint64_t source_hash;           /* 64-bit FNV-1a of the source text */
+    uint64_t depth;                 /* Deepest stack the program reaches */
+    uint32_t symbol_count;
+    uint32_t body_count;            /* User word bodies plus the program */
+    uint32_t object_count;          /* Records in all ranges together */
+    uint32_t strings_size;          /* Bytes in the string area */
+    uint32_t path_len;              /* Absolute source path, 0 if unknown */
+    uint32_t reserved;
+} tfimageheader;
+
+/*
+ * tfimagesymbol - An interned name, stored in the string area
+ */
+typedef struct {
+    uint32_t offset;
+    uint32_t len;
+} tfimagesymbol;
+
+/*
+ * tfimagerange - The records of one compiled list
+ */
+typedef struct {
+    uint32_t first;                 /* Index of the first record */
+    uint32_t len;                   /* Number of records */
+} tfimagerange;
+
+/*
+ * TF_IMAGE_OBJ - Kinds of image records
+ *
+ * Words are resolved by name when the image is loaded, so an image keeps
+ * working across builds of the interpreter.
+ */
+typedef enum {
+    TF_IMAGE_INT,                   /* Integer literal in value */
+    TF_IMAGE_BOOL,                  /* Boolean literal in value */
+    TF_IMAGE_WORD,                  /* Primitive named by symbol */
+    TF_IMAGE_OPERAND_WORD,          /* Fused primitive named by symbol, literal in value */
+    TF_IMAGE_CALL,                  /* Call to user word symbol, body (range index) in value */
+    TF_IMAGE_BRANCH_ALWAYS,         /* Branches, target (index in the range) in value */
+    TF_IMAGE_BRANCH_IF_FALSE,
+    TF_IMAGE_BRANCH_LOOP,
+    TF_IMAGE_STRING                 /* String literal, its bytes stored as symbol */
+} TF_IMAGE_OBJ;
+
+/*
+ * tfimageobject - One compiled object
+ *
+ * The tag packs the kind (low 8 bits) with the symbol index of words and
+ * branches, so images hold at most 2^24 distinct symbols. value is as
+ * wide as an integer, so any literal is stored as is.
+ */
+typedef struct {
+    uint32_t tag;                   /* TF_IMAGE_OBJ | symbol index << 8 */
+    uint32_t reserved;
+    int64_t value;                  /* Literal, body index or branch target */
+} tfimageobject;
+
+#define TF_IMAGE_KIND_BITS 8
+#define TF_IMAGE_MAX_SYMBOLS (1u << (32 - TF_IMAGE_KIND_BITS))
+
+
+/*
+ * isImage() - Tells whether a loaded file is a program image
+ *
+ * Args:
+ *   source - File loaded with loadSource()
+ *
+ * Returns:
+ *   1 if it starts with TF_IMAGE_MAGIC, 0 otherwise
+ */
+int isImage(const tfsource *source);
+
+/*
+ * buildImage() - Compiles a source file and saves it as an image
+ *
+ * Compiles, folds and fuses the source, then writes the image. Errors
+ * writing the image are reported but do not fail the compilation.
+ *
+ * Args:
+ *   source_path - Source file, or "-" for stdin (no staleness check then)
+ *   image_path  - Image file to create or replace, or NULL to skip it
+ *   depth       - Receives the deepest stack the program reaches
+ *   written     - Receives 1 if the image was written, 0 otherwise (may
+ *                 be NULL)
+ *
+ * Returns:
+ *   The optimized program (refcount=1), or NULL on a compile error
+ */
+tfobj *buildImage(const char *source_path, const char *image_path, size_t *depth, int *written);
+
+/*
+ * loadImage() - Turns an image back into a runnable program
+ *
+ * Validates the image, then rebuilds the bodies and the program from its
+ * records, resolving each symbol once. If the recorded source has changed
+ * since, it is recompiled and the image rewritten instead. The returned
+ * program is already folded and fused.
+ *
+ * Args:
+ *   image      - Image loaded with loadSource()
+ *   image_path - Path of the image, rewritten when stale
+ *   depth      - Receives the deepest stack the program reaches
+ *
+ * Returns:
+ *   The program (refcount=1), or NULL (after printing why) if the image
+ *   is corrupt or its stale source fails to compile
+ */
+tfobj *loadImage(const tfsource *image, const char *image_path, size_t *depth);
+
+
+#endif
@@ -0,0 +1,926 @@
+/*
+ * JIT Module Implementation
+ *
+ * Code is emitted into a growable buffer, function by function: first the
+ * program, then every word body it reaches. Jumps within a function and
+ * calls between functions are rel32 and patched once their targets are
+ * known, so the code is position independent and copied into executable
+ * memory at the end. Calls into C load the address into a register.
+ *
+ * Register use, for the whole of every native function:
+ *
+ *   rbx  context            r12  stack array (base)
+ *   r15  context->stack     r13  depth
+ *                           r14  top of stack (tos)
+ *
+ * These are callee-saved, so they survive calls into C, and a native
+ * function is an ordinary C function of its context. rax, rcx, rdx, rsi,
+ * rdi, r8 and r9 are scratch. As in executeBytecode(), base[depth-1] is
+ * stale while tos holds the top; spilling writes it back.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jit.h"
+#include "dictionary.h"
+#include "engine.h"
+#include "list.h"
+#include "mem.h"
+#include "ops.h"
+
+
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(TF_NO_JIT)
+#define TF_JIT 1
+#else
+#define TF_JIT 0
+#endif
+
+
+#if TF_JIT
+
+#include <sys/mman.h>
+
+/* Entry point of a native function */
+typedef void (*JitEntry)(tfcontext *context);
+
+/*
+ * JitFunction - A program or word body being translated
+ */
+typedef struct {
+    tfobj *body;                    /* Word body, or NULL for the program */
+    tfbytecode *bytecode;           /* Its bytecode; owned for bodies */
+    size_t entry;                   /* Offset of its code in the buffer */
+} JitFunction;
+
+struct tfjit {
+    unsigned char *code;            /* Executable mapping */
+    size_t size;                    /* Bytes mapped */
+    JitFunction *functions;         /* functions[0] is the program */
+    size_t function_count;
+};
+
+
+/* Bytes an instruction may take at most: the buffer grows ahead of each */
+#define MAX_INSTRUCTION_BYTES 512
+
+/* Jumps to the slow path of one instruction, at most */
+#define MAX_SLOW_JUMPS 8
+
+/*
+ * Reg - x86-64 general purpose registers, by encoding
+ */
+typedef enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+} Reg;
+
+#define CONTEXT RBX
+#define BASE R12
+#define DEPTH R13
+#define TOS R14
+#define STACK R15
+
+/*
+ * Cond - Condition codes of jcc
+ */
+typedef enum {
+    CC_O = 0x0, CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_GE = 0xD,
+    CC_ALWAYS = -1
+} Cond;
+
+/* Arithmetic instructions of the form "op r/m64, r64" and their /digit */
+enum { OP_ADD = 0x01, OP_OR = 0x09, OP_SUB = 0x29, OP_XOR = 0x31, OP_CMP = 0x39, OP_TEST = 0x85, OP_MOV = 0x89 };
+enum { EXT_ADD = 0, EXT_OR = 1, EXT_SUB = 5, EXT_CMP = 7 };
+enum { EXT_SHR = 5, EXT_SAR = 7 };
+
+#define LIST_ELEMENT ((int32_t)offsetof(tfobj, list_obj.element))
+#define LIST_LEN ((int32_t)offsetof(tfobj, list_obj.len))
+#define LIST_CAPACITY ((int32_t)offsetof(tfobj, list_obj.capacity))
+#define CONTEXT_STACK ((int32_t)offsetof(tfcontext, stack))
+#define CONTEXT_LOOPS ((int32_t)offsetof(tfcontext, loops))
+
+/*
+ * Fixup - A rel32 field to patch once its target is emitted
+ */
+typedef struct {
+    size_t at;                      /* Offset of the rel32 field */
+    size_t target;                  /* Instruction index, or function index for calls */
+} Fixup;
+
+/*
+ * Emitter - Code buffer and pending fixups of a translation
+ */
+typedef struct {
+    unsigned char *code;
+    size_t len;
+    size_t capacity;
+    Fixup *calls;                   /* Calls to functions, patched at the end */
+    size_t call_count;
+    size_t call_capacity;
+    Fixup *branches;                /* Branches of the current function */
+    size_t branch_count;
+    size_t branch_capacity;
+    JitFunction *functions;
+    size_t function_count;
+    size_t function_capacity;
+} Emitter;
+
+
+/*
+ * growArray() - Makes room for one more element of a dynamic array
+ */
+static void *growArray(void *array, size_t count, size_t *capacity, size_t size) {
+    if (count < *capacity) return array;
+    *capacity = *capacity > 0 ? *capacity * 2 : 16;
+    return wrealloc(array, *capacity * size);
+}
+
+
+/*
+ * Byte-level emission
+ */
+static void emitByte(Emitter *e, unsigned int byte) {
+    e->code[e->len++] = (unsigned char)byte;
+}
+
+static void emitU32(Emitter *e, uint32_t value) {
+    memcpy(e->code + e->len, &value, 4);
+    e->len += 4;
+}
+
+static void emitU64(Emitter *e, uint64_t value) {
+    memcpy(e->code + e->len, &value, 8);
+    e->len += 8;
+}
+
+static void emitRex(Emitter *e, int wide, Reg reg, Reg index, Reg rm) {
+    unsigned int rex = 0x40 | (wide ? 8 : 0) | (reg >> 3) << 2 | (index >> 3) << 1 | (rm >> 3);
+    if (rex != 0x40) emitByte(e, rex);
+}
+
+static void emitModRM(Emitter *e, unsigned int mod, unsigned int reg, unsigned int rm) {
+    emitByte(e, mod << 6 | (reg & 7) << 3 | (rm & 7));
+}
+
+
+/*
+ * emitRegReg() - "op rm, reg" on two 64-bit registers
+ */
+static void emitRegReg(Emitter *e, unsigned int op, Reg rm, Reg reg) {
+    emitRex(e, 1, reg, RAX, rm);
+    emitByte(e, op);
+    emitModRM(e, 3, reg, rm);
+}
+
+/*
+ * emitMemory() - "op reg, [base + index * 8 + disp]" (no index if index is RSP)
+ *
+ * With op 0x8B this is a load, with 0x89 a store and with 0x3B a compare
+ * of reg with memory. The displacement is always 32 bits.
+ */
+static void emitMemory(Emitter *e, unsigned int op, Reg reg, Reg base, Reg index, int32_t disp) {
+    emitRex(e, 1, reg, index == RSP ? RAX : index, base);
+    emitByte(e, op);
+    if (index == RSP && (base & 7) != RSP) {
+        emitModRM(e, 2, reg, base);
+    } else {
+        emitModRM(e, 2, reg, RSP);
+        emitByte(e, (index == RSP ? 0 : 3u << 6) | (index & 7) << 3 | (base & 7));
+    }
+    emitU32(e, (uint32_t)disp);
+}
+
+#define emitLoad(e, reg, base, index, disp) emitMemory(e, 0x8B, reg, base, index, disp)
+#define emitStore(e, reg, base, index, disp) emitMemory(e, 0x89, reg, base, index, disp)
+
+/*
+ * emitImmediate() - "op rm, imm32" (group 1: add, or, sub, cmp)
+ */
+static void emitImmediate(Emitter *e, unsigned int ext, Reg rm, int32_t imm) {
+    emitRex(e, 1, RAX, RAX, rm);
+    emitByte(e, 0x81);
+    emitModRM(e, 3, ext, rm);
+    emitU32(e, (uint32_t)imm);
+}
+
+/*
+ * emitTestImmediate() - "test rm, imm32"
+ */
+static void emitTestImmediate(Emitter *e, Reg rm, int32_t imm) {
+    emitRex(e, 1, RAX, RAX, rm);
+    emitByte(e, 0xF7);
+    emitModRM(e, 3, 0, rm);
+    emitU32(e, (uint32_t)imm);
+}
+
+/*
+ * emitShift() - "shr/sar rm, imm8"
+ */
+static void emitShift(Emitter *e, unsigned int ext, Reg rm, unsigned int count) {
+    emitRex(e, 1, RAX, RAX, rm);
+    emitByte(e, 0xC1);
+    emitModRM(e, 3, ext, rm);
+    emitByte(e, count);
+}
+
+/*
+ * emitMoveImmediate() - "mov reg, imm64"
+ */
+static void emitMoveImmediate(Emitter *e, Reg reg, uint64_t imm) {
+    emitRex(e, 1, RAX, RAX, reg);
+    emitByte(e, 0xB8 + (reg & 7));
+    emitU64(e, imm);
+}
+
+/*
+ * emitMultiply() - "imul reg, rm"
+ */
+static void emitMultiply(Emitter *e, Reg reg, Reg rm) {
+    emitRex(e, 1, reg, RAX, rm);
+    emitByte(e, 0x0F);
+    emitByte(e, 0xAF);
+    emitModRM(e, 3, reg, rm);
+}
+
+/*
+ * emitMultiplyImmediate() - "imul reg, rm, imm8"
+ */
+static void emitMultiplyImmediate(Emitter *e, Reg reg, Reg rm, int8_t imm) {
+    emitRex(e, 1, reg, RAX, rm);
+    emitByte(e, 0x6B);
+    emitModRM(e, 3, reg, rm);
+    emitByte(e, (uint8_t)imm);
+}
+
+/*
+ * emitDivide() - "cqo; idiv rm": rax / rm into rax, clobbering rdx
+ */
+static void emitDivide(Emitter *e, Reg rm) {
+    emitByte(e, 0x48);
+    emitByte(e, 0x99);
+    emitRex(e, 1, RAX, RAX, rm);
+    emitByte(e, 0xF7);
+    emitModRM(e, 3, 7, rm);
+}
+
+/*
+ * emitZeroExtend() - "mov reg32, reg32", clearing the upper half of an int result
+ */
+static void emitZeroExtend(Emitter *e, Reg reg) {
+    emitRex(e, 0, reg, RAX, reg);
+    emitByte(e, 0x89);
+    emitModRM(e, 3, reg, reg);
+}
+
+static void emitPush(Emitter *e, Reg reg) {
+    emitRex(e, 0, RAX, RAX, reg);
+    emitByte(e, 0x50 + (reg & 7));
+}
+
+static void emitPop(Emitter *e, Reg reg) {
+    emitRex(e, 0, RAX, RAX, reg);
+    emitByte(e, 0x58 + (reg & 7));
+}
+
+
+/*
+ * emitJump() - Emits a jmp or jcc with a rel32 to patch, returning its offset
+ */
+static size_t emitJump(Emitter *e, Cond cond) {
+    if (cond == CC_ALWAYS) {
+        emitByte(e, 0xE9);
+    } else {
+        emitByte(e, 0x0F);
+        emitByte(e, 0x80 + (unsigned int)cond);
+    }
+    emitU32(e, 0);
+    return e->len - 4;
+}
+
+/*
+ * patchJump() - Points the rel32 at offset at to target
+ */
+static void patchJump(Emitter *e, size_t at, size_t target) {
+    uint32_t rel = (uint32_t)((int64_t)target - (int64_t)(at + 4));
+    memcpy(e->code + at, &rel, 4);
+}
+
+/*
+ * emitBranch() - Emits a jump to an instruction of the current function
+ */
+static void emitBranch(Emitter *e, Cond cond, size_t target) {
+    size_t at = emitJump(e, cond);
+    e->branches = growArray(e->branches, e->branch_count, &e->branch_capacity, sizeof(Fixup));
+    e->branches[e->branch_count++] = (Fixup){at, target};
+}
+
+/*
+ * emitCallC() - Calls a C function, its arguments already in rdi and rsi
+ */
+static void emitCallC(Emitter *e, uintptr_t function) {
+    emitMoveImmediate(e, RAX, function);
+    emitRex(e, 0, RAX, RAX, RAX);
+    emitByte(e, 0xFF);
+    emitModRM(e, 3, 2, RAX);
+}
+
+
+/*
+ * SlowPath - Jumps to the out-of-line path of one instruction
+ */
+typedef struct {
+    size_t at[MAX_SLOW_JUMPS];
+    size_t count;
+} SlowPath;
+
+static void jumpToSlowPath(Emitter *e, SlowPath *slow, Cond cond) {
+    slow->at[slow->count++] = emitJump(e, cond);
+}
+
+static void bindSlowPath(Emitter *e, SlowPath *slow) {
+    for (size_t i = 0; i < slow->count; i++) patchJump(e, slow->at[i], e->len);
+}
+
+
+/*
+ * Cached stack state, as RELOAD(), SPILL() and RESERVE() in bytecode.c
+ *
+ * None of them touches rax except emitReserve(), so an int returned by
+ * an out-of-line call survives emitReload().
+ */
+static void emitReload(Emitter *e) {
+    emitLoad(e, BASE, STACK, RSP, LIST_ELEMENT);
+    emitLoad(e, DEPTH, STACK, RSP, LIST_LEN);
+    emitRegReg(e, OP_XOR, TOS, TOS);
+    emitRegReg(e, OP_TEST, DEPTH, DEPTH);
+    size_t empty = emitJump(e, CC_E);
+    emitLoad(e, TOS, BASE, DEPTH, -8);
+    patchJump(e, empty, e->len);
+}
+
+/* base[depth-1] = tos, unless the stack is empty */
+static void emitWriteBack(Emitter *e) {
+    emitRegReg(e, OP_TEST, DEPTH, DEPTH);
+    size_t empty = emitJump(e, CC_E);
+    emitStore(e, TOS, BASE, DEPTH, -8);
+    patchJump(e, empty, e->len);
+}
+
+static void emitSpill(Emitter *e) {
+    emitWriteBack(e);
+    emitStore(e, DEPTH, STACK, RSP, LIST_LEN);
+}
+
+static void emitReserve(Emitter *e, unsigned int headroom) {
+    if (headroom == 0) return;
+
+    emitMemory(e, 0x8D, RSI, DEPTH, RSP, (int32_t)headroom);
+    emitMemory(e, 0x3B, RSI, STACK, RSP, LIST_CAPACITY);
+    size_t enough = emitJump(e, CC_BE);
+    emitRegReg(e, OP_MOV, RDI, STACK);
+    emitCallC(e, (uintptr_t)listReserve);
+    emitLoad(e, BASE, STACK, RSP, LIST_ELEMENT);
+    patchJump(e, enough, e->len);
+}
+
+/* Pops tos: the item below becomes the top, or NULL */
+static void emitPopTos(Emitter *e) {
+    emitImmediate(e, EXT_SUB, DEPTH, 1);
+    emitRegReg(e, OP_XOR, TOS, TOS);
+    emitRegReg(e, OP_TEST, DEPTH, DEPTH);
+    size_t empty = emitJump(e, CC_E);
+    emitLoad(e, TOS, BASE, DEPTH, -8);
+    patchJump(e, empty, e->len);
+}
+
+
+/*
+ * emitOutOfLine() - Runs an Operation (or OperandOperation) on the spilled stack
+ */
+static void emitOutOfLine(Emitter *e, uintptr_t function, const tfobj *operand) {
+    emitSpill(e);
+    emitRegReg(e, OP_MOV, RDI, CONTEXT);
+    if (operand != NULL) emitMoveImmediate(e, RSI, (uint64_t)(uintptr_t)operand);
+    emitCallC(e, function);
+    emitReload(e);
+}
+
+/*
+ * emitUntag() - Clears the tag of reg, jumping to slow unless it was an integer
+ *
+ * As untagInteger() in bytecode.c: only an integer leaves the low two
+ * bits zero.
+ */
+static void emitUntag(Emitter *e, Reg reg, SlowPath *slow) {
+    emitImmediate(e, EXT_SUB, reg, TF_TAG_INT);
+    emitTestImmediate(e, reg, TF_TAG_MASK);
+    jumpToSlowPath(e, slow, CC_NE);
+}
+
+
+/*
+ * Arithmetic - Inline integer operations on untagged rcx and rdx
+ */
+typedef enum {
+    ARITH_ADD,
+    ARITH_SUB,
+    ARITH_SWAP_SUB,
+    ARITH_MUL,
+    ARITH_DIV
+} Arithmetic;
+
+/*
+ * emitArithmetic() - rcx = rcx op rdx on untagged integers
+ *
+ * Jumps to slow whenever the result would not be an immediate, like the
+ * __builtin_*_overflow() checks of the bytecode engine, and on division
+ * by zero.
+ */
+static void emitArithmetic(Emitter *e, Arithmetic kind, SlowPath *slow) {
+    switch (kind) {
+    case ARITH_ADD:
+        emitRegReg(e, OP_ADD, RCX, RDX);
+        jumpToSlowPath(e, slow, CC_O);
+        break;
+    case ARITH_SUB:
+        emitRegReg(e, OP_SUB, RCX, RDX);
+        jumpToSlowPath(e, slow, CC_O);
+        break;
+    case ARITH_SWAP_SUB:
+        emitRegReg(e, OP_SUB, RDX, RCX);
+        jumpToSlowPath(e, slow, CC_O);
+        emitRegReg(e, OP_MOV, RCX, RDX);
+        break;
+    case ARITH_MUL:
+        emitShift(e, EXT_SAR, RDX, TF_TAG_SHIFT);
+        emitMultiply(e, RCX, RDX);
+        jumpToSlowPath(e, slow, CC_O);
+        break;
+    case ARITH_DIV:
+        emitRegReg(e, OP_TEST, RDX, RDX);
+        jumpToSlowPath(e, slow, CC_E);
+        emitRegReg(e, OP_MOV, RAX, RCX);
+        emitShift(e, EXT_SAR, RAX, TF_TAG_SHIFT);
+        emitRegReg(e, OP_MOV, RSI, RDX);
+        emitShift(e, EXT_SAR, RSI, TF_TAG_SHIFT);
+        emitDivide(e, RSI);
+        /* Only the quotient of the smallest immediate by -1 overflows 4q */
+        emitMultiplyImmediate(e, RCX, RAX, 1 << TF_TAG_SHIFT);
+        jumpToSlowPath(e, slow, CC_O);
+        break;
+    }
+}
+
+/*
+ * emitBinary() - Inline arithmetic on the two top items
+ */
+static void emitBinary(Emitter *e, Arithmetic kind, Operation fallback) {
+    SlowPath slow = {{0}, 0};
+
+    emitImmediate(e, EXT_CMP, DEPTH, 2);
+    jumpToSlowPath(e, &slow, CC_B);
+    emitLoad(e, RCX, BASE, DEPTH, -16);
+    emitUntag(e, RCX, &slow);
+    emitRegReg(e, OP_MOV, RDX, TOS);
+    emitUntag(e, RDX, &slow);
+    emitArithmetic(e, kind, &slow);
+    emitRegReg(e, OP_MOV, TOS, RCX);
+    emitImmediate(e, EXT_OR, TOS, TF_TAG_INT);
+    emitImmediate(e, EXT_SUB, DEPTH, 1);
+    size_t done = emitJump(e, CC_ALWAYS);
+
+    bindSlowPath(e, &slow);
+    emitOutOfLine(e, (uintptr_t)fallback, NULL);
+    patchJump(e, done, e->len);
+}
+
+/*
+ * emitLiteral() - Inline arithmetic of the top item with a literal
+ *
+ * The literal is known now, so a literal that is no immediate integer
+ * always takes the primitive.
+ */
+static void emitLiteral(Emitter *e, Arithmetic kind, OperandOperation fallback, const tfobj *literal) {
+    SlowPath slow = {{0}, 0};
+
+    if (((uintptr_t)literal & TF_TAG_MASK) != TF_TAG_INT) {
+        emitOutOfLine(e, (uintptr_t)fallback, literal);
+        return;
+    }
+
+    emitRegReg(e, OP_TEST, DEPTH, DEPTH);
+    jumpToSlowPath(e, &slow, CC_E);
+    emitRegReg(e, OP_MOV, RCX, TOS);
+    emitUntag(e, RCX, &slow);
+    emitMoveImmediate(e, RDX, (uint64_t)((uintptr_t)literal - TF_TAG_INT));
+    emitArithmetic(e, kind, &slow);
+    emitRegReg(e, OP_MOV, TOS, RCX);
+    emitImmediate(e, EXT_OR, TOS, TF_TAG_INT);
+    size_t done = emitJump(e, CC_ALWAYS);
+
+    bindSlowPath(e, &slow);
+    emitOutOfLine(e, (uintptr_t)fallback, literal);
+    patchJump(e, done, e->len);
+}
+
+
+/*
+ * isTranslatable() - Tells whether a word body can get native code
+ *
+ * compileBytecode() rejects (and reports) unknown words up front, while
+ * execute() only reports them if they are reached, so such bodies stay
+ * with execute().
+ */
+static int isTranslatable(tfobj *body) {
+    for (size_t i = 0; i < body->list_obj.len; i++) {
+        tfobj *object = body->list_obj.element[i];
+        TF_OBJ_TYPE type = getObjectType(object);
+
+        if (type == TF_OBJ_SYMBOL && lookupWord(object) == NULL) return 0;
+        if (type == TF_OBJ_LIST || type == TF_OBJ_ROPE || type == TF_OBJ_ARRAY) return 0;
+    }
+    return 1;
+}
+
+/*
+ * functionFor() - Index of the native function of a word body
+ *
+ * Adds the body the first time it is called; it is translated after the
+ * function being emitted. Returns SIZE_MAX for a body left to execute().
+ */
+static size_t functionFor(Emitter *e, tfobj *body) {
+    for (size_t i = 1; i < e->function_count; i++) {
+        if (e->functions[i].body == body) return e->functions[i].bytecode != NULL ? i : SIZE_MAX;
+    }
+
+    tfbytecode *bytecode = isTranslatable(body) ? compileBytecode(body) : NULL;
+    size_t index = e->function_count++;
+    e->functions = growArray(e->functions, index, &e->function_capacity, sizeof(JitFunction));
+    e->functions[index] = (JitFunction){body, bytecode, 0};
+
+    return bytecode != NULL ? index : SIZE_MAX;
+}
+
+
+/*
+ * emitInstruction() - Emits the machine code of one bytecode instruction
+ */
+static void emitInstruction(Emitter *e, const tfinstr *instr) {
+    switch (instr->opcode) {
+    case TF_OP_PUSH:
+    case TF_OP_PUSH_COUNTED:
+        emitWriteBack(e);
+        emitMoveImmediate(e, TOS, (uint64_t)(uintptr_t)instr->operand.object);
+        emitImmediate(e, EXT_ADD, DEPTH, 1);
+        if (instr->opcode == TF_OP_PUSH_COUNTED) {
+            emitRegReg(e, OP_MOV, RDI, TOS);
+            emitCallC(e, (uintptr_t)incrementReferenceCount);
+        }
+        break;
+
+    case TF_OP_ADD: emitBinary(e, ARITH_ADD, operationAdd); break;
+    case TF_OP_SUB: emitBinary(e, ARITH_SUB, operationSub); break;
+    case TF_OP_MUL: emitBinary(e, ARITH_MUL, operationMul); break;
+    case TF_OP_DIV: emitBinary(e, ARITH_DIV, operationDiv); break;
+    case TF_OP_SWAP_SUB: emitBinary(e, ARITH_SWAP_SUB, operationSwapSub); break;
+
+    case TF_OP_ADD_LIT: emitLiteral(e, ARITH_ADD, operationAddLiteral, instr->operand.object); break;
+    case TF_OP_SUB_LIT: emitLiteral(e, ARITH_SUB, operationSubLiteral, instr->operand.object); break;
+    case TF_OP_MUL_LIT: emitLiteral(e, ARITH_MUL, operationMulLiteral, instr->operand.object); break;
+    case TF_OP_DIV_LIT: emitLiteral(e, ARITH_DIV, operationDivLiteral, instr->operand.object); break;
+
+    case TF_OP_PRINT:
+        emitOutOfLine(e, (uintptr_t)operationPrint, NULL);
+        break;
+
+    case TF_OP_DUP: {
+        /* dup of an empty stack is a no-op, as in operationDup() */
+        emitRegReg(e, OP_TEST, DEPTH, DEPTH);
+        size_t empty = emitJump(e, CC_E);
+        emitStore(e, TOS, BASE, DEPTH, -8);
+        emitImmediate(e, EXT_ADD, DEPTH, 1);
+        emitTestImmediate(e, TOS, TF_TAG_MASK);
+        size_t immediate = emitJump(e, CC_NE);
+        emitRegReg(e, OP_MOV, RDI, TOS);
+        emitCallC(e, (uintptr_t)incrementReferenceCount);
+        patchJump(e, empty, e->len);
+        patchJump(e, immediate, e->len);
+        break;
+    }
+
+    case TF_OP_DROP: {
+        SlowPath slow = {{0}, 0};
+        emitRegReg(e, OP_TEST, DEPTH, DEPTH);
+        jumpToSlowPath(e, &slow, CC_E);
+        emitRegReg(e, OP_MOV, RDI, TOS);
+        emitPopTos(e);
+        emitTestImmediate(e, RDI, TF_TAG_MASK);
+        size_t immediate = emitJump(e, CC_NE);
+        emitCallC(e, (uintptr_t)decrementReferenceCount);
+        size_t done = emitJump(e, CC_ALWAYS);
+        bindSlowPath(e, &slow);
+        emitOutOfLine(e, (uintptr_t)operationDrop, NULL);
+        patchJump(e, immediate, e->len);
+        patchJump(e, done, e->len);
+        break;
+    }
+
+    case TF_OP_SWAP: {
+        SlowPath slow = {{0}, 0};
+        emitImmediate(e, EXT_CMP, DEPTH, 2);
+        jumpToSlowPath(e, &slow, CC_B);
+        emitLoad(e, RAX, BASE, DEPTH, -16);
+        emitStore(e, TOS, BASE, DEPTH, -16);
+        emitRegReg(e, OP_MOV, TOS, RAX);
+        size_t done = emitJump(e, CC_ALWAYS);
+        bindSlowPath(e, &slow);
+        emitOutOfLine(e, (uintptr_t)operationSwap, NULL);
+        patchJump(e, done, e->len);
+        break;
+    }
+
+    case TF_OP_SQUARE: {
+        SlowPath slow = {{0}, 0};
+        emitRegReg(e, OP_TEST, DEPTH, DEPTH);
+        jumpToSlowPath(e, &slow, CC_E);
+        emitRegReg(e, OP_MOV, RCX, TOS);
+        emitUntag(e, RCX, &slow);
+        emitRegReg(e, OP_MOV, RDX, RCX);
+        emitArithmetic(e, ARITH_MUL, &slow);
+        emitRegReg(e, OP_MOV, TOS, RCX);
+        emitImmediate(e, EXT_OR, TOS, TF_TAG_INT);
+        size_t done = emitJump(e, CC_ALWAYS);
+        bindSlowPath(e, &slow);
+        emitOutOfLine(e, (uintptr_t)operationSquare, NULL);
+        patchJump(e, done, e->len);
+        break;
+    }
+
+    case TF_OP_CALL:
+        /* The callee may push any number of items: reserve for what follows */
+        emitOutOfLine(e, (uintptr_t)instr->operand.op, NULL);
+        emitReserve(e, instr->headroom);
+        break;
+
+    case TF_OP_WORD: {
+        tfobj *word = instr->operand.object;
+        size_t function = word->word_obj.operand_op == callWordBody
+                        ? functionFor(e, word->word_obj.operand) : SIZE_MAX;
+
+        if (function != SIZE_MAX) {
+            emitSpill(e);
+            emitRegReg(e, OP_MOV, RDI, CONTEXT);
+            emitByte(e, 0xE8);
+            emitU32(e, 0);
+            e->calls = growArray(e->calls, e->call_count, &e->call_capacity, sizeof(Fixup));
+            e->calls[e->call_count++] = (Fixup){e->len - 4, function};
+            emitReload(e);
+        } else {
+            emitOutOfLine(e, (uintptr_t)word->word_obj.operand_op, word->word_obj.operand);
+        }
+        emitReserve(e, instr->headroom);
+        break;
+    }
+
+    case TF_OP_BRANCH:
+        emitReserve(e, instr->headroom);
+        emitBranch(e, CC_ALWAYS, instr->operand.target);
+        break;
+
+    case TF_OP_BRANCH_IF_FALSE: {
+        /* Reserving before the pop covers one item more than needed */
+        SlowPath slow = {{0}, 0};
+        emitReserve(e, instr->headroom);
+        emitRegReg(e, OP_TEST, DEPTH, DEPTH);
+        jumpToSlowPath(e, &slow, CC_E);
+        /* Immediate flags are false exactly when their payload is 0 */
+        emitTestImmediate(e, TOS, TF_TAG_MASK);
+        jumpToSlowPath(e, &slow, CC_E);
+        emitRegReg(e, OP_MOV, RAX, TOS);
+        emitShift(e, EXT_SHR, RAX, TF_TAG_SHIFT);
+        emitPopTos(e);
+        size_t test = emitJump(e, CC_ALWAYS);
+        bindSlowPath(e, &slow);
+        emitOutOfLine(e, (uintptr_t)popFlag, NULL);
+        emitZeroExtend(e, RAX);
+        patchJump(e, test, e->len);
+        emitRegReg(e, OP_TEST, RAX, RAX);
+        emitBranch(e, CC_E, instr->operand.target);
+        break;
+    }
+
+    case TF_OP_LOOP: {
+        /* The loop stack is separate from the data stack: no spill needed */
+        SlowPath slow = {{0}, 0};
+        emitReserve(e, instr->headroom);
+        emitLoad(e, RAX, CONTEXT, RSP, CONTEXT_LOOPS);
+        emitLoad(e, RCX, RAX, RSP, LIST_LEN);
+        emitLoad(e, RDX, RAX, RSP, LIST_ELEMENT);
+        emitLoad(e, RSI, RDX, RCX, -16);
+        emitLoad(e, RDI, RDX, RCX, -8);
+        /* Both are integers exactly when neither untagged copy has tag bits */
+        emitRegReg(e, OP_MOV, R8, RSI);
+        emitImmediate(e, EXT_SUB, R8, TF_TAG_INT);
+        emitRegReg(e, OP_MOV, R9, RDI);
+        emitImmediate(e, EXT_SUB, R9, TF_TAG_INT);
+        emitRegReg(e, OP_OR, R8, R9);
+        emitTestImmediate(e, R8, TF_TAG_MASK);
+        jumpToSlowPath(e, &slow, CC_NE);
+        /* Tagged integers compare like their values. do does not check that
+           index < limit, so an index at TF_IMMEDIATE_MAX overflows here and
+           is left to stepLoop(), which ends the loop */
+        emitImmediate(e, EXT_ADD, RDI, 1 << TF_TAG_SHIFT);
+        jumpToSlowPath(e, &slow, CC_O);
+        emitRegReg(e, OP_CMP, RDI, RSI);
+        size_t finished = emitJump(e, CC_GE);
+        emitStore(e, RDI, RDX, RCX, -8);
+        emitBranch(e, CC_ALWAYS, instr->operand.target);
+        patchJump(e, finished, e->len);
+        emitImmediate(e, EXT_SUB, RCX, 2);
+        emitStore(e, RCX, RAX, RSP, LIST_LEN);
+        size_t done = emitJump(e, CC_ALWAYS);
+        bindSlowPath(e, &slow);
+        emitRegReg(e, OP_MOV, RDI, CONTEXT);
+        emitCallC(e, (uintptr_t)stepLoop);
+        emitZeroExtend(e, RAX);
+        emitRegReg(e, OP_TEST, RAX, RAX);
+        emitBranch(e, CC_NE, instr->operand.target);
+        patchJump(e, done, e->len);
+        break;
+    }
+
+    case TF_OP_HALT:
+        emitSpill(e);
+        emitPop(e, R15);
+        emitPop(e, R14);
+        emitPop(e, R13);
+        emitPop(e, R12);
+        emitPop(e, RBX);
+        emitByte(e, 0xC3);
+        break;
+    }
+}
+
+
+/*
+ * ensureCode() - Makes room in the code buffer for one more instruction
+ */
+static void ensureCode(Emitter *e) {
+    while (e->len + MAX_INSTRUCTION_BYTES > e->capacity) {
+        e->code = growArray(e->code, e->capacity, &e->capacity, 1);
+    }
+}
+
+
+/*
+ * emitFunction() - Emits the native function of functions[index]
+ *
+ * Five pushes after the return address leave rsp 16-byte aligned for the
+ * calls inside. Translating may add functions, which moves the array.
+ */
+static void emitFunction(Emitter *e, size_t index) {
+    const tfbytecode *bytecode = e->functions[index].bytecode;
+    size_t *starts = wmalloc(sizeof(size_t) * bytecode->len);
+
+    ensureCode(e);
+    e->functions[index].entry = e->len;
+    emitPush(e, RBX);
+    emitPush(e, R12);
+    emitPush(e, R13);
+    emitPush(e, R14);
+    emitPush(e, R15);
+    emitRegReg(e, OP_MOV, CONTEXT, RDI);
+    emitLoad(e, STACK, CONTEXT, RSP, CONTEXT_STACK);
+    emitReload(e);
+    emitReserve(e, bytecode->headroom);
+
+    e->branch_count = 0;
+    for (size_t i = 0; i < bytecode->len; i++) {
+        ensureCode(e);
+        starts[i] = e->len;
+        emitInstruction(e, &bytecode->code[i]);
+    }
+
+    for (size_t i = 0; i < e->branch_count; i++) {
+        patchJump(e, e->branches[i].at, starts[e->branches[i].target]);
+    }
+    free(starts);
+}
+
+
+/*
+ * compileJit() implementation
+ *
+ * functions grows while it is walked: each call to a new body adds the
+ * function that is emitted after the current ones.
+ */
+tfjit *compileJit(const tfbytecode *bytecode) {
+    if (bytecode == NULL) return NULL;
+
+    Emitter e;
+    memset(&e, 0, sizeof(e));
+    e.functions = growArray(NULL, 0, &e.function_capacity, sizeof(JitFunction));
+    e.functions[e.function_count++] = (JitFunction){NULL, (tfbytecode *)bytecode, 0};
+
+    for (size_t f = 0; f < e.function_count; f++) {
+        if (e.functions[f].bytecode != NULL) emitFunction(&e, f);
+    }
+    for (size_t i = 0; i < e.call_count; i++) {
+        patchJump(&e, e.calls[i].at, e.functions[e.calls[i].target].entry);
+    }
+    free(e.calls);
+    free(e.branches);
+
+    /* Written while writable, then switched to executable (never both) */
+    void *map = mmap(NULL, e.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map != MAP_FAILED) {
+        memcpy(map, e.code, e.len);
+        if (mprotect(map, e.len, PROT_READ | PROT_EXEC) != 0) {
+            munmap(map, e.len);
+            map = MAP_FAILED;
+        }
+    }
+    free(e.code);
+
+    tfjit *jit = wmalloc(sizeof(tfjit));
+    jit->code = map != MAP_FAILED ? map : NULL;
+    jit->size = e.len;
+    jit->functions = e.functions;
+    jit->function_count = e.function_count;
+
+    if (jit->code == NULL) {
+        freeJit(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+
+/*
+ * executeJit() implementation
+ */
+void executeJit(const tfjit *jit, tfcontext *context) {
+    if (jit == NULL || context == NULL) return;
+
+    JitEntry entry = (JitEntry)(uintptr_t)(jit->code + jit->functions[0].entry);
+    entry(context);
+}
+
+
+/*
+ * freeJit() implementation
+ *
+ * functions[0] is the caller's bytecode; the bodies' bytecode is ours.
+ */
+void freeJit(tfjit *jit) {
+    if (jit == NULL) return;
+
+    if (jit->code != NULL) munmap(jit->code, jit->size);
+    for (size_t f = 1; f < jit->function_count; f++) {
+        freeBytecode(jit->functions[f].bytecode);
+    }
+    free(jit->functions);
+    free(jit);
+}
+
+
+#else
+
+
+struct tfjit {
+    int unused;
+};
+
+
+/*
+ * compileJit() implementation, for hosts without a JIT
+ */
+tfjit *compileJit(const tfbytecode *bytecode) {
+    (void)bytecode;
+    return NULL;
+}
+
+
+/*
+ * executeJit() implementation, for hosts without a JIT
+ */
+void executeJit(const tfjit *jit, tfcontext *context) {
+    (void)jit;
+    (void)context;
+}
+
+
+/*
+ * freeJit() implementation, for hosts without a JIT
+ */
+void freeJit(tfjit *jit) {
+    (void)jit;
+}
+
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * JIT Module - Native Code for Compiled Programs
+ *
+ * A template JIT behind the bytecode engine: every instruction of a
+ * bytecode program is replaced by a fixed sequence of x86-64 machine code,
+ * written into an mmap()'d buffer that is made executable once complete.
+ * The cached stack state of executeBytecode() lives in callee-saved
+ * registers (the stack array, the depth and the top of stack), so the
+ * integer fast paths of the core primitives run without touching memory
+ * beyond the stack itself. Everything else, and every fast path whose
+ * operands do not qualify, calls the same Operation the bytecode engine
+ * calls out of line, so results and diagnostics stay identical.
+ *
+ * Bodies of the user words a program calls are translated too, each into
+ * a native function of its own, and called directly. A body the JIT
+ * cannot translate is called through callWordBody(), i.e. run by
+ * execute().
+ *
+ * Only x86-64 hosts with the System V ABI are supported. Elsewhere, or
+ * when built with -DTF_NO_JIT, compileJit() returns NULL and callers run
+ * the bytecode instead.
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include "tforth.h"
+#include "bytecode.h"
+
+
+/*
+ * tfjit - Native code of a program and of the word bodies it calls
+ */
+typedef struct tfjit tfjit;
+
+
+/*
+ * compileJit() - Translates a bytecode program into native code
+ *
+ * The machine code refers to the literals and words of the bytecode, so
+ * the bytecode must outlive the result.
+ *
+ * Args:
+ *   bytecode - Program returned by compileBytecode()
+ *
+ * Returns:
+ *   Native program (free with freeJit()), or NULL if this host has no JIT
+ *   or executable memory could not be mapped
+ */
+tfjit *compileJit(const tfbytecode *bytecode);
+
+/*
+ * executeJit() - Runs a native program
+ *
+ * Produces exactly the same results and diagnostics as executeBytecode()
+ * on the bytecode it was compiled from.
+ *
+ * Args:
+ *   jit     - Program returned by compileJit()
+ *   context - VM execution context
+ */
+void executeJit(const tfjit *jit, tfcontext *context);
+
+/*
+ * freeJit() - Unmaps a native program and releases the bytecode of its bodies
+ *
+ * Args:
+ *   jit - Program to free (may be NULL; no-op if so)
+ */
+void freeJit(tfjit *jit);
+
+
+#endif
@@ -1,32 +1,136 @@
-/*
- * List/Array Implementation
- *
- * Implements dynamic array operations for TF_OBJ_LIST, with automatic
- * capacity doubling when needed. Lists are the primary container type
- * in ToyForth and are used for stacks, compiled programs, and user data.
- */
-
-#include "list.h"
-#include "mem.h"
-#include "tforth.h"
-
-
-/*
- * listAppendObject() implementation
- *
- * Appends an object to the end of a list, with automatic capacity
- * management. When the list is full, capacity is doubled. The list
- * acquires a new reference to the object (increments refcount).
- */
-void listAppendObject(tfobj *list, tfobj *object) {
-    if (list->list_obj.len >= list->list_obj.capacity) {
-        list->list_obj.capacity *= 2;  
-        list->list_obj.element = wrealloc(list->list_obj.element, sizeof(tfobj *) * list->list_obj.capacity);
-    }
-
-    list->list_obj.element[list->list_obj.len] = object;                            
-    list->list_obj.len++;
-    
-    /* The list acquires a reference to the object */
-    incrementReferenceCount(object);                                                
-}
\ No newline at end of file
+/*
+ * List/Array Implementation
+ *
+ * Implements dynamic array operations for TF_OBJ_LIST, with automatic
+ * capacity doubling when needed. Lists are the primary container type
+ * in ToyForth and are used for stacks, compiled programs, and user data.
+ * The TF_OBJ_ARRAY kernels below are written to be auto-vectorized.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "list.h"
+#include "mem.h"
+#include "tforth.h"
+
+
+/*
+ * listAppendObject() implementation
+ *
+ * Appends an object to the end of a list, with automatic capacity
+ * management. When the list is full, capacity is doubled. The list
+ * acquires a new reference to the object (increments refcount).
+ */
+void listAppendObject(tfobj *list, tfobj *object) {
+    if (list->list_obj.len >= list->list_obj.capacity) {
+        list->list_obj.capacity *= 2;  
+        list->list_obj.element = wrealloc(list->list_obj.element, sizeof(tfobj *) * list->list_obj.capacity);
+    }
+
+    list->list_obj.element[list->list_obj.len] = object;                            
+    list->list_obj.len++;
+    
+    /* The list acquires a reference to the object */
+    incrementReferenceCount(object);                                                
+}
+
+
+/*
+ * listReserve() implementation
+ *
+ * Grows by doubling, like listAppendObject(), so repeated reservations
+ * stay amortized O(1). A capacity too large to be addressed is reported
+ * as out of memory rather than left to overflow the doubling.
+ */
+void listReserve(tfobj *list, size_t capacity) {
+    if (list->list_obj.capacity >= capacity) return;
+
+    if (capacity > SIZE_MAX / sizeof(tfobj *)) {
+        fprintf(stderr, "OOM. Couldn't reserve %zu list slots.\n", capacity);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t grown = list->list_obj.capacity > 0 ? list->list_obj.capacity : 1;
+    while (grown < capacity) {
+        grown = grown <= capacity / 2 ? grown * 2 : capacity;
+    }
+    list->list_obj.capacity = grown;
+    list->list_obj.element = wrealloc(list->list_obj.element, sizeof(tfobj *) * grown);
+}
+
+
+/*
+ * listClear() implementation
+ */
+void listClear(tfobj *list) {
+    for (size_t i = 0; i < list->list_obj.len; i++) {
+        decrementReferenceCount(list->list_obj.element[i]);
+    }
+    list->list_obj.len = 0;
+}
+
+/*
+ * arraySum() implementation
+ */
+int arraySum(const int64_t *element, size_t len, int64_t *sum) {
+    int64_t total = 0;
+    int overflow = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        overflow |= __builtin_add_overflow(total, element[i], &total);
+    }
+
+    *sum = total;
+    return !overflow;
+}
+
+
+/*
+ * arrayDot() implementation
+ */
+int arrayDot(const int64_t *restrict a, const int64_t *restrict b, size_t len, int64_t *dot) {
+    int64_t total = 0;
+    int overflow = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        int64_t product;
+        overflow |= __builtin_mul_overflow(a[i], b[i], &product);
+        overflow |= __builtin_add_overflow(total, product, &total);
+    }
+
+    *dot = total;
+    return !overflow;
+}
+
+
+/*
+ * arrayAddScalar() implementation
+ *
+ * Elementwise, so updating in place (into == from) is safe even though
+ * the pointers cannot be restrict.
+ */
+int arrayAddScalar(int64_t *into, const int64_t *from, size_t len, int64_t value) {
+    int overflow = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        overflow |= __builtin_add_overflow(from[i], value, &into[i]);
+    }
+
+    return !overflow;
+}
+
+
+/*
+ * arrayMulScalar() implementation
+ */
+int arrayMulScalar(int64_t *into, const int64_t *from, size_t len, int64_t value) {
+    int overflow = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        overflow |= __builtin_mul_overflow(from[i], value, &into[i]);
+    }
+
+    return !overflow;
+}
@@ -1,27 +1,110 @@
-/*
- * List Module - Dynamic Array Operations
- *
- * Provides utilities for manipulating TF_OBJ_LIST objects with automatic
- * resizing and reference counting. The list is the primary container type
- * used for the data stack and compiled program representation.
- */
-
-#ifndef LIST_H
-#define LIST_H
-
-#include "tforth.h"
-
-/*
- * listAppendObject() - Appends an object to a list with automatic resizing
- *
- * Adds a new object to the end of a list, doubling capacity when needed.
- * Increments the object's refcount since the list now holds a reference.
- *
- * Args:
- *   list   - Target list object (must be TF_OBJ_LIST)
- *   object - Object to append (any tfobj type)
- */
-void listAppendObject(tfobj *list, tfobj *object);
-
-
+/*
+ * List Module - Dynamic Array Operations
+ *
+ * Provides utilities for manipulating TF_OBJ_LIST objects with automatic
+ * resizing and reference counting. The list is the primary container type
+ * used for the data stack and compiled program representation.
+ *
+ * Also holds the kernels over TF_OBJ_ARRAY elements. They are plain loops
+ * over int64_t arrays that do not alias (restrict). Overflow is detected
+ * with __builtin_*_overflow() and the flags are ORed together rather than
+ * branched on, so each loop body stays straight-line code; the caller
+ * reports an overflow once the loop is done.
+ */
+
+#ifndef LIST_H
+#define LIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tforth.h"
+
+/*
+ * listAppendObject() - Appends an object to a list with automatic resizing
+ *
+ * Adds a new object to the end of a list, doubling capacity when needed.
+ * Increments the object's refcount since the list now holds a reference.
+ *
+ * Args:
+ *   list   - Target list object (must be TF_OBJ_LIST)
+ *   object - Object to append (any tfobj type)
+ */
+void listAppendObject(tfobj *list, tfobj *object);
+
+/*
+ * listReserve() - Ensures a list can hold a number of elements without resizing
+ *
+ * Doubles the capacity until it reaches at least the requested number of
+ * elements. Engines use it to check the stack capacity once, instead of
+ * before every push.
+ *
+ * Args:
+ *   list     - Target list object (must be TF_OBJ_LIST)
+ *   capacity - Minimum number of elements the list must be able to hold
+ */
+void listReserve(tfobj *list, size_t capacity);
+
+/*
+ * listClear() - Removes every element of a list, keeping its capacity
+ *
+ * Drops the list's reference to each element, so a list that is refilled
+ * often (such as a reused stack) never reallocates its array.
+ *
+ * Args:
+ *   list - Target list object (must be TF_OBJ_LIST)
+ */
+void listClear(tfobj *list);
+
+/*
+ * arraySum() - Adds up the elements of an integer array
+ *
+ * Args:
+ *   element - Elements to add
+ *   len     - Number of elements
+ *   sum     - Receives the sum
+ *
+ * Returns:
+ *   1, or 0 if the sum (or a partial sum) overflowed 64 bits
+ */
+int arraySum(const int64_t *element, size_t len, int64_t *sum);
+
+/*
+ * arrayDot() - Computes the dot product of two integer arrays
+ *
+ * Args:
+ *   a, b - Elements to multiply pairwise
+ *   len  - Number of elements of each
+ *   dot  - Receives the sum of the products
+ *
+ * Returns:
+ *   1, or 0 if a product or partial sum overflowed 64 bits
+ */
+int arrayDot(const int64_t *restrict a, const int64_t *restrict b, size_t len, int64_t *dot);
+
+/*
+ * arrayAddScalar() - Adds a value to every element of an integer array
+ *
+ * into may be the same array as from (updating in place) but must not
+ * overlap it otherwise.
+ *
+ * Args:
+ *   into  - Receives the results
+ *   from  - Elements to add to
+ *   len   - Number of elements
+ *   value - Value added to each element
+ *
+ * Returns:
+ *   1, or 0 if any result overflowed 64 bits (it is stored wrapped around)
+ */
+int arrayAddScalar(int64_t *into, const int64_t *from, size_t len, int64_t value);
+
+/*
+ * arrayMulScalar() - Multiplies every element of an integer array by a value
+ *
+ * Same contract as arrayAddScalar().
+ */
+int arrayMulScalar(int64_t *into, const int64_t *from, size_t len, int64_t value);
+
+
 #endif 
\ No newline at end of file
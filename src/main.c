@@ -1,52 +1,494 @@
-/*
- * ToyForth Interpreter - Main Entry Point
- *
- * Implements the main execution flow:
- *   1. Load source code from file
- *   2. Compile to intermediate representation
- *   3. Execute on the virtual machine
- *   4. Clean up resources
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-
-#include "mem.h"
-#include "engine.h"
-#include "tforth.h"
-#include "file_utils.h"
-#include "parser.h"
-
-/*
- * main() - Program entry point
- *
- * Orchestrates the three phases of the ToyForth interpreter:
- *   1. File Loading: Reads the source program from the specified file
- *   2. Compilation:  Parses and tokenizes into executable objects
- *   3. Execution:    Runs the compiled program on the VM
- *
- * Usage:
- *   toyfort <source-file>
- *
- * Returns:
- *   EXIT_SUCCESS (0) if successful
- *   EXIT_FAILURE (1) if arguments invalid or execution error occurs
- */
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "Error. How to use: %s <filename>\n", argv[0]);
-        return EXIT_FAILURE;
-    }
-
-    char *program_txt = readFromFile(argv[1]);
-    tfobj *program = compile(program_txt);
-    tfcontext *context = createContext();
-    execute(program, context);
-
-    /* Clean up allocated resources */
-    decrementReferenceCount(program);
-    freeContext(context);
-    free(program_txt);
-    
-    return EXIT_SUCCESS;
+/*
+ * ToyForth Interpreter - Main Entry Point
+ *
+ * Implements the main execution flow:
+ *   1. Load source code from file
+ *   2. Compile to intermediate representation
+ *   3. Execute on the virtual machine
+ *   4. Clean up resources
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mem.h"
+#include "engine.h"
+#include "bytecode.h"
+#include "tforth.h"
+#include "file_utils.h"
+#include "parser.h"
+#include "list.h"
+#include "runner.h"
+#include "image.h"
+#include "jit.h"
+#include "output.h"
+#include "server.h"
+#include "stack.h"
+
+/*
+ * Engine - Execution engines selectable from the command line
+ *
+ * ENGINE_LIST:     execute() walks the compiled program list
+ * ENGINE_THREADED: executeBytecode() runs the list translated to bytecode
+ * ENGINE_JIT:      executeJit() runs the bytecode translated to native code
+ *                  (the bytecode itself where there is no JIT)
+ */
+typedef enum {
+    ENGINE_LIST,
+    ENGINE_THREADED,
+    ENGINE_JIT
+} Engine;
+
+/* Objects per batch for --stream when no size is given */
+#define DEFAULT_BATCH_SIZE 4096
+
+/* Bytes per chunk when a whole program is compiled on several threads */
+#define DEFAULT_PARSE_CHUNK (4 << 20)
+
+
+/*
+ * printUsage() - Prints the command line synopsis to stderr
+ */
+static void printUsage(const char *program_name) {
+    fprintf(stderr, "Error. How to use: %s [--engine=list|threaded|jit] [--pairs] [--stream[=N]] [--direct-output] <filename | ->\n", program_name);
+    fprintf(stderr, "       (any of these also takes [--stack=N] [--stack-limit=N] [--stack-shrink=N])\n");
+    fprintf(stderr, "       (and, without --stream, [--parse-jobs=N] [--parse-chunk=N])\n");
+    fprintf(stderr, "       %s --profile[=<json>] <filename | ->\n", program_name);
+    fprintf(stderr, "       %s --jobs[=N] <filename | ->...\n", program_name);
+    fprintf(stderr, "       %s --compile <filename | -> -o <image>\n", program_name);
+    fprintf(stderr, "       %s [--engine=list|threaded] [--direct-output] --serve[=<socket>]\n", program_name);
+}
+
+
+/*
+ * parseSlots() - Parses the slot count of a --stack option
+ *
+ * Returns 0 (after reporting it) if the text is not a positive number of
+ * slots that a stack could be mapped with.
+ */
+static int parseSlots(const char *option, const char *text, size_t *slots) {
+    char *end;
+    long long value = strtoll(text, &end, 10);
+
+    if (end == text || *end != '\0' || value < 1 || (unsigned long long)value > SIZE_MAX / (4 * sizeof(tfobj *))) {
+        fprintf(stderr, "Error. Invalid %s size '%s'.\n", option, text);
+        return 0;
+    }
+
+    *slots = (size_t)value;
+    return 1;
+}
+
+
+/*
+ * runOptimized() - Runs a folded and fused program on the chosen engine
+ */
+static void runOptimized(tfobj *program, tfcontext *context, Engine engine) {
+    if (engine == ENGINE_THREADED) {
+        tfbytecode *bytecode = compileBytecode(program);
+        executeBytecode(bytecode, context);
+        freeBytecode(bytecode);
+    } else if (engine == ENGINE_JIT) {
+        tfbytecode *bytecode = compileBytecode(program);
+        tfjit *jit = compileJit(bytecode);
+        if (jit != NULL) {
+            executeJit(jit, context);
+        } else {
+            executeBytecode(bytecode, context);
+        }
+        freeJit(jit);
+        freeBytecode(bytecode);
+    } else {
+        execute(program, context);
+    }
+}
+
+
+/*
+ * runProgram() - Optimizes a compiled program (or batch) and runs it
+ *
+ * A whole program lives until exit, so its literals are pinned and the
+ * stack only borrows them; a streamed batch is freed after it runs, so
+ * its literals stay refcounted (see pinLiterals()).
+ */
+static void runProgram(tfobj *program, tfcontext *context, Engine engine, int whole) {
+    foldConstants(program);
+    fuseSuperinstructions(program);
+    if (whole) pinLiterals(program);
+    runOptimized(program, context, engine);
+}
+
+
+/*
+ * runImage() - Runs a program image without compiling anything
+ *
+ * loadImage() recompiles the source (and rewrites the image) instead if
+ * the source changed since the image was made.
+ */
+static void runImage(const tfsource *image, const char *image_path, tfcontext *context, Engine engine) {
+    size_t depth;
+    tfobj *program = loadImage(image, image_path, &depth);
+    if (program == NULL) return;
+
+    pinLiterals(program);
+    listReserve(context->stack, depth);
+    runOptimized(program, context, engine);
+    decrementReferenceCount(program);
+}
+
+
+/*
+ * runProfiled() - Runs a program (or image) on the profiling list engine
+ *
+ * The program is optimized first, so the profile shows the words that
+ * normally run, fused ones included. Returns 0 if it fails to compile or
+ * the report cannot be written.
+ */
+static int runProfiled(const tfsource *source, const char *path, tfcontext *context, const char *json_path) {
+    tfobj *program;
+    size_t depth;
+
+    if (isImage(source)) {
+        program = loadImage(source, path, &depth);
+    } else {
+        tfparser parser;
+        parserInit(&parser, source->text);
+        program = compileBatch(&parser, SIZE_MAX);
+        foldConstants(program);
+        fuseSuperinstructions(program);
+        depth = (size_t)parser.analysis.highest;
+    }
+    if (program == NULL) return 0;
+
+    pinLiterals(program);
+    listReserve(context->stack, depth);
+    int ok = executeProfiling(program, context, json_path);
+    decrementReferenceCount(program);
+    return ok;
+}
+
+
+/*
+ * runBatches() - Compiles and runs a program in bounded batches
+ *
+ * Each batch is optimized, executed and freed before the next one is
+ * compiled; the stack carries over between batches. Without --stream the
+ * whole program is a single batch, compiled on parse_jobs threads once
+ * it is at least two chunks of parse_chunk bytes long. A syntax error or
+ * static underflow stops the run, after the batches before it have
+ * executed.
+ */
+static void runBatches(char *program_text, size_t batch_size, unsigned int parse_jobs, size_t parse_chunk,
+                       tfcontext *context, Engine engine) {
+    tfparser parser;
+    parserInit(&parser, program_text);
+
+    while (1) {
+        tfobj *batch = batch_size == SIZE_MAX
+            ? compileParallel(&parser, parse_jobs, parse_chunk)
+            : compileBatch(&parser, batch_size);
+        if (batch == NULL) break;
+
+        /* Size the stack once for the deepest point the compiler found */
+        listReserve(context->stack, (size_t)parser.analysis.highest);
+
+        size_t len = batch->list_obj.len;
+        if (len > 0) runProgram(batch, context, engine, batch_size == SIZE_MAX);
+        decrementReferenceCount(batch);
+
+        /* Output of finished batches comes before any error in the next one */
+        if (batch_size != SIZE_MAX) outputFlush(&context->output);
+
+        if (len == 0) break;
+    }
+}
+
+
+/*
+ * runFiles() - Compiles several programs and runs them in parallel
+ *
+ * Every file is compiled first, in order, so definitions made by one file
+ * are visible to the files after it. Nothing runs if any file fails to
+ * compile.
+ */
+static int runFiles(const char **filenames, size_t count, unsigned int workers) {
+    tfprogram **programs = wmalloc(sizeof(tfprogram *) * count);
+    tfjob *jobs = wmalloc(sizeof(tfjob) * count);
+    size_t compiled = 0;
+
+    while (compiled < count) {
+        tfsource *source = loadSource(filenames[compiled]);
+        programs[compiled] = tfprogramCompile(source->text, 0);
+        freeSource(source);
+        if (programs[compiled] == NULL) break;
+
+        jobs[compiled].program = programs[compiled];
+        jobs[compiled].params = NULL;
+        jobs[compiled].param_count = 0;
+        compiled++;
+    }
+
+    if (compiled == count) tfrunParallel(jobs, count, workers, NULL, NULL);
+
+    for (size_t i = 0; i < compiled; i++) {
+        tfprogramFree(programs[i]);
+    }
+    free(programs);
+    free(jobs);
+
+    return compiled == count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/*
+ * main() - Program entry point
+ *
+ * Orchestrates the three phases of the ToyForth interpreter:
+ *   1. File Loading: Maps (or reads) the source program from the file
+ *   2. Compilation:  Parses and tokenizes into executable objects
+ *   3. Execution:    Runs the compiled program on the VM
+ *
+ * Usage:
+ *   toyforth [--engine=list|threaded|jit] [--pairs] [--stream[=N]] [--direct-output]
+ *            [--parse-jobs=N] [--parse-chunk=N] <source-file | ->
+ *   toyforth --profile[=<json-file>] <source-file | ->
+ *   toyforth --jobs[=N] <source-file | ->...
+ *   toyforth --compile <source-file | -> -o <image>
+ *   toyforth [--engine=list|threaded] [--direct-output] --serve[=<socket-path>]
+ *   (any of these also takes [--stack=N] [--stack-limit=N] [--stack-shrink=N])
+ *
+ *   --engine=list      Interpret the compiled program list (default)
+ *   --engine=threaded  Translate to bytecode and run with threaded dispatch
+ *   --engine=jit       Translate the bytecode to native code and run that
+ *                      (x86-64 only; elsewhere the same as threaded, and
+ *                      --serve always runs requests as bytecode)
+ *   --pairs            Run unoptimized (no folding or fusion) on the list
+ *                      engine and report the most frequent adjacent word
+ *                      pairs to stderr
+ *   --profile          Run the optimized program on the list engine while
+ *                      timing every word, then print a report sorted by
+ *                      self time to stderr (or write it as JSON to the
+ *                      given file)
+ *   --stream[=N]       Compile and run N objects at a time (default 4096),
+ *                      so memory use does not grow with the program
+ *   --parse-jobs=N     Compile a long program on N threads (default: one
+ *                      per CPU); definitions are still compiled serially
+ *   --parse-chunk=N    Bytes of source per thread's work unit (default
+ *                      4 MiB); shorter programs compile on one thread
+ *   --direct-output    Write the program's output to file descriptor 1
+ *                      with writev() instead of through stdio
+ *   --jobs[=N]         Run every given file on N worker threads (default:
+ *                      one per CPU) with the threaded engine
+ *   --compile          Save the optimized program as an image instead of
+ *                      running it; running the image skips compilation
+ *   --serve            Keep running, and compile and run every line read
+ *                      from stdin as a request on one context; the
+ *                      dictionary and the stack carry over between them
+ *   --serve=<socket>   Serve the lines of the connections to a Unix
+ *                      domain socket instead, one connection at a time
+ *   --stack=N          Allocate N stack slots up front (the compiler's
+ *                      depth estimate is reserved on top of it when larger)
+ *   --stack-limit=N    Give each context a fixed stack of N slots ending
+ *                      in a guard page; going past it is an overflow error
+ *   --stack-shrink=N   When a context is reset, shrink a stack that grew
+ *                      past N slots back to its initial size
+ *   -                  Read the program from stdin
+ *
+ * Returns:
+ *   EXIT_SUCCESS (0) if successful
+ *   EXIT_FAILURE (1) if arguments invalid or execution error occurs
+ */
+int main(int argc, char **argv) {
+    const char **filenames = wmalloc(sizeof(const char *) * (size_t)argc);
+    size_t file_count = 0;
+    Engine engine = ENGINE_LIST;
+    int count_pairs = 0;
+    int profile = 0;
+    const char *profile_path = NULL;
+    int parallel = 0;
+    unsigned int workers = 0;
+    size_t batch_size = 0;
+    unsigned int parse_jobs = 0;
+    size_t parse_chunk = DEFAULT_PARSE_CHUNK;
+    int compile_only = 0;
+    const char *image_path = NULL;
+    int direct_output = 0;
+    tfstackpolicy stack_policy = {0, 0, 0};
+    int serve = 0;
+    const char *socket_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--engine=", 9) == 0) {
+            const char *name = argv[i] + 9;
+            if (strcmp(name, "list") == 0) {
+                engine = ENGINE_LIST;
+            } else if (strcmp(name, "threaded") == 0) {
+                engine = ENGINE_THREADED;
+            } else if (strcmp(name, "jit") == 0) {
+                engine = ENGINE_JIT;
+            } else {
+                fprintf(stderr, "Error. Unknown engine '%s'.\n", name);
+                free(filenames);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--pairs") == 0) {
+            count_pairs = 1;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = 1;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0 && argv[i][10] != '\0') {
+            profile = 1;
+            profile_path = argv[i] + 10;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            batch_size = DEFAULT_BATCH_SIZE;
+        } else if (strncmp(argv[i], "--stream=", 9) == 0) {
+            char *end;
+            long size = strtol(argv[i] + 9, &end, 10);
+            if (end == argv[i] + 9 || *end != '\0' || size < 1) {
+                fprintf(stderr, "Error. Invalid batch size '%s'.\n", argv[i] + 9);
+                free(filenames);
+                return EXIT_FAILURE;
+            }
+            batch_size = (size_t)size;
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            parallel = 1;
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            char *end;
+            long count = strtol(argv[i] + 7, &end, 10);
+            if (end == argv[i] + 7 || *end != '\0' || count < 1) {
+                fprintf(stderr, "Error. Invalid number of jobs '%s'.\n", argv[i] + 7);
+                free(filenames);
+                return EXIT_FAILURE;
+            }
+            parallel = 1;
+            workers = (unsigned int)count;
+        } else if (strncmp(argv[i], "--parse-jobs=", 13) == 0) {
+            char *end;
+            long count = strtol(argv[i] + 13, &end, 10);
+            if (end == argv[i] + 13 || *end != '\0' || count < 1) {
+                fprintf(stderr, "Error. Invalid number of parse jobs '%s'.\n", argv[i] + 13);
+                free(filenames);
+                return EXIT_FAILURE;
+            }
+            parse_jobs = (unsigned int)count;
+        } else if (strncmp(argv[i], "--parse-chunk=", 14) == 0) {
+            char *end;
+            long size = strtol(argv[i] + 14, &end, 10);
+            if (end == argv[i] + 14 || *end != '\0' || size < 1) {
+                fprintf(stderr, "Error. Invalid parse chunk size '%s'.\n", argv[i] + 14);
+                free(filenames);
+                return EXIT_FAILURE;
+            }
+            parse_chunk = (size_t)size;
+        } else if (strcmp(argv[i], "--direct-output") == 0) {
+            direct_output = 1;
+        } else if (strncmp(argv[i], "--stack=", 8) == 0) {
+            if (!parseSlots("stack", argv[i] + 8, &stack_policy.initial)) {
+                free(filenames);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--stack-limit=", 14) == 0) {
+            if (!parseSlots("stack limit", argv[i] + 14, &stack_policy.limit)) {
+                free(filenames);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--stack-shrink=", 15) == 0) {
+            if (!parseSlots("stack shrink", argv[i] + 15, &stack_policy.shrink_above)) {
+                free(filenames);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            serve = 1;
+        } else if (strncmp(argv[i], "--serve=", 8) == 0 && argv[i][8] != '\0') {
+            serve = 1;
+            socket_path = argv[i] + 8;
+        } else if (strcmp(argv[i], "--compile") == 0) {
+            compile_only = 1;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            image_path = argv[++i];
+        } else {
+            filenames[file_count++] = argv[i];
+        }
+    }
+
+    if (serve && (file_count > 0 || parallel || count_pairs || profile || batch_size > 0 || compile_only ||
+                  (socket_path != NULL && direct_output))) {
+        printUsage(argv[0]);
+        free(filenames);
+        return EXIT_FAILURE;
+    }
+
+    /* Before any context exists, so worker contexts follow it too */
+    setStackPolicy(&stack_policy);
+
+    if (serve) {
+        tfcontext *context = createContext();
+        int status = EXIT_SUCCESS;
+        if (direct_output) outputUseDescriptor(&context->output, STDOUT_FILENO);
+
+        if (socket_path != NULL) {
+            if (!serveSocket(socket_path, context, engine != ENGINE_LIST)) status = EXIT_FAILURE;
+        } else {
+            serveLines(stdin, STDOUT_FILENO, context, engine != ENGINE_LIST);
+        }
+
+        freeContext(context);
+        free(filenames);
+        return status;
+    }
+
+    if (file_count == 0 || (file_count > 1 && !parallel) || (parallel && (count_pairs || batch_size > 0 || direct_output)) ||
+        (profile && (parallel || count_pairs || batch_size > 0 || compile_only))) {
+        printUsage(argv[0]);
+        free(filenames);
+        return EXIT_FAILURE;
+    }
+
+    if (compile_only != (image_path != NULL) || (compile_only && (file_count > 1 || parallel))) {
+        printUsage(argv[0]);
+        free(filenames);
+        return EXIT_FAILURE;
+    }
+
+    if (parallel) {
+        int status = runFiles(filenames, file_count, workers);
+        free(filenames);
+        return status;
+    }
+
+    if (compile_only) {
+        size_t depth;
+        int written;
+        tfobj *program = buildImage(filenames[0], image_path, &depth, &written);
+        decrementReferenceCount(program);
+        free(filenames);
+        return written ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    tfsource *source = loadSource(filenames[0]);
+    tfcontext *context = createContext();
+    int status = EXIT_SUCCESS;
+    if (direct_output) outputUseDescriptor(&context->output, STDOUT_FILENO);
+
+    if (profile) {
+        if (!runProfiled(source, filenames[0], context, profile_path)) status = EXIT_FAILURE;
+    } else if (isImage(source)) {
+        runImage(source, filenames[0], context, engine);
+    } else if (count_pairs) {
+        /* Pairs are counted on the program as written, before fusion */
+        tfobj *program = compile(source->text);
+        executeCountingPairs(program, context);
+        decrementReferenceCount(program);
+    } else {
+        runBatches(source->text, batch_size > 0 ? batch_size : SIZE_MAX, parse_jobs, parse_chunk, context, engine);
+    }
+
+    /* Clean up allocated resources */
+    freeContext(context);
+    freeSource(source);
+    free(filenames);
+    
+    return status;
 }
\ No newline at end of file
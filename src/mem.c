@@ -1,228 +1,942 @@
-/*
- * Memory Management Implementation
- *
- * Implements reference-counted memory management for all ToyForth objects.
- * Uses a simple tracing garbage collector via reference counting: when
- * refcount reaches 0, the object is immediately freed.
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-#include "mem.h"
-#include "tforth.h"
-
-
-/*
- * wmalloc() implementation
- *
- * Wrapper around malloc() that enforces non-NULL returns through explicit
- * error handling on allocation failure.
- */
-void *wmalloc(size_t size) {
-    if (size == 0) size = 1;                                       
-    
-    void *newptr = malloc(size);
-    if (newptr == NULL) {
-        fprintf(stderr, "OOM. Couldn't allocate %zu bytes.\n", size);
-        exit(EXIT_FAILURE);
-    }
-
-    return newptr;
-}
-
-
-/*
- * wrealloc() implementation
- *
- * Wrapper around realloc() that enforces non-NULL returns through explicit
- * error handling on reallocation failure.
- */
-void *wrealloc(void *ptr, size_t size) {
-    if (size == 0) size = 1;             
-    
-    void *newptr = realloc(ptr, size);
-    if (newptr == NULL) {
-        fprintf(stderr, "OOM. Couldn't reallocate %zu bytes.\n", size);
-        exit(EXIT_FAILURE);
-    }
-    
-    return newptr;
-}
-
-
-/*
- * freeObject() implementation
- *
- * Deallocates a tfobj and all its internal heap-allocated data.
- * For container types (lists), this triggers recursive deallocation
- * of contained objects via reference counting.
- */
-void freeObject(tfobj *object) {
-    if (object == NULL) return;
-
-    if (object->type == TF_OBJ_SYMBOL || object->type == TF_OBJ_STR) {
-        free(object->str_obj.str);                                       /* Frees the deep-copied string buffer */
-    }
-
-    if (object->type == TF_OBJ_LIST) {
-        for (size_t i = 0; i < object->list_obj.len; i++) {
-            tfobj *element = object->list_obj.element[i];
-            decrementReferenceCount(element);                       /* Recursively decrease refcount for each item in the list */
-        }
-        free(object->list_obj.element);                                  /* Frees the array holding the pointers */
-    }
-
-    free(object);                                                        /* Finally, free the object struct itself */
-}
-
-
-/*
- * incrementReferenceCount() implementation
- *
- * Increases the reference count when a new reference is acquired.
- * NULL-safe (no-op if passed NULL).
- */
-void incrementReferenceCount(tfobj *object) {
-    if (object == NULL) return;
-    object->refcount++;
-}
-
-
-/*
- * decrementReferenceCount() implementation
- *
- * Decreases the reference count when a reference is released.
- * When count reaches 0, immediately deallocates the object.
- * NULL-safe (no-op if passed NULL).
- */
-void decrementReferenceCount(tfobj *object) {
-    if (object == NULL) return;
-
-    object->refcount--;
-    
-    /* Automatic deallocation when no references remain */
-    if (object->refcount == 0) {
-        freeObject(object);
-    }
-}
-
-
-/*
- * createObject() implementation
- *
- * Base constructor for all tfobj instances. Allocates the structure,
- * initializes type, and sets refcount=1 (creator owns one reference).
- */
-tfobj *createObject(TF_OBJ_TYPE type) {
-    tfobj *object = wmalloc(sizeof(tfobj));
-    object->type = type;
-    object->refcount = 1;  /* New objects start with one reference from the creator */
-    
-    return object;
-}
-
-
-/*
- * createStringObject() implementation
- *
- * Creates a string object with a deep copy of the input data.
- * Input does not need to be NUL-terminated.
- */
-tfobj *createStringObject(const char *str, size_t len) {
-    tfobj *object = createObject(TF_OBJ_STR);
-    
-    object->str_obj.str = wmalloc(sizeof(char) * len + 1);
-    object->str_obj.len = len;
-    
-    memcpy(object->str_obj.str, str, len);
-    object->str_obj.str[len] = '\0';  
-    
-    return object;
-}
-
-
-/*
- * createIntegerObject() implementation
- *
- * Creates an integer object containing a 32-bit signed value.
- */
-tfobj *createIntegerObject(int number) {
-    tfobj *object = createObject(TF_OBJ_INT);
-    object->number = number;
-    
-    return object;
-}
-
-
-/*
- * createBooleanObject() implementation
- *
- * Creates a boolean object (internally stored as int: 0=false, non-zero=true).
- */
-tfobj *createBooleanObject(int number) {
-    tfobj *object = createObject(TF_OBJ_BOOL);
-    object->number = number;
-    
-    return object;
-}
-
-
-/*
- * createSymbolObject() implementation
- *
- * Creates a symbol object (Forth word name) with deep-copied string data.
- * Symbols are implemented as strings but have distinct type for semantics.
- */
-tfobj *createSymbolObject(const char *str, size_t len) {
-    tfobj *object = createStringObject(str, len);
-    object->type = TF_OBJ_SYMBOL;
-    
-    return object;
-}
-
-
-/*
- * createListObject() implementation
- *
- * Creates an empty list with initial capacity for dynamic growth.
- * Used for the data stack and compiled program representation.
- */
-tfobj *createListObject() {
-    tfobj *object = createObject(TF_OBJ_LIST);
-    object->list_obj.capacity = INITIAL_STACK_CAPACITY;
-    object->list_obj.element = wmalloc(object->list_obj.capacity * sizeof(tfobj*));
-    object->list_obj.len = 0;
-
-    return object;
-}
-
-
-/*
- * createContext() implementation
- *
- * Allocates and initializes a ToyForth execution context with
- * an empty data stack.
- */
-tfcontext *createContext() {
-    tfcontext *context = wmalloc(sizeof(tfcontext));
-    context->stack = createListObject();
-    
-    return context;
-}
-
-
-/*
- * freeContext() implementation
- *
- * Deallocates a context and all objects remaining on its stack.
- * The stack deallocation is handled via reference counting.
- */
-void freeContext(tfcontext *context) {
-    if (context == NULL) return;
-    
-    decrementReferenceCount(context->stack);
-
-    free(context);
+/*
+ * Memory Management Implementation
+ *
+ * Implements reference-counted memory management for all ToyForth objects.
+ * Uses a simple tracing garbage collector via reference counting: when
+ * refcount reaches 0, the object is immediately freed.
+ *
+ * Objects and small string payloads come from a slab allocator: each
+ * context owns a pool of 64 KiB slabs carved into fixed-size chunks, and
+ * freed chunks go to type-segregated free lists instead of back to libc.
+ * Build with -DTF_USE_MALLOC (make POOL=0) to use plain malloc()/free(),
+ * which is what AddressSanitizer and Valgrind runs want.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+#include "tforth.h"
+#include "list.h"
+#include "output.h"
+#include "stack.h"
+
+
+/* Allocations made by this thread, see allocationCount() */
+static TF_THREAD_LOCAL size_t allocation_count;
+
+/* Objects created and freed by this thread, see objectCounts() */
+static TF_THREAD_LOCAL size_t objects_created;
+static TF_THREAD_LOCAL size_t objects_freed;
+
+
+/*
+ * wmalloc() implementation
+ *
+ * Wrapper around malloc() that enforces non-NULL returns through explicit
+ * error handling on allocation failure.
+ */
+void *wmalloc(size_t size) {
+    if (size == 0) size = 1;                                       
+    
+    void *newptr = malloc(size);
+    if (newptr == NULL) {
+        fprintf(stderr, "OOM. Couldn't allocate %zu bytes.\n", size);
+        exit(EXIT_FAILURE);
+    }
+    allocation_count++;
+
+    return newptr;
+}
+
+
+/*
+ * wrealloc() implementation
+ *
+ * Wrapper around realloc() that enforces non-NULL returns through explicit
+ * error handling on reallocation failure.
+ */
+void *wrealloc(void *ptr, size_t size) {
+    if (size == 0) size = 1;             
+    
+    void *newptr = realloc(ptr, size);
+    if (newptr == NULL) {
+        fprintf(stderr, "OOM. Couldn't reallocate %zu bytes.\n", size);
+        exit(EXIT_FAILURE);
+    }
+    allocation_count++;
+    
+    return newptr;
+}
+
+
+/*
+ * allocationCount() implementation
+ */
+size_t allocationCount(void) {
+    return allocation_count;
+}
+
+
+/*
+ * objectCounts() implementation
+ */
+void objectCounts(size_t *created, size_t *freed) {
+    *created = objects_created;
+    *freed = objects_freed;
+}
+
+
+#ifndef TF_USE_MALLOC
+
+/* Slabs are aligned to their size so a chunk can find its slab by masking */
+#define TF_SLAB_SIZE (64 * 1024)
+
+/* Lists keep their element array while on the free list, up to this size */
+#define TF_POOL_MAX_CACHED_CAPACITY (INITIAL_STACK_CAPACITY * 16)
+
+/* Number of TF_OBJ_TYPE values, one header free list per type */
+#define TF_OBJ_TYPE_COUNT (TF_OBJ_ARRAY + 1)
+
+/*
+ * Chunk size classes - Every slab serves chunks of a single class
+ *
+ * TF_CLASS_OBJECT holds tfobj headers; the string classes hold payloads
+ * (including the NUL terminator) of up to 16, 32 and 64 bytes. Larger
+ * strings are rare and go straight to wmalloc().
+ */
+enum {
+    TF_CLASS_OBJECT,
+    TF_CLASS_STR16,
+    TF_CLASS_STR32,
+    TF_CLASS_STR64,
+    TF_CLASS_COUNT
+};
+
+static const size_t class_sizes[TF_CLASS_COUNT] = { sizeof(tfobj), 16, 32, 64 };
+
+/* Free chunk: the link overlays the first bytes of the released memory */
+typedef struct tfchunk {
+    struct tfchunk *next;
+} tfchunk;
+
+/* Slab header, stored at the start of each aligned slab */
+typedef struct tfslab {
+    struct tfslab *next;            /* Next slab owned by the same pool */
+    struct tfpool *pool;            /* Owning pool, found from any chunk address */
+} tfslab;
+
+/*
+ * tfpool - Per-context slab allocator
+ *
+ * Chunks are always returned to the pool of the slab they were carved
+ * from, so objects may safely outlive the context that created them: a
+ * pool released while chunks are still live is only orphaned, and frees
+ * its slabs once the last chunk comes back.
+ */
+struct tfpool {
+    tfslab *slabs;                           /* Every slab owned by this pool */
+    char *bump[TF_CLASS_COUNT];              /* Next uncarved chunk per class */
+    char *bump_end[TF_CLASS_COUNT];          /* End of the slab being carved */
+    tfchunk *free_objects[TF_OBJ_TYPE_COUNT]; /* Released headers, per type */
+    tfchunk *free_strings[TF_CLASS_COUNT];   /* Released payloads, per class */
+    size_t live;                             /* Chunks currently handed out */
+    int orphaned;                            /* Owner gone; free on last chunk */
+};
+
+/* Pool for objects created outside any context (e.g. by compile()) */
+static struct tfpool global_pool;
+static TF_THREAD_LOCAL struct tfpool *active_pool = &global_pool;
+
+
+/*
+ * poolRelease() - Returns all slabs of a pool to libc
+ *
+ * Only valid once no chunk of the pool is in use anymore.
+ */
+static void poolRelease(struct tfpool *pool) {
+    /* Recycled list headers still own their element arrays */
+    for (tfchunk *chunk = pool->free_objects[TF_OBJ_LIST]; chunk != NULL; chunk = chunk->next) {
+        free(((tfobj *)chunk)->list_obj.element);
+    }
+
+    tfslab *slab = pool->slabs;
+    while (slab != NULL) {
+        tfslab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    if (pool != &global_pool) free(pool);
+}
+
+
+/*
+ * poolCarve() - Takes a fresh, zeroed chunk of the given class
+ *
+ * Grabs a new slab from libc when the current one is exhausted.
+ */
+static void *poolCarve(struct tfpool *pool, int size_class) {
+    size_t size = class_sizes[size_class];
+
+    if (pool->bump[size_class] == NULL || pool->bump[size_class] + size > pool->bump_end[size_class]) {
+        void *memory;
+        if (posix_memalign(&memory, TF_SLAB_SIZE, TF_SLAB_SIZE) != 0) {
+            fprintf(stderr, "OOM. Couldn't allocate %d bytes.\n", TF_SLAB_SIZE);
+            exit(EXIT_FAILURE);
+        }
+
+        tfslab *slab = memory;
+        slab->pool = pool;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+
+        /* Chunks start after the header, keeping 16-byte alignment */
+        size_t header = (sizeof(tfslab) + 15) & ~(size_t)15;
+        pool->bump[size_class] = (char *)memory + header;
+        pool->bump_end[size_class] = (char *)memory + TF_SLAB_SIZE;
+    }
+
+    void *chunk = pool->bump[size_class];
+    pool->bump[size_class] += size;
+    memset(chunk, 0, size);
+
+    return chunk;
+}
+
+
+/*
+ * chunkPool() - Finds the pool owning a chunk by masking its address
+ */
+static struct tfpool *chunkPool(void *chunk) {
+    tfslab *slab = (tfslab *)((uintptr_t)chunk & ~(uintptr_t)(TF_SLAB_SIZE - 1));
+    return slab->pool;
+}
+
+
+/*
+ * poolChunkReturned() - Accounts for a chunk coming back to its pool
+ *
+ * Frees the slabs of an orphaned pool once its last chunk is returned.
+ */
+static void poolChunkReturned(struct tfpool *pool) {
+    pool->live--;
+    if (pool->orphaned && pool->live == 0) {
+        poolRelease(pool);
+    }
+}
+
+
+/*
+ * allocateHeader() - Allocates a tfobj header from the active pool
+ *
+ * Reuses a released header of the same type when one is available, so a
+ * recycled list still carries its element array.
+ */
+static tfobj *allocateHeader(TF_OBJ_TYPE type) {
+    struct tfpool *pool = active_pool;
+    tfchunk *chunk = pool->free_objects[type];
+    pool->live++;
+    allocation_count++;
+
+    if (chunk != NULL) {
+        pool->free_objects[type] = chunk->next;
+        return (tfobj *)chunk;
+    }
+
+    return poolCarve(pool, TF_CLASS_OBJECT);
+}
+
+
+/*
+ * releaseHeader() - Puts a tfobj header on its pool's typed free list
+ */
+static void releaseHeader(tfobj *object) {
+    struct tfpool *pool = chunkPool(object);
+    TF_OBJ_TYPE type = object->type;
+    tfchunk *chunk = (tfchunk *)object;
+
+    chunk->next = pool->free_objects[type];
+    pool->free_objects[type] = chunk;
+    poolChunkReturned(pool);
+}
+
+
+/*
+ * stringClass() - Maps a payload size to its size class
+ *
+ * Returns TF_CLASS_COUNT for payloads too large for the slabs.
+ */
+static int stringClass(size_t size) {
+    for (int size_class = TF_CLASS_STR16; size_class < TF_CLASS_COUNT; size_class++) {
+        if (size <= class_sizes[size_class]) return size_class;
+    }
+    return TF_CLASS_COUNT;
+}
+
+
+/*
+ * allocateString() - Allocates a string payload of the given size
+ */
+static char *allocateString(size_t size) {
+    int size_class = stringClass(size);
+    if (size_class == TF_CLASS_COUNT) return wmalloc(size);
+
+    struct tfpool *pool = active_pool;
+    tfchunk *chunk = pool->free_strings[size_class];
+    pool->live++;
+    allocation_count++;
+
+    if (chunk != NULL) {
+        pool->free_strings[size_class] = chunk->next;
+        return (char *)chunk;
+    }
+
+    return poolCarve(pool, size_class);
+}
+
+
+/*
+ * releaseString() - Returns a string payload of the given size
+ */
+static void releaseString(char *str, size_t size) {
+    int size_class = stringClass(size);
+    if (size_class == TF_CLASS_COUNT) {
+        free(str);
+        return;
+    }
+
+    struct tfpool *pool = chunkPool(str);
+    tfchunk *chunk = (tfchunk *)str;
+
+    chunk->next = pool->free_strings[size_class];
+    pool->free_strings[size_class] = chunk;
+    poolChunkReturned(pool);
+}
+
+#else  /* TF_USE_MALLOC */
+
+static tfobj *allocateHeader(TF_OBJ_TYPE type) {
+    (void)type;
+    return wmalloc(sizeof(tfobj));
+}
+
+static void releaseHeader(tfobj *object) {
+    free(object);
+}
+
+static char *allocateString(size_t size) {
+    return wmalloc(size);
+}
+
+static void releaseString(char *str, size_t size) {
+    (void)size;
+    free(str);
+}
+
+#endif /* TF_USE_MALLOC */
+
+
+/*
+ * freeObject() implementation
+ *
+ * Deallocates a tfobj and all its internal heap-allocated data.
+ * For container types (lists), this triggers recursive deallocation
+ * of contained objects via reference counting.
+ */
+void freeObject(tfobj *object) {
+    if (object == NULL || isImmediate(object)) return;
+    objects_freed++;
+
+    if (object->type == TF_OBJ_STR && object->str_obj.owner != NULL) {
+        decrementReferenceCount(object->str_obj.owner);                 /* A slice only borrows its bytes */
+    } else if (object->type == TF_OBJ_SYMBOL || object->type == TF_OBJ_STR) {
+        releaseString(object->str_obj.str, object->str_obj.len + 1);    /* Frees the deep-copied string buffer */
+    }
+
+    if (object->type == TF_OBJ_ROPE) {
+        decrementReferenceCount(object->rope_obj.left);
+        decrementReferenceCount(object->rope_obj.right);
+    }
+
+    if (object->type == TF_OBJ_LIST) {
+        for (size_t i = 0; i < object->list_obj.len; i++) {
+            tfobj *element = object->list_obj.element[i];
+            decrementReferenceCount(element);                       /* Recursively decrease refcount for each item in the list */
+        }
+#ifndef TF_USE_MALLOC
+        /* Small arrays stay attached to the recycled header for reuse */
+        if (object->list_obj.capacity > TF_POOL_MAX_CACHED_CAPACITY) {
+            free(object->list_obj.element);
+            object->list_obj.element = NULL;
+        }
+#else
+        free(object->list_obj.element);                                  /* Frees the array holding the pointers */
+#endif
+    }
+
+    if (object->type == TF_OBJ_ARRAY) {
+        free(object->array_obj.element);
+    }
+
+    if (object->type == TF_OBJ_WORD) {
+        decrementReferenceCount(object->word_obj.symbol);                 /* Releases the word's name */
+        decrementReferenceCount(object->word_obj.operand);               /* And its inline literal, if any */
+    }
+
+    if (object->type == TF_OBJ_BRANCH) {
+        decrementReferenceCount(object->branch_obj.symbol);
+    }
+
+    releaseHeader(object);                                               /* Finally, release the object struct itself */
+}
+
+
+/*
+ * incrementReferenceCount() implementation
+ *
+ * Increases the reference count when a new reference is acquired.
+ * NULL-safe (no-op if passed NULL). Immediates have no count to update,
+ * and pinned objects are not counted.
+ */
+void incrementReferenceCount(tfobj *object) {
+    if (object == NULL || isImmediate(object) || object->refcount == TF_REFCOUNT_PINNED) return;
+    object->refcount++;
+}
+
+
+/*
+ * decrementReferenceCount() implementation
+ *
+ * Decreases the reference count when a reference is released.
+ * When count reaches 0, immediately deallocates the object.
+ * NULL-safe (no-op if passed NULL).
+ */
+void decrementReferenceCount(tfobj *object) {
+    if (object == NULL || isImmediate(object) || object->refcount == TF_REFCOUNT_PINNED) return;
+
+    object->refcount--;
+    
+    /* Automatic deallocation when no references remain */
+    if (object->refcount == 0) {
+        freeObject(object);
+    }
+}
+
+
+/*
+ * Pinned objects other than symbols, which stay reachable through the
+ * symbol table. Keeping them listed means an immortal object is never
+ * mistaken for a leak once the program that pinned it is gone.
+ */
+static tfobj **pinned_objects = NULL;
+static size_t pinned_count = 0;
+static size_t pinned_capacity = 0;
+
+
+/*
+ * pinObject() implementation
+ */
+void pinObject(tfobj *object) {
+    if (object == NULL || isImmediate(object) || object->refcount == TF_REFCOUNT_PINNED) return;
+    object->refcount = TF_REFCOUNT_PINNED;
+
+    if (object->type != TF_OBJ_SYMBOL) {
+        if (pinned_count == pinned_capacity) {
+            pinned_capacity = pinned_capacity > 0 ? pinned_capacity * 2 : INITIAL_STACK_CAPACITY;
+            pinned_objects = wrealloc(pinned_objects, sizeof(tfobj *) * pinned_capacity);
+        }
+        pinned_objects[pinned_count++] = object;
+    }
+}
+
+
+/*
+ * hashString() implementation
+ *
+ * 32-bit FNV-1a: cheap, and well distributed for short word names.
+ */
+unsigned int hashString(const char *str, size_t len) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+/*
+ * createObject() implementation
+ *
+ * Base constructor for all tfobj instances. Allocates the structure from
+ * the active pool, initializes type, and sets refcount=1 (creator owns
+ * one reference).
+ */
+tfobj *createObject(TF_OBJ_TYPE type) {
+    tfobj *object = allocateHeader(type);
+    objects_created++;
+    object->type = type;
+    object->refcount = 1;  /* New objects start with one reference from the creator */
+    
+    return object;
+}
+
+
+/*
+ * createStringObject() implementation
+ *
+ * Creates a string object with a deep copy of the input data.
+ * Input does not need to be NUL-terminated.
+ */
+tfobj *createStringObject(const char *str, size_t len) {
+    tfobj *object = createObject(TF_OBJ_STR);
+    
+    object->str_obj.str = allocateString(sizeof(char) * len + 1);
+    object->str_obj.len = len;
+    object->str_obj.owner = NULL;
+    
+    memcpy(object->str_obj.str, str, len);
+    object->str_obj.str[len] = '\0';  
+    
+    return object;
+}
+
+
+/*
+ * copyStringBytes() - Copies the bytes of a string or rope to dest
+ *
+ * Recursion is bounded by TF_ROPE_MAX_DEPTH.
+ */
+static void copyStringBytes(const tfobj *string, char *dest) {
+    if (string->type == TF_OBJ_ROPE) {
+        const tfobj *left = string->rope_obj.left;
+        copyStringBytes(left, dest);
+        copyStringBytes(string->rope_obj.right, dest + stringLength(left));
+    } else {
+        memcpy(dest, string->str_obj.str, string->str_obj.len);
+    }
+}
+
+
+/*
+ * flattenString() implementation
+ *
+ * A rope becomes a TF_OBJ_STR owning a copy of all its bytes and lets go
+ * of its parts; every holder of the rope sees the flat string from then on.
+ */
+const char *flattenString(tfobj *string) {
+    if (string->type != TF_OBJ_ROPE) return string->str_obj.str;
+
+    size_t len = string->rope_obj.len;
+    tfobj *left = string->rope_obj.left;
+    tfobj *right = string->rope_obj.right;
+    char *bytes = allocateString(len + 1);
+
+    copyStringBytes(string, bytes);
+    bytes[len] = '\0';
+
+    string->type = TF_OBJ_STR;
+    string->str_obj.str = bytes;
+    string->str_obj.len = len;
+    string->str_obj.owner = NULL;
+
+    decrementReferenceCount(left);
+    decrementReferenceCount(right);
+    return bytes;
+}
+
+
+/*
+ * createSliceObject() implementation
+ *
+ * A slice of a slice points straight into the original bytes, so slices
+ * never chain. Ropes are flattened first.
+ */
+tfobj *createSliceObject(tfobj *string, size_t offset, size_t len) {
+    const char *bytes = flattenString(string);
+
+    if (offset == 0 && len == string->str_obj.len) {
+        incrementReferenceCount(string);
+        return string;
+    }
+
+    tfobj *owner = string->str_obj.owner != NULL ? string->str_obj.owner : string;
+    tfobj *object = createObject(TF_OBJ_STR);
+    object->str_obj.str = (char *)bytes + offset;
+    object->str_obj.len = len;
+    object->str_obj.owner = owner;
+    incrementReferenceCount(owner);
+
+    return object;
+}
+
+
+/*
+ * createConcatObject() implementation
+ *
+ * Short results are copied right away: below TF_ROPE_MIN_LEN a rope node
+ * would cost more than the bytes it saves. A part that would take the rope
+ * past TF_ROPE_MAX_DEPTH is flattened, which keeps every walk over a rope
+ * (copying, freeing) shallow.
+ */
+tfobj *createConcatObject(tfobj *a, tfobj *b) {
+    size_t len_a = stringLength(a);
+    size_t len_b = stringLength(b);
+
+    if (len_b == 0 || len_a == 0) {
+        tfobj *result = len_b == 0 ? a : b;
+        incrementReferenceCount(result);
+        return result;
+    }
+
+    if (len_a + len_b < TF_ROPE_MIN_LEN || len_a + len_b > UINT32_MAX) {
+        tfobj *object = createObject(TF_OBJ_STR);
+        object->str_obj.str = allocateString(len_a + len_b + 1);
+        object->str_obj.len = len_a + len_b;
+        object->str_obj.owner = NULL;
+        copyStringBytes(a, object->str_obj.str);
+        copyStringBytes(b, object->str_obj.str + len_a);
+        object->str_obj.str[len_a + len_b] = '\0';
+        return object;
+    }
+
+    uint32_t depth_a = a->type == TF_OBJ_ROPE ? a->rope_obj.depth : 0;
+    uint32_t depth_b = b->type == TF_OBJ_ROPE ? b->rope_obj.depth : 0;
+    if (depth_a >= TF_ROPE_MAX_DEPTH) {
+        flattenString(a);
+        depth_a = 0;
+    }
+    if (depth_b >= TF_ROPE_MAX_DEPTH) {
+        flattenString(b);
+        depth_b = 0;
+    }
+
+    tfobj *object = createObject(TF_OBJ_ROPE);
+    object->rope_obj.left = a;
+    object->rope_obj.right = b;
+    object->rope_obj.len = (uint32_t)(len_a + len_b);
+    object->rope_obj.depth = (depth_a > depth_b ? depth_a : depth_b) + 1;
+    incrementReferenceCount(a);
+    incrementReferenceCount(b);
+
+    return object;
+}
+
+
+/*
+ * createIntegerObject() implementation
+ *
+ * Encodes the integer as a tagged immediate whenever it fits. Falls back
+ * to a boxed heap object for the rest of the 64-bit range.
+ */
+tfobj *createIntegerObject(int64_t number) {
+    if (number >= TF_IMMEDIATE_MIN && number <= TF_IMMEDIATE_MAX) {
+        return createIntegerImmediate((intptr_t)number);
+    }
+
+    tfobj *object = createObject(TF_OBJ_INT);
+    object->number = number;
+    
+    return object;
+}
+
+
+/*
+ * createBooleanObject() implementation
+ *
+ * Encodes the boolean as a tagged immediate (0=false, 1=true).
+ */
+tfobj *createBooleanObject(int number) {
+    return (tfobj *)(((uintptr_t)(number != 0) << TF_TAG_SHIFT) | TF_TAG_BOOL);
+}
+
+
+/*
+ * createSymbolObject() implementation
+ *
+ * Creates a symbol object (Forth word name) with deep-copied string data.
+ * Symbols are implemented as strings but have distinct type for semantics,
+ * and carry their precomputed dictionary hash.
+ */
+tfobj *createSymbolObject(const char *str, size_t len) {
+    tfobj *object = createStringObject(str, len);
+    object->type = TF_OBJ_SYMBOL;
+    object->str_obj.hash = hashString(str, len);
+    
+    return object;
+}
+
+
+/*
+ * Symbol intern table state
+ *
+ * A power-of-two array of pinned symbols; a slot is empty when NULL.
+ * Grown at 70% load.
+ */
+#define SYMBOL_TABLE_INITIAL_CAPACITY 64
+
+static tfobj **symbol_table = NULL;
+static size_t symbol_table_capacity = 0;
+static size_t symbol_table_count = 0;
+
+
+/*
+ * findSymbolSlot() - Returns the slot holding a name, or the empty slot ending its probe
+ */
+static tfobj **findSymbolSlot(const char *str, size_t len, unsigned int hash) {
+    size_t mask = symbol_table_capacity - 1;
+    size_t i = hash & mask;
+
+    while (symbol_table[i] != NULL) {
+        tfobj *symbol = symbol_table[i];
+        if (symbol->str_obj.hash == hash && symbol->str_obj.len == len &&
+            memcmp(symbol->str_obj.str, str, len) == 0) {
+            return &symbol_table[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    return &symbol_table[i];
+}
+
+
+/*
+ * growSymbolTable() - Doubles the intern table and reinserts every symbol
+ */
+static void growSymbolTable(void) {
+    tfobj **old_table = symbol_table;
+    size_t old_capacity = symbol_table_capacity;
+
+    symbol_table_capacity = old_capacity ? old_capacity * 2 : SYMBOL_TABLE_INITIAL_CAPACITY;
+    symbol_table = wmalloc(sizeof(tfobj *) * symbol_table_capacity);
+    memset(symbol_table, 0, sizeof(tfobj *) * symbol_table_capacity);
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        tfobj *symbol = old_table[i];
+        if (symbol != NULL) {
+            *findSymbolSlot(symbol->str_obj.str, symbol->str_obj.len, symbol->str_obj.hash) = symbol;
+        }
+    }
+
+    free(old_table);
+}
+
+
+/*
+ * internSymbol() implementation
+ *
+ * New symbols are created in the global pool: the table outlives every
+ * context, and a context pool holding one would never be released.
+ */
+tfobj *internSymbol(const char *str, size_t len) {
+    if ((symbol_table_count + 1) * 10 > symbol_table_capacity * 7) growSymbolTable();
+
+    unsigned int hash = hashString(str, len);
+    tfobj **slot = findSymbolSlot(str, len, hash);
+
+    if (*slot == NULL) {
+#ifndef TF_USE_MALLOC
+        struct tfpool *pool = active_pool;
+        active_pool = &global_pool;
+#endif
+        *slot = createSymbolObject(str, len);
+        pinObject(*slot);
+#ifndef TF_USE_MALLOC
+        active_pool = pool;
+#endif
+        symbol_table_count++;
+    }
+
+    incrementReferenceCount(*slot);
+    return *slot;
+}
+
+
+/*
+ * findSymbol() implementation
+ *
+ * Only reads the table; a miss is reported instead of filled.
+ */
+tfobj *findSymbol(const char *str, size_t len) {
+    if (symbol_table == NULL) return NULL;
+
+    tfobj *symbol = *findSymbolSlot(str, len, hashString(str, len));
+    incrementReferenceCount(symbol);
+    return symbol;
+}
+
+
+/*
+ * createWordObject() implementation
+ *
+ * Creates a compiled word holding its resolved primitive. The word keeps
+ * a reference to its symbol so the name stays available for diagnostics.
+ */
+tfobj *createWordObject(Operation op, tfobj *symbol) {
+    tfobj *object = createObject(TF_OBJ_WORD);
+    object->word_obj.op = op;
+    object->word_obj.symbol = symbol;
+    object->word_obj.operand = NULL;
+    incrementReferenceCount(symbol);
+
+    return object;
+}
+
+
+/*
+ * createOperandWordObject() implementation
+ *
+ * Creates a fused word holding its operand primitive and inline literal.
+ */
+tfobj *createOperandWordObject(OperandOperation op, tfobj *symbol, tfobj *operand) {
+    tfobj *object = createObject(TF_OBJ_WORD);
+    object->word_obj.operand_op = op;
+    object->word_obj.symbol = symbol;
+    object->word_obj.operand = operand;
+    incrementReferenceCount(symbol);
+    incrementReferenceCount(operand);
+
+    return object;
+}
+
+
+/*
+ * createBranchObject() implementation
+ *
+ * The target is filled in by the compiler once it is known.
+ */
+tfobj *createBranchObject(TF_BRANCH_KIND kind, tfobj *symbol) {
+    tfobj *object = createObject(TF_OBJ_BRANCH);
+    object->branch_obj.kind = kind;
+    object->branch_obj.target = 0;
+    object->branch_obj.symbol = symbol;
+    incrementReferenceCount(symbol);
+
+    return object;
+}
+
+
+/*
+ * createArrayObject() implementation
+ *
+ * The elements live in their own malloc()ed block, sized exactly, so the
+ * kernels see one contiguous int64_t array. At least one element is
+ * allocated so an empty array still has a valid pointer.
+ */
+tfobj *createArrayObject(size_t len) {
+    tfobj *object = createObject(TF_OBJ_ARRAY);
+    object->array_obj.element = wmalloc(sizeof(int64_t) * (len > 0 ? len : 1));
+    object->array_obj.len = len;
+
+    return object;
+}
+
+
+/*
+ * createListObject() implementation
+ *
+ * Creates an empty list with initial capacity for dynamic growth.
+ * Used for the data stack and compiled program representation.
+ * Recycled list headers keep their previous (larger) capacity.
+ */
+tfobj *createListObject() {
+    tfobj *object = createObject(TF_OBJ_LIST);
+#ifndef TF_USE_MALLOC
+    /* Fresh chunks are zeroed; a recycled list header still owns its array */
+    if (object->list_obj.element == NULL)
+#endif
+    {
+        object->list_obj.capacity = INITIAL_STACK_CAPACITY;
+        object->list_obj.element = wmalloc(object->list_obj.capacity * sizeof(tfobj*));
+    }
+    object->list_obj.len = 0;
+
+    return object;
+}
+
+
+/*
+ * createContext() implementation
+ *
+ * Allocates and initializes a ToyForth execution context with
+ * an empty data stack, sized by the stack policy (see stackInit()), and
+ * its own allocator pool, which becomes the active pool for every object
+ * created while the context runs.
+ */
+tfcontext *createContext() {
+    tfcontext *context = wmalloc(sizeof(tfcontext));
+#ifndef TF_USE_MALLOC
+    context->pool = wmalloc(sizeof(struct tfpool));
+    memset(context->pool, 0, sizeof(struct tfpool));
+    active_pool = context->pool;
+#else
+    context->pool = NULL;
+#endif
+    context->stack = createListObject();
+    context->loops = createListObject();
+    outputInit(&context->output);
+    context->recovery = NULL;
+    stackInit(context);
+    
+    return context;
+}
+
+
+/*
+ * freeContext() implementation
+ *
+ * Deallocates a context and all objects remaining on its stack.
+ * The stack deallocation is handled via reference counting, after which
+ * the context's pool is released (or orphaned if objects still live).
+ */
+void freeContext(tfcontext *context) {
+    if (context == NULL) return;
+    
+    outputRelease(&context->output);
+    stackRelease(context);
+    decrementReferenceCount(context->stack);
+    decrementReferenceCount(context->loops);
+
+#ifndef TF_USE_MALLOC
+    struct tfpool *pool = context->pool;
+    if (active_pool == pool) active_pool = &global_pool;
+
+    /* Objects that escaped the context keep the slabs alive until freed */
+    if (pool->live == 0) {
+        poolRelease(pool);
+    } else {
+        pool->orphaned = 1;
+    }
+#endif
+
+    free(context);
+}
+
+
+/*
+ * resetContext() implementation
+ */
+void resetContext(tfcontext *context) {
+    outputFlush(&context->output);
+    listClear(context->stack);
+    listClear(context->loops);
+    stackIdle(context);
+    activateContext(context);
+}
+
+
+/*
+ * activateContext() implementation
+ */
+void activateContext(tfcontext *context) {
+#ifndef TF_USE_MALLOC
+    active_pool = context != NULL ? context->pool : &global_pool;
+#endif
+    stackActivate(context);
 }
\ No newline at end of file
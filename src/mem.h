@@ -1,193 +1,533 @@
-/*
- * Memory Management Module
- *
- * Provides automatic memory management through reference counting. All tfobj
- * instances use reference counting: when refcount reaches 0, the object is
- * automatically deallocated.
- *
- * OWNERSHIP RULES:
- *   - Creating a function returns an object with refcount=1 (creator owns it)
- *   - Passing an object to a function does NOT transfer ownership
- *   - The caller remains responsible for decrementing when done
- *   - Exceptions: operations that modify reference counts (stackPush, etc.)
- */
-
-#ifndef MEM_H
-#define MEM_H
-
-#include <stddef.h>
-#include "tforth.h"
-
-
-/*
- * wmalloc() - Safe malloc wrapper with automatic OOM error handling
- *
- * Allocates memory with guaranteed non-NULL return or program exit.
- * Treats zero-size requests as one byte to simplify logic.
- *
- * Args:
- *   size - Number of bytes to allocate (0 is promoted to 1)
- *
- * Returns:
- *   Non-NULL pointer to allocated memory (never NULL)
- */
-void *wmalloc(size_t size);
-
-/*
- * wrealloc() - Safe realloc wrapper with automatic OOM error handling
- *
- * Resizes previously allocated memory with guaranteed non-NULL return
- * or program exit. Treats zero-size requests as one byte.
- *
- * Args:
- *   ptr  - Previous allocation (may be NULL)
- *   size - New size in bytes (0 is promoted to 1)
- *
- * Returns:
- *   Non-NULL pointer to resized memory (never NULL)
- */
-void *wrealloc(void *ptr, size_t size);
-
-
-/*
- * createObject() - Base constructor for all ToyForth objects
- *
- * Allocates a new tfobj instance, initializes type and sets refcount to 1.
- * The caller takes ownership of this reference.
- *
- * Args:
- *   type - The object type (determines active union member)
- *
- * Returns:
- *   Newly allocated tfobj with refcount=1
- */
-tfobj *createObject(TF_OBJ_TYPE type);
-
-/*
- * createStringObject() - Constructs a string object
- *
- * Creates a TF_OBJ_STR instance with a deep copy of the input string.
- * The input string may be freed immediately after this call.
- *
- * Args:
- *   str - Source string (does not need to be NUL-terminated)
- *   len - Length of source string in bytes
- *
- * Returns:
- *   New TF_OBJ_STR object with refcount=1 and deep-copied string data
- */
-tfobj *createStringObject(const char *str, size_t len);
-
-/*
- * createIntegerObject() - Constructs an integer object
- *
- * Creates a TF_OBJ_INT instance containing a 32-bit signed integer.
- *
- * Args:
- *   number - The integer value to store
- *
- * Returns:
- *   New TF_OBJ_INT object with refcount=1
- */
-tfobj *createIntegerObject(int number);
-
-/*
- * createBooleanObject() - Constructs a boolean object
- *
- * Creates a TF_OBJ_BOOL instance (internally stored as int: 0=false, 1=true).
- *
- * Args:
- *   number - The boolean value (0 or non-zero)
- *
- * Returns:
- *   New TF_OBJ_BOOL object with refcount=1
- */
-tfobj *createBooleanObject(int number);
-
-/*
- * createSymbolObject() - Constructs a symbol/word name object
- *
- * Creates a TF_OBJ_SYMBOL instance with a deep copy of the input string.
- * Symbols are Forth word names that are resolved at execution time.
- *
- * Args:
- *   str - Source symbol string (does not need to be NUL-terminated)
- *   len - Length of source string in bytes
- *
- * Returns:
- *   New TF_OBJ_SYMBOL object with refcount=1 and deep-copied string data
- */
-tfobj *createSymbolObject(const char *str, size_t len);
-
-/*
- * createListObject() - Constructs an empty list/array object
- *
- * Allocates a new TF_OBJ_LIST with initial capacity. Used for the main
- * data stack and compiled program representation.
- *
- * Returns:
- *   New empty TF_OBJ_LIST object with refcount=1 and capacity=INITIAL_STACK_CAPACITY
- */
-tfobj *createListObject();
-
-
-/*
- * createContext() - Allocates and initializes a ToyForth execution context
- *
- * Creates a new tfcontext with an empty data stack ready for execution.
- * Should be freed with freeContext() when no longer needed.
- *
- * Returns:
- *   New tfcontext with initialized stack and refcount=1
- */
-tfcontext *createContext();
-
-/*
- * freeContext() - Deallocates an execution context and its resources
- *
- * Releases all resources associated with the context, including any objects
- * remaining on the stack. The stack is freed through reference counting.
- *
- * Args:
- *   context - Context to deallocate (may be NULL; no-op if so)
- */
-void freeContext(tfcontext *context);
-
-
-/*
- * incrementReferenceCount() - Increases an object's reference count
- *
- * Called when a new reference to an object is created (e.g., adding to a
- * container). A safe no-op if passed a NULL pointer.
- *
- * Args:
- *   object - Object whose reference count should be incremented (may be NULL)
- */
-void incrementReferenceCount(tfobj *object);
-
-/*
- * decrementReferenceCount() - Decreases an object's reference count
- *
- * Called when relinquishing ownership of a reference. When count reaches 0,
- * the object is automatically freed via freeObject(). Safe no-op if passed
- * a NULL pointer.
- *
- * Args:
- *   object - Object whose reference count should be decremented (may be NULL)
- */
-void decrementReferenceCount(tfobj *object);
-
-/*
- * freeObject() - Immediately deallocates an object and its resources
- *
- * Called automatically when reference count reaches 0. Does not check
- * reference counts; use only after confirming the object has no active
- * references. Handles recursive deallocation for container types.
- *
- * Args:
- *   object - Object to deallocate and destroy (may be NULL)
- */
-void freeObject(tfobj *object);
-
-
+/*
+ * Memory Management Module
+ *
+ * Provides automatic memory management through reference counting. All tfobj
+ * instances use reference counting: when refcount reaches 0, the object is
+ * automatically deallocated.
+ *
+ * OWNERSHIP RULES:
+ *   - Creating a function returns an object with refcount=1 (creator owns it)
+ *   - Passing an object to a function does NOT transfer ownership
+ *   - The caller remains responsible for decrementing when done
+ *   - Exceptions: operations that modify reference counts (stackPush, etc.)
+ */
+
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+#include "tforth.h"
+
+
+/*
+ * isImmediate() - Tells whether a value is encoded inside the pointer
+ *
+ * Immediate values (integers and booleans) have no heap storage: they must
+ * never be dereferenced and reference counting ignores them.
+ *
+ * Args:
+ *   object - Value to inspect (may be NULL)
+ *
+ * Returns:
+ *   Non-zero for tagged immediates, 0 for heap objects and NULL
+ */
+static inline int isImmediate(const tfobj *object) {
+    return ((uintptr_t)object & TF_TAG_MASK) != 0;
+}
+
+/*
+ * getObjectType() - Returns the type of a heap object or immediate
+ *
+ * Args:
+ *   object - Value to inspect (must not be NULL)
+ *
+ * Returns:
+ *   The TF_OBJ_TYPE of the value
+ */
+static inline TF_OBJ_TYPE getObjectType(const tfobj *object) {
+    uintptr_t tag = (uintptr_t)object & TF_TAG_MASK;
+
+    if (tag == TF_TAG_INT) return TF_OBJ_INT;
+    if (tag == TF_TAG_BOOL) return TF_OBJ_BOOL;
+    return object->type;
+}
+
+/*
+ * getObjectNumber() - Returns the value of an integer or boolean
+ *
+ * Works for both immediates and heap-boxed integers.
+ *
+ * Args:
+ *   object - TF_OBJ_INT or TF_OBJ_BOOL value
+ *
+ * Returns:
+ *   The stored number (0/1 for booleans)
+ */
+static inline int64_t getObjectNumber(const tfobj *object) {
+    if (isImmediate(object)) {
+        return (int64_t)((intptr_t)object >> TF_TAG_SHIFT);
+    }
+    return object->number;
+}
+
+/*
+ * createIntegerImmediate() - Encodes an integer as a tagged immediate
+ *
+ * Inline fast path for engines. Only valid for numbers within
+ * [TF_IMMEDIATE_MIN, TF_IMMEDIATE_MAX]; use createIntegerObject() otherwise.
+ *
+ * Args:
+ *   number - The integer value to encode
+ *
+ * Returns:
+ *   TF_OBJ_INT immediate value
+ */
+static inline tfobj *createIntegerImmediate(intptr_t number) {
+    return (tfobj *)(((uintptr_t)number << TF_TAG_SHIFT) | TF_TAG_INT);
+}
+
+
+/*
+ * isStringObject() - Tells whether a value is a string, flat or not
+ *
+ * Args:
+ *   object - Value to inspect (must not be NULL)
+ *
+ * Returns:
+ *   Non-zero for TF_OBJ_STR and TF_OBJ_ROPE, 0 otherwise
+ */
+static inline int isStringObject(const tfobj *object) {
+    TF_OBJ_TYPE type = getObjectType(object);
+    return type == TF_OBJ_STR || type == TF_OBJ_ROPE;
+}
+
+/*
+ * stringLength() - Returns the length of a string or rope in bytes
+ *
+ * Args:
+ *   string - TF_OBJ_STR or TF_OBJ_ROPE value
+ *
+ * Returns:
+ *   Number of bytes, without flattening anything
+ */
+static inline size_t stringLength(const tfobj *string) {
+    return string->type == TF_OBJ_ROPE ? string->rope_obj.len : string->str_obj.len;
+}
+
+
+/*
+ * wmalloc() - Safe malloc wrapper with automatic OOM error handling
+ *
+ * Allocates memory with guaranteed non-NULL return or program exit.
+ * Treats zero-size requests as one byte to simplify logic.
+ *
+ * Args:
+ *   size - Number of bytes to allocate (0 is promoted to 1)
+ *
+ * Returns:
+ *   Non-NULL pointer to allocated memory (never NULL)
+ */
+void *wmalloc(size_t size);
+
+/*
+ * wrealloc() - Safe realloc wrapper with automatic OOM error handling
+ *
+ * Resizes previously allocated memory with guaranteed non-NULL return
+ * or program exit. Treats zero-size requests as one byte.
+ *
+ * Args:
+ *   ptr  - Previous allocation (may be NULL)
+ *   size - New size in bytes (0 is promoted to 1)
+ *
+ * Returns:
+ *   Non-NULL pointer to resized memory (never NULL)
+ */
+void *wrealloc(void *ptr, size_t size);
+
+/*
+ * allocationCount() - Returns how many allocations this thread has made
+ *
+ * Counts every object header and string payload, whether it came from a
+ * slab pool or from malloc(), plus every wmalloc()/wrealloc() call. The
+ * difference between two readings is the allocation cost of the code run
+ * in between; tagged immediates never count.
+ *
+ * Returns:
+ *   Allocations made by the calling thread since it started
+ */
+size_t allocationCount(void);
+
+/*
+ * objectCounts() - Returns how many objects this thread created and freed
+ *
+ * Counts heap objects passing through createObject() and freeObject();
+ * tagged immediates are never counted. The profiler reports the
+ * differences over a run.
+ *
+ * Args:
+ *   created - Receives the number of objects created so far
+ *   freed   - Receives the number of objects freed so far
+ */
+void objectCounts(size_t *created, size_t *freed);
+
+
+/*
+ * hashString() - Computes the 32-bit FNV-1a hash of a byte string
+ *
+ * Used for symbol hashes and dictionary lookups.
+ *
+ * Args:
+ *   str - Bytes to hash (does not need to be NUL-terminated)
+ *   len - Number of bytes
+ *
+ * Returns:
+ *   Hash value
+ */
+unsigned int hashString(const char *str, size_t len);
+
+
+/*
+ * createObject() - Base constructor for all ToyForth objects
+ *
+ * Allocates a new tfobj instance from the active slab pool (or malloc() in
+ * TF_USE_MALLOC builds), initializes type and sets refcount to 1.
+ * The caller takes ownership of this reference.
+ *
+ * Args:
+ *   type - The object type (determines active union member)
+ *
+ * Returns:
+ *   Newly allocated tfobj with refcount=1
+ */
+tfobj *createObject(TF_OBJ_TYPE type);
+
+/*
+ * createStringObject() - Constructs a string object
+ *
+ * Creates a TF_OBJ_STR instance with a deep copy of the input string.
+ * The input string may be freed immediately after this call.
+ *
+ * Args:
+ *   str - Source string (does not need to be NUL-terminated)
+ *   len - Length of source string in bytes
+ *
+ * Returns:
+ *   New TF_OBJ_STR object with refcount=1 and deep-copied string data
+ */
+tfobj *createStringObject(const char *str, size_t len);
+
+/* Concatenations shorter than this are copied instead of making a rope */
+#define TF_ROPE_MIN_LEN 64
+
+/* Deepest a rope may get before a part of it is flattened */
+#define TF_ROPE_MAX_DEPTH 32
+
+/*
+ * createSliceObject() - Constructs a substring without copying its bytes
+ *
+ * The slice points into the bytes of the string it is cut from and keeps
+ * that string alive through a reference, so the slice may outlive every
+ * other reference to it. Slice bytes are not NUL-terminated.
+ *
+ * Args:
+ *   string - TF_OBJ_STR or TF_OBJ_ROPE (a rope is flattened first)
+ *   offset - First byte of the slice (offset + len <= length of string)
+ *   len    - Length of the slice
+ *
+ * Returns:
+ *   TF_OBJ_STR with refcount=1, or string itself (with a new reference)
+ *   when the slice covers all of it
+ */
+tfobj *createSliceObject(tfobj *string, size_t offset, size_t len);
+
+/*
+ * createConcatObject() - Concatenates two strings lazily
+ *
+ * Makes a TF_OBJ_ROPE referencing both parts, so no bytes are copied
+ * until flattenString() needs them contiguous. Results shorter than
+ * TF_ROPE_MIN_LEN are copied into a flat string right away.
+ *
+ * Args:
+ *   a - First part (TF_OBJ_STR or TF_OBJ_ROPE)
+ *   b - Second part (TF_OBJ_STR or TF_OBJ_ROPE)
+ *
+ * Returns:
+ *   The concatenation with a new reference (a or b itself if the other
+ *   one is empty)
+ */
+tfobj *createConcatObject(tfobj *a, tfobj *b);
+
+/*
+ * flattenString() - Returns the bytes of a string as one contiguous run
+ *
+ * A TF_OBJ_ROPE is turned into a TF_OBJ_STR in place, copying its bytes
+ * once; later calls are free. The bytes of a slice are returned as they
+ * are, without a NUL terminator.
+ *
+ * Args:
+ *   string - TF_OBJ_STR or TF_OBJ_ROPE
+ *
+ * Returns:
+ *   Pointer to stringLength(string) bytes, valid while string is
+ */
+const char *flattenString(tfobj *string);
+
+/*
+ * createIntegerObject() - Constructs an integer object
+ *
+ * Creates a TF_OBJ_INT value containing a 64-bit signed integer. Values in
+ * the immediate range are tagged into the pointer and allocate nothing;
+ * only integers wider than the host pointer allows (beyond 62 bits on a
+ * 64-bit host) are boxed on the heap.
+ *
+ * Args:
+ *   number - The integer value to store
+ *
+ * Returns:
+ *   TF_OBJ_INT immediate, or a new heap object with refcount=1
+ */
+tfobj *createIntegerObject(int64_t number);
+
+/*
+ * createBooleanObject() - Constructs a boolean object
+ *
+ * Creates a TF_OBJ_BOOL immediate (stored as 0=false, 1=true). Booleans
+ * never allocate.
+ *
+ * Args:
+ *   number - The boolean value (0 or non-zero)
+ *
+ * Returns:
+ *   TF_OBJ_BOOL immediate value
+ */
+tfobj *createBooleanObject(int number);
+
+/*
+ * createSymbolObject() - Constructs a symbol/word name object
+ *
+ * Creates a TF_OBJ_SYMBOL instance with a deep copy of the input string.
+ * Symbols are Forth word names resolved through the dictionary; their hash
+ * is computed once here so lookups never rehash the name.
+ *
+ * Args:
+ *   str - Source symbol string (does not need to be NUL-terminated)
+ *   len - Length of source string in bytes
+ *
+ * Returns:
+ *   New TF_OBJ_SYMBOL object with refcount=1 and deep-copied string data
+ */
+tfobj *createSymbolObject(const char *str, size_t len);
+
+/*
+ * internSymbol() - Returns the unique symbol object for a name
+ *
+ * Looks the name up in the global intern table and creates the symbol
+ * (with a deep copy of the name) the first time it is seen, so every
+ * occurrence of a word shares one object and symbols can be compared by
+ * pointer. Interned symbols are pinned (see pinObject()) and live for the
+ * whole process; they are allocated outside any context pool.
+ *
+ * Args:
+ *   str - Symbol characters (does not need to be NUL-terminated)
+ *   len - Length of the symbol in bytes
+ *
+ * Returns:
+ *   The interned TF_OBJ_SYMBOL, with a new reference owned by the caller
+ */
+tfobj *internSymbol(const char *str, size_t len);
+
+/*
+ * findSymbol() - Returns the symbol for a name if it was interned before
+ *
+ * Never adds to the intern table, so threads may call it concurrently
+ * as long as no thread interns a new symbol meanwhile.
+ *
+ * Args:
+ *   str - Symbol characters (does not need to be NUL-terminated)
+ *   len - Length of the symbol in bytes
+ *
+ * Returns:
+ *   The interned TF_OBJ_SYMBOL (with a new reference owned by the
+ *   caller), or NULL if the name was never interned
+ */
+tfobj *findSymbol(const char *str, size_t len);
+
+/*
+ * createWordObject() - Constructs a compiled, pre-resolved word
+ *
+ * Creates a TF_OBJ_WORD instance binding a primitive implementation to the
+ * symbol it was compiled from. The engine calls the stored function pointer
+ * directly, so no dictionary lookup happens at execution time.
+ *
+ * Args:
+ *   op     - Resolved primitive implementation (must not be NULL)
+ *   symbol - TF_OBJ_SYMBOL naming the word (the word takes a reference)
+ *
+ * Returns:
+ *   New TF_OBJ_WORD object with refcount=1
+ */
+tfobj *createWordObject(Operation op, tfobj *symbol);
+
+/*
+ * createOperandWordObject() - Constructs a word carrying an inline operand
+ *
+ * Creates a TF_OBJ_WORD for a fused superinstruction: the engine calls
+ * op(context, operand) instead of pushing the operand and running a
+ * separate primitive.
+ *
+ * Args:
+ *   op      - Resolved operand primitive (must not be NULL)
+ *   symbol  - TF_OBJ_SYMBOL naming the word (the word takes a reference)
+ *   operand - Inline literal (must not be NULL; the word takes a reference)
+ *
+ * Returns:
+ *   New TF_OBJ_WORD object with refcount=1
+ */
+tfobj *createOperandWordObject(OperandOperation op, tfobj *symbol, tfobj *operand);
+
+/*
+ * createBranchObject() - Constructs a compiled control-flow jump
+ *
+ * Creates a TF_OBJ_BRANCH of the given kind. Its target starts at 0 and
+ * is resolved by the compiler when the matching control word is parsed.
+ *
+ * Args:
+ *   kind   - Condition of the jump
+ *   symbol - TF_OBJ_SYMBOL of the control word (a reference is taken)
+ *
+ * Returns:
+ *   New TF_OBJ_BRANCH object with refcount=1
+ */
+tfobj *createBranchObject(TF_BRANCH_KIND kind, tfobj *symbol);
+
+/*
+ * createListObject() - Constructs an empty list/array object
+ *
+ * Allocates a new TF_OBJ_LIST with initial capacity. Used for the main
+ * data stack and compiled program representation.
+ *
+ * Returns:
+ *   New empty TF_OBJ_LIST object with refcount=1 and capacity>=INITIAL_STACK_CAPACITY
+ */
+tfobj *createListObject();
+
+
+/*
+ * createArrayObject() - Constructs an unboxed integer array
+ *
+ * Args:
+ *   len - Number of elements; their values are left uninitialized
+ *
+ * Returns:
+ *   New TF_OBJ_ARRAY object with refcount=1
+ */
+tfobj *createArrayObject(size_t len);
+
+
+/*
+ * createContext() - Allocates and initializes a ToyForth execution context
+ *
+ * Creates a new tfcontext with an empty data stack ready for execution,
+ * sized by the stack policy in force (see setStackPolicy()), plus a private allocator pool that becomes active for all objects
+ * created afterwards. Output is buffered (see output.h) and goes to stdout
+ * through stdio. Should be freed with freeContext() when no longer needed.
+ *
+ * Returns:
+ *   New tfcontext with initialized stack and refcount=1
+ */
+tfcontext *createContext();
+
+/*
+ * freeContext() - Deallocates an execution context and its resources
+ *
+ * Flushes the context's output, then releases all resources associated
+ * with the context, including any objects remaining on the stack. The
+ * stack is freed through reference counting.
+ *
+ * Args:
+ *   context - Context to deallocate (may be NULL; no-op if so)
+ */
+void freeContext(tfcontext *context);
+
+/*
+ * resetContext() - Empties a context so it can run another program
+ *
+ * Drops everything left on the data and loop stacks, but keeps their
+ * capacity and the context's pool (with its free lists), so running many
+ * small programs on one context allocates nothing once it is warm. A data
+ * stack that grew past the policy's shrink_above is shrunk back (see
+ * stackIdle()). Flushes the output first, and makes the context's pool
+ * the active one.
+ *
+ * Args:
+ *   context - Context to reset
+ */
+void resetContext(tfcontext *context);
+
+/*
+ * activateContext() - Directs new allocations to a context's pool
+ *
+ * Objects created until the next call come from the pool of context, or
+ * from the global pool if context is NULL, for objects that must not
+ * belong to any single context (e.g. programs shared between contexts).
+ *
+ * Args:
+ *   context - Context whose pool to use, or NULL
+ */
+void activateContext(tfcontext *context);
+
+
+/*
+ * incrementReferenceCount() - Increases an object's reference count
+ *
+ * Called when a new reference to an object is created (e.g., adding to a
+ * container). A safe no-op if passed a NULL pointer or an immediate.
+ *
+ * Args:
+ *   object - Object whose reference count should be incremented (may be NULL)
+ */
+void incrementReferenceCount(tfobj *object);
+
+/*
+ * decrementReferenceCount() - Decreases an object's reference count
+ *
+ * Called when relinquishing ownership of a reference. When count reaches 0,
+ * the object is automatically freed via freeObject(). Safe no-op if passed
+ * a NULL pointer, an immediate or a pinned object.
+ *
+ * Args:
+ *   object - Object whose reference count should be decremented (may be NULL)
+ */
+void decrementReferenceCount(tfobj *object);
+
+/*
+ * pinObject() - Makes an object immortal
+ *
+ * Sets the refcount to TF_REFCOUNT_PINNED, after which increments and
+ * decrements are no-ops and the object is never freed. Used for objects
+ * shared by the whole process (interned symbols), which are referenced
+ * from every compiled word, and for the literals of programs that live
+ * until exit (see pinLiterals()): pinning them removes that refcount
+ * traffic and lets contexts on different threads share them without
+ * races. Pinned objects stay listed, so they remain reachable after the
+ * program that pinned them is freed. Not thread-safe; pin while compiling.
+ *
+ * Args:
+ *   object - Heap object to pin (immediates are ignored)
+ */
+void pinObject(tfobj *object);
+
+/*
+ * freeObject() - Immediately deallocates an object and its resources
+ *
+ * Called automatically when reference count reaches 0. Does not check
+ * reference counts; use only after confirming the object has no active
+ * references. Handles recursive deallocation for container types.
+ *
+ * Args:
+ *   object - Object to deallocate and destroy (may be NULL)
+ */
+void freeObject(tfobj *object);
+
+
 #endif
\ No newline at end of file
@@ -1,191 +1,1083 @@
-/*
- * Forth Primitive Operations Implementation
- *
- * Implements built-in Forth words: arithmetic operations, I/O, and
- * stack manipulation. Each operation pops operands, performs computation,
- * and may push results. All operations handle reference counting and may
- * trigger garbage collection.
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-
-#include "ops.h"
-#include "stack.h"
-#include "mem.h"
-
-
-/*
- * operationAdd() implementation
- *
- * ( a b -- a+b )
- *
- * Pops two values from the stack. If both are integers, computes their
- * sum, pushes the result, and cleans up operands via reference counting.
- * No operation occurs if either operand is not an integer.
- */
-void operationAdd(tfcontext *context) {
-    tfobj *b = stackPop(context);
-    tfobj *a = stackPop(context);
-
-    if (a->type == TF_OBJ_INT && b->type == TF_OBJ_INT) {           
-        tfobj *result = createIntegerObject(a->number + b->number);
-        stackPush(context, result);
-        /* Release local reference: the stack now owns it */
-        decrementReferenceCount(result);
-    }
-
-    decrementReferenceCount(a);
-    decrementReferenceCount(b);
-}
-
-/*
- * operationSub() implementation
- *
- * ( a b -- a-b )
- *
- * Pops two values from the stack. If both are integers, computes a minus b,
- * pushes the result, and cleans up operands. No operation if not both integers.
- */
-void operationSub(tfcontext *context) {
-    tfobj *b = stackPop(context);
-    tfobj *a = stackPop(context);
-
-    if (a->type == TF_OBJ_INT && b->type == TF_OBJ_INT) {
-        tfobj *result = createIntegerObject(a->number - b->number);
-        stackPush(context, result);
-        decrementReferenceCount(result);
-    }
-
-    decrementReferenceCount(a);
-    decrementReferenceCount(b);
-}
-
-/*
- * operationMul() implementation
- *
- * ( a b -- a*b )
- *
- * Pops two values from the stack. If both are integers, computes their
- * product, pushes the result, and cleans up operands.
- */
-void operationMul(tfcontext *context) {
-    tfobj *b = stackPop(context);
-    tfobj *a = stackPop(context);
-
-    if (a->type == TF_OBJ_INT && b->type == TF_OBJ_INT) {
-        tfobj *result = createIntegerObject(a->number * b->number);
-        stackPush(context, result);
-        decrementReferenceCount(result);
-    }
-
-    decrementReferenceCount(a);
-    decrementReferenceCount(b);
-}
-
-/*
- * operationDiv() implementation
- *
- * ( a b -- a/b )
- *
- * Pops two integer values and computes integer division (a/b).
- * Terminates with error on division by zero.
- * Cleans up operands via reference counting.
- */
-void operationDiv(tfcontext *context) {
-    tfobj *b = stackPop(context);
-    tfobj *a = stackPop(context);
-
-    if (a->type == TF_OBJ_INT && b->type == TF_OBJ_INT) {
-        if (b->number == 0) {                                      
-            fprintf(stderr, "Division by zero error.\n");
-            exit(EXIT_FAILURE);
-        }
-        tfobj *result = createIntegerObject(a->number / b->number);
-        stackPush(context, result);
-        decrementReferenceCount(result);
-    }
-
-    decrementReferenceCount(a);
-    decrementReferenceCount(b);
-}
-
-
-/*
- * operationPrint() implementation
- *
- * ( a -- )
- *
- * Pops the top of the stack and prints it in a human-readable format.
- * Output is type-dependent:
- *   - Integer: Decimal followed by space
- *   - String:  String contents followed by space
- *   - Boolean: "TRUE" or "FALSE" followed by space
- *
- * The popped value is destroyed by reference counting.
- */
-void operationPrint(tfcontext *context) {
-    tfobj *object = stackPop(context);
-
-    if (object->type == TF_OBJ_INT) {
-        printf("%d ", object->number);
-    } else if (object->type == TF_OBJ_STR) {
-        printf("%s ", object->str_obj.str);
-    } else if (object->type == TF_OBJ_BOOL) {
-        printf("%s ", object->number ? "TRUE" : "FALSE");
-    }
-
-    decrementReferenceCount(object);
-}
-
-
-/*
- * operationDup() implementation
- *
- * ( a -- a a )
- *
- * If the stack is non-empty, pops the top element and pushes it twice,
- * resulting in duplication. Safe no-op if the stack is empty.
- */
-void operationDup(tfcontext *context) {
-    if (context->stack->list_obj.len == 0) return;
-    
-    tfobj *object = stackPop(context);
-    
-    stackPush(context, object);
-    stackPush(context, object);
-    
-    decrementReferenceCount(object);
-}
-
-/*
- * operationDrop() implementation
- *
- * ( a -- )
- *
- * Pops and immediately destroys the top element of the stack.
- */
-void operationDrop(tfcontext *context) {
-    tfobj *object = stackPop(context);
-    
-    decrementReferenceCount(object);
-}
-
-/*
- * operationSwap() implementation
- *
- * ( a b -- b a )
- *
- * Pops two elements and pushes them back in reverse order,
- * effectively swapping the top two stack elements.
- */
-void operationSwap(tfcontext *context) {
-    tfobj *b = stackPop(context);                                       
-    tfobj *a = stackPop(context);                                       
-
-    stackPush(context, b);                                              
-    stackPush(context, a);
-
-    decrementReferenceCount(a);                                  
-    decrementReferenceCount(b);
+/*
+ * Forth Primitive Operations Implementation
+ *
+ * Implements built-in Forth words: arithmetic operations, I/O, and
+ * stack manipulation. Each operation pops operands, performs computation,
+ * and may push results. All operations handle reference counting and may
+ * trigger garbage collection. Integer and boolean results are immediates,
+ * so arithmetic never reaches the allocator, and integer operands are
+ * combined directly in their stack slots without a pop/push round trip.
+ *
+ * Runtime errors can be recovered from (see executeRecovering()), so no
+ * operation raises one while holding popped operands: words popping
+ * several values check the depth up front with stackTop(), and errors
+ * detected after popping release the operands first.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ops.h"
+#include "engine.h"
+#include "stack.h"
+#include "mem.h"
+#include "list.h"
+#include "output.h"
+
+
+/*
+ * integerOperands() - Returns the top count stack slots if all hold integers
+ *
+ * The fast paths compute directly on these slots, without popping the
+ * operands or pushing the result. Returns NULL on underflow or on other
+ * types; callers then take the popping path, which reports errors and
+ * ignores non-integers exactly as before.
+ */
+static inline tfobj **integerOperands(tfcontext *context, size_t count) {
+    tfobj *stack = context->stack;
+    if (stack->list_obj.len < count) return NULL;
+
+    tfobj **slots = stack->list_obj.element + stack->list_obj.len - count;
+    for (size_t i = 0; i < count; i++) {
+        if (getObjectType(slots[i]) != TF_OBJ_INT) return NULL;
+    }
+    return slots;
+}
+
+
+/*
+ * Checked arithmetic - 64-bit operations that report overflow
+ *
+ * __builtin_*_overflow() compiles to the plain instruction followed by a
+ * branch on its overflow flag, which is never taken in practice, so the
+ * check costs next to nothing on the fast paths. A result that does not
+ * fit in 64 bits is a runtime error rather than a wrapped-around value.
+ */
+static void overflowError(tfcontext *context) {
+    runtimeError(context, "Integer overflow error.");
+}
+
+static inline int64_t checkedAdd(tfcontext *context, int64_t a, int64_t b) {
+    int64_t result;
+    if (__builtin_add_overflow(a, b, &result)) overflowError(context);
+    return result;
+}
+
+static inline int64_t checkedSub(tfcontext *context, int64_t a, int64_t b) {
+    int64_t result;
+    if (__builtin_sub_overflow(a, b, &result)) overflowError(context);
+    return result;
+}
+
+static inline int64_t checkedMul(tfcontext *context, int64_t a, int64_t b) {
+    int64_t result;
+    if (__builtin_mul_overflow(a, b, &result)) overflowError(context);
+    return result;
+}
+
+/* Callers rule out b == 0 first; INT64_MIN / -1 is the one overflow left */
+static inline int64_t checkedDiv(tfcontext *context, int64_t a, int64_t b) {
+    if (b == -1 && a == INT64_MIN) overflowError(context);
+    return a / b;
+}
+
+
+/*
+ * replaceOperands() - Replaces the count operands at slots with an integer
+ *
+ * The result takes the slot of the deepest operand. A boxed operand that
+ * only the stack references is overwritten in place rather than freed and
+ * reallocated; immediates need neither.
+ */
+static inline void replaceOperands(tfcontext *context, tfobj **slots, size_t count, int64_t value) {
+    tfobj *a = slots[0];
+
+    if (!isImmediate(a) && a->refcount == 1 && (value > TF_IMMEDIATE_MAX || value < TF_IMMEDIATE_MIN)) {
+        a->number = value;
+    } else {
+        slots[0] = createIntegerObject(value);
+        decrementReferenceCount(a);
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        decrementReferenceCount(slots[i]);
+    }
+    context->stack->list_obj.len -= count - 1;
+}
+
+
+/*
+ * pushInteger() - Pushes an integer result
+ *
+ * Releases the local reference once the stack holds its own, which
+ * matters for results too wide for an immediate.
+ */
+static inline void pushInteger(tfcontext *context, int64_t value) {
+    tfobj *result = createIntegerObject(value);
+    stackPush(context, result);
+    decrementReferenceCount(result);
+}
+
+
+/*
+ * operationAdd() implementation
+ *
+ * ( a b -- a+b )
+ *
+ * When both operands are integers the sum replaces them in place on the
+ * stack. Otherwise pops two values and cleans up operands via reference
+ * counting; no operation occurs if either operand is not an integer.
+ */
+void operationAdd(tfcontext *context) {
+    tfobj **slots = integerOperands(context, 2);
+    if (slots != NULL) {
+        replaceOperands(context, slots, 2, checkedAdd(context, getObjectNumber(slots[0]), getObjectNumber(slots[1])));
+        return;
+    }
+
+    stackTop(context, 2);
+    tfobj *b = stackPop(context);
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(b) == TF_OBJ_INT) {           
+        tfobj *result = createIntegerObject(checkedAdd(context, getObjectNumber(a), getObjectNumber(b)));
+        stackPush(context, result);
+        /* Release local reference: the stack now owns it */
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+    decrementReferenceCount(b);
+}
+
+/*
+ * operationSub() implementation
+ *
+ * ( a b -- a-b )
+ *
+ * Pops two values from the stack. If both are integers, computes a minus b,
+ * pushes the result, and cleans up operands. No operation if not both integers.
+ */
+void operationSub(tfcontext *context) {
+    tfobj **slots = integerOperands(context, 2);
+    if (slots != NULL) {
+        replaceOperands(context, slots, 2, checkedSub(context, getObjectNumber(slots[0]), getObjectNumber(slots[1])));
+        return;
+    }
+
+    stackTop(context, 2);
+    tfobj *b = stackPop(context);
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(b) == TF_OBJ_INT) {
+        tfobj *result = createIntegerObject(checkedSub(context, getObjectNumber(a), getObjectNumber(b)));
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+    decrementReferenceCount(b);
+}
+
+/*
+ * operationMul() implementation
+ *
+ * ( a b -- a*b )
+ *
+ * Pops two values from the stack. If both are integers, computes their
+ * product, pushes the result, and cleans up operands.
+ */
+void operationMul(tfcontext *context) {
+    tfobj **slots = integerOperands(context, 2);
+    if (slots != NULL) {
+        replaceOperands(context, slots, 2, checkedMul(context, getObjectNumber(slots[0]), getObjectNumber(slots[1])));
+        return;
+    }
+
+    stackTop(context, 2);
+    tfobj *b = stackPop(context);
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(b) == TF_OBJ_INT) {
+        tfobj *result = createIntegerObject(checkedMul(context, getObjectNumber(a), getObjectNumber(b)));
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+    decrementReferenceCount(b);
+}
+
+/*
+ * operationDiv() implementation
+ *
+ * ( a b -- a/b )
+ *
+ * Pops two integer values and computes integer division (a/b).
+ * Terminates with error on division by zero.
+ * Cleans up operands via reference counting.
+ */
+void operationDiv(tfcontext *context) {
+    tfobj **slots = integerOperands(context, 2);
+    if (slots != NULL && getObjectNumber(slots[1]) != 0) {
+        replaceOperands(context, slots, 2, checkedDiv(context, getObjectNumber(slots[0]), getObjectNumber(slots[1])));
+        return;
+    }
+
+    stackTop(context, 2);
+    tfobj *b = stackPop(context);
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(b) == TF_OBJ_INT) {
+        if (getObjectNumber(b) == 0) {
+            decrementReferenceCount(a);
+            decrementReferenceCount(b);
+            runtimeError(context, "Division by zero error.");
+        }
+        tfobj *result = createIntegerObject(checkedDiv(context, getObjectNumber(a), getObjectNumber(b)));
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+    decrementReferenceCount(b);
+}
+
+
+/*
+ * printObject() - Writes a value in its human-readable format
+ *
+ * Shared by "." and the fused "(dup.)". Appends to the context's output
+ * buffer; nothing reaches the terminal until it is flushed.
+ */
+static void printObject(tfcontext *context, tfobj *object) {
+    TF_OBJ_TYPE type = getObjectType(object);
+
+    if (type == TF_OBJ_INT) {
+        outputInteger(&context->output, getObjectNumber(object));
+    } else if (type == TF_OBJ_STR || type == TF_OBJ_ROPE) {
+        const char *bytes = flattenString(object);
+        outputBytes(&context->output, bytes, stringLength(object));
+        outputBytes(&context->output, " ", 1);
+    } else if (type == TF_OBJ_ARRAY) {
+        outputBytes(&context->output, "[ ", 2);
+        for (size_t i = 0; i < object->array_obj.len; i++) {
+            outputInteger(&context->output, object->array_obj.element[i]);
+        }
+        outputBytes(&context->output, "] ", 2);
+    } else if (type == TF_OBJ_BOOL) {
+        if (getObjectNumber(object)) {
+            outputBytes(&context->output, "TRUE ", 5);
+        } else {
+            outputBytes(&context->output, "FALSE ", 6);
+        }
+    }
+}
+
+
+/*
+ * operationPrint() implementation
+ *
+ * ( a -- )
+ *
+ * Pops the top of the stack and prints it in a human-readable format.
+ * Output is type-dependent:
+ *   - Integer: Decimal followed by space
+ *   - String:  String contents followed by space
+ *   - Boolean: "TRUE" or "FALSE" followed by space
+ *   - Array:   "[ ", each element followed by space, then "] "
+ *
+ * The popped value is destroyed by reference counting.
+ */
+void operationPrint(tfcontext *context) {
+    tfobj *object = stackPop(context);
+
+    printObject(context, object);
+
+    decrementReferenceCount(object);
+}
+
+
+/*
+ * operationDup() implementation
+ *
+ * ( a -- a a )
+ *
+ * If the stack is non-empty, pops the top element and pushes it twice,
+ * resulting in duplication. Safe no-op if the stack is empty.
+ */
+void operationDup(tfcontext *context) {
+    if (context->stack->list_obj.len == 0) return;
+
+    /* Pushing the borrowed top takes the new reference; no pop needed */
+    stackPush(context, stackPeek(context));
+}
+
+/*
+ * operationDrop() implementation
+ *
+ * ( a -- )
+ *
+ * Pops and immediately destroys the top element of the stack.
+ */
+void operationDrop(tfcontext *context) {
+    tfobj *object = stackPop(context);
+    
+    decrementReferenceCount(object);
+}
+
+/*
+ * operationSwap() implementation
+ *
+ * ( a b -- b a )
+ *
+ * Pops two elements and pushes them back in reverse order,
+ * effectively swapping the top two stack elements.
+ */
+void operationSwap(tfcontext *context) {
+    if (context->stack->list_obj.len >= 2) {
+        /* Exchange the slots in place; the stack keeps both references */
+        tfobj **slots = context->stack->list_obj.element + context->stack->list_obj.len - 2;
+        tfobj *top = slots[1];
+        slots[1] = slots[0];
+        slots[0] = top;
+        return;
+    }
+
+    stackTop(context, 2);
+    tfobj *b = stackPop(context);                                       
+    tfobj *a = stackPop(context);                                       
+
+    stackPush(context, b);                                              
+    stackPush(context, a);
+
+    decrementReferenceCount(a);                                  
+    decrementReferenceCount(b);
+}
+
+
+/*
+ * popCount() - Pops the item count of a bulk word
+ *
+ * Returns false (the count is dropped) unless it is a non-negative
+ * integer.
+ */
+static bool popCount(tfcontext *context, size_t *count) {
+    tfobj *n = stackPop(context);
+    bool ok = getObjectType(n) == TF_OBJ_INT && getObjectNumber(n) >= 0;
+
+    if (ok) *count = (size_t)getObjectNumber(n);
+    decrementReferenceCount(n);
+    return ok;
+}
+
+
+/*
+ * rollSlots() - Moves the item depth slots below the top to the top
+ */
+static void rollSlots(tfcontext *context, size_t depth) {
+    tfobj **slots = stackTop(context, depth + 1);
+    tfobj *item = slots[0];
+
+    memmove(slots, slots + 1, sizeof(tfobj *) * depth);
+    slots[depth] = item;
+}
+
+
+/*
+ * operationPick() implementation
+ *
+ * ( xn ... x0 n -- xn ... x0 xn )
+ */
+void operationPick(tfcontext *context) {
+    size_t depth;
+    if (!popCount(context, &depth)) return;
+
+    stackPush(context, stackTop(context, depth + 1)[0]);
+}
+
+
+/*
+ * operationRoll() implementation
+ *
+ * ( xn xn-1 ... x0 n -- xn-1 ... x0 xn )
+ */
+void operationRoll(tfcontext *context) {
+    size_t depth;
+    if (popCount(context, &depth)) rollSlots(context, depth);
+}
+
+
+/*
+ * operationRot() implementation
+ *
+ * ( a b c -- b c a )
+ */
+void operationRot(tfcontext *context) {
+    rollSlots(context, 2);
+}
+
+
+/*
+ * operationNDrop() implementation
+ *
+ * ( xn ... x1 n -- )
+ */
+void operationNDrop(tfcontext *context) {
+    size_t count;
+    if (!popCount(context, &count)) return;
+
+    tfobj **slots = stackTop(context, count);
+    for (size_t i = 0; i < count; i++) {
+        decrementReferenceCount(slots[i]);
+    }
+    context->stack->list_obj.len -= count;
+}
+
+
+/*
+ * operationNDup() implementation
+ *
+ * ( xn ... x1 n -- xn ... x1 xn ... x1 )
+ */
+void operationNDup(tfcontext *context) {
+    size_t count;
+    if (!popCount(context, &count)) return;
+
+    tfobj *stack = context->stack;
+    stackTop(context, count);
+    listReserve(stack, stack->list_obj.len + count);
+
+    tfobj **slots = stack->list_obj.element + stack->list_obj.len - count;
+    memcpy(slots + count, slots, sizeof(tfobj *) * count);
+    for (size_t i = 0; i < count; i++) {
+        incrementReferenceCount(slots[i]);
+    }
+    stack->list_obj.len += count;
+}
+
+
+/*
+ * pushArray() - Pushes a new array, handing over the caller's reference
+ */
+static void pushArray(tfcontext *context, tfobj *array) {
+    stackPush(context, array);
+    decrementReferenceCount(array);
+}
+
+
+/*
+ * operationArray() implementation
+ *
+ * ( x1 ... xn n -- array )
+ */
+void operationArray(tfcontext *context) {
+    size_t count;
+    if (!popCount(context, &count)) return;
+
+    tfobj **slots = stackTop(context, count);
+    tfobj *array = NULL;
+    bool integers = true;
+
+    for (size_t i = 0; i < count && integers; i++) {
+        integers = getObjectType(slots[i]) == TF_OBJ_INT;
+    }
+    if (integers) {
+        array = createArrayObject(count);
+        for (size_t i = 0; i < count; i++) {
+            array->array_obj.element[i] = getObjectNumber(slots[i]);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        decrementReferenceCount(slots[i]);
+    }
+    context->stack->list_obj.len -= count;
+
+    if (array != NULL) pushArray(context, array);
+}
+
+
+/*
+ * operationIota() implementation
+ *
+ * ( n -- array )
+ */
+void operationIota(tfcontext *context) {
+    size_t count;
+    if (!popCount(context, &count)) return;
+
+    tfobj *array = createArrayObject(count);
+    for (size_t i = 0; i < count; i++) {
+        array->array_obj.element[i] = (int64_t)i;
+    }
+    pushArray(context, array);
+}
+
+
+/*
+ * operationLength() implementation
+ *
+ * ( array -- n )
+ */
+void operationLength(tfcontext *context) {
+    tfobj *array = stackPop(context);
+
+    if (getObjectType(array) == TF_OBJ_ARRAY) {
+        pushInteger(context, (int64_t)array->array_obj.len);
+    }
+
+    decrementReferenceCount(array);
+}
+
+
+/*
+ * operationAt() implementation
+ *
+ * ( array i -- x )
+ */
+void operationAt(tfcontext *context) {
+    stackTop(context, 2);
+    tfobj *index = stackPop(context);
+    tfobj *array = stackPop(context);
+
+    if (getObjectType(array) == TF_OBJ_ARRAY && getObjectType(index) == TF_OBJ_INT) {
+        int64_t i = getObjectNumber(index);
+        if (i < 0 || (uint64_t)i >= array->array_obj.len) {
+            decrementReferenceCount(array);
+            decrementReferenceCount(index);
+            runtimeError(context, "Array index out of range error.");
+        }
+        pushInteger(context, array->array_obj.element[i]);
+    }
+
+    decrementReferenceCount(array);
+    decrementReferenceCount(index);
+}
+
+
+/*
+ * operationSum() implementation
+ *
+ * ( array -- n )
+ */
+void operationSum(tfcontext *context) {
+    tfobj *array = stackPop(context);
+
+    if (getObjectType(array) == TF_OBJ_ARRAY) {
+        int64_t sum;
+        if (!arraySum(array->array_obj.element, array->array_obj.len, &sum)) {
+            decrementReferenceCount(array);
+            overflowError(context);
+        }
+        pushInteger(context, sum);
+    }
+
+    decrementReferenceCount(array);
+}
+
+
+/*
+ * mapScalar() - Shared body of map+ and map*
+ *
+ * The popped array is mutated when the stack held its only reference;
+ * otherwise the kernel writes into a fresh array.
+ */
+static void mapScalar(tfcontext *context, int (*kernel)(int64_t *, const int64_t *, size_t, int64_t)) {
+    stackTop(context, 2);
+    tfobj *value = stackPop(context);
+    tfobj *array = stackPop(context);
+
+    if (getObjectType(array) == TF_OBJ_ARRAY && getObjectType(value) == TF_OBJ_INT) {
+        size_t len = array->array_obj.len;
+        tfobj *result = array->refcount == 1 ? array : createArrayObject(len);
+
+        if (!kernel(result->array_obj.element, array->array_obj.element, len, getObjectNumber(value))) {
+            if (result != array) decrementReferenceCount(result);
+            decrementReferenceCount(array);
+            decrementReferenceCount(value);
+            overflowError(context);
+        }
+        stackPush(context, result);
+        if (result != array) decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(array);
+    decrementReferenceCount(value);
+}
+
+
+/*
+ * operationMapAdd() implementation
+ *
+ * ( array k -- array' )
+ */
+void operationMapAdd(tfcontext *context) {
+    mapScalar(context, arrayAddScalar);
+}
+
+
+/*
+ * operationMapMul() implementation
+ *
+ * ( array k -- array' )
+ */
+void operationMapMul(tfcontext *context) {
+    mapScalar(context, arrayMulScalar);
+}
+
+
+/*
+ * operationDot() implementation
+ *
+ * ( a b -- n )
+ */
+void operationDot(tfcontext *context) {
+    stackTop(context, 2);
+    tfobj *b = stackPop(context);
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_ARRAY && getObjectType(b) == TF_OBJ_ARRAY &&
+        a->array_obj.len == b->array_obj.len) {
+        int64_t dot;
+        if (!arrayDot(a->array_obj.element, b->array_obj.element, a->array_obj.len, &dot)) {
+            decrementReferenceCount(a);
+            decrementReferenceCount(b);
+            overflowError(context);
+        }
+        pushInteger(context, dot);
+    }
+
+    decrementReferenceCount(a);
+    decrementReferenceCount(b);
+}
+
+
+/*
+ * operationSquare() implementation
+ *
+ * ( a -- a*a )
+ *
+ * Fused "dup *": a single pop and push instead of dup's push/pop pair.
+ */
+void operationSquare(tfcontext *context) {
+    tfobj **slots = integerOperands(context, 1);
+    if (slots != NULL) {
+        replaceOperands(context, slots, 1, checkedMul(context, getObjectNumber(slots[0]), getObjectNumber(slots[0])));
+        return;
+    }
+
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT) {
+        tfobj *result = createIntegerObject(checkedMul(context, getObjectNumber(a), getObjectNumber(a)));
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+}
+
+/*
+ * operationSwapSub() implementation
+ *
+ * ( a b -- b-a )
+ *
+ * Fused "swap -": subtracts without reordering the stack first.
+ */
+void operationSwapSub(tfcontext *context) {
+    tfobj **slots = integerOperands(context, 2);
+    if (slots != NULL) {
+        replaceOperands(context, slots, 2, checkedSub(context, getObjectNumber(slots[1]), getObjectNumber(slots[0])));
+        return;
+    }
+
+    stackTop(context, 2);
+    tfobj *b = stackPop(context);
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(b) == TF_OBJ_INT) {
+        tfobj *result = createIntegerObject(checkedSub(context, getObjectNumber(b), getObjectNumber(a)));
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+    decrementReferenceCount(b);
+}
+
+/*
+ * operationDupPrint() implementation
+ *
+ * ( a -- a )
+ *
+ * Fused "dup .": prints the top of stack in place. An empty stack reports
+ * an underflow, as "." would after the no-op dup.
+ */
+void operationDupPrint(tfcontext *context) {
+    printObject(context, stackPeek(context));
+}
+
+
+/*
+ * operationAddLiteral() implementation
+ *
+ * ( a -- a+n )
+ *
+ * Fused "<n> +": the literal never touches the stack.
+ */
+void operationAddLiteral(tfcontext *context, tfobj *operand) {
+    tfobj **slots = integerOperands(context, 1);
+    if (slots != NULL && getObjectType(operand) == TF_OBJ_INT) {
+        replaceOperands(context, slots, 1, checkedAdd(context, getObjectNumber(slots[0]), getObjectNumber(operand)));
+        return;
+    }
+
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(operand) == TF_OBJ_INT) {
+        tfobj *result = createIntegerObject(checkedAdd(context, getObjectNumber(a), getObjectNumber(operand)));
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+}
+
+/*
+ * operationSubLiteral() implementation
+ *
+ * ( a -- a-n )
+ */
+void operationSubLiteral(tfcontext *context, tfobj *operand) {
+    tfobj **slots = integerOperands(context, 1);
+    if (slots != NULL && getObjectType(operand) == TF_OBJ_INT) {
+        replaceOperands(context, slots, 1, checkedSub(context, getObjectNumber(slots[0]), getObjectNumber(operand)));
+        return;
+    }
+
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(operand) == TF_OBJ_INT) {
+        tfobj *result = createIntegerObject(checkedSub(context, getObjectNumber(a), getObjectNumber(operand)));
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+}
+
+/*
+ * operationMulLiteral() implementation
+ *
+ * ( a -- a*n )
+ */
+void operationMulLiteral(tfcontext *context, tfobj *operand) {
+    tfobj **slots = integerOperands(context, 1);
+    if (slots != NULL && getObjectType(operand) == TF_OBJ_INT) {
+        replaceOperands(context, slots, 1, checkedMul(context, getObjectNumber(slots[0]), getObjectNumber(operand)));
+        return;
+    }
+
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(operand) == TF_OBJ_INT) {
+        tfobj *result = createIntegerObject(checkedMul(context, getObjectNumber(a), getObjectNumber(operand)));
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+}
+
+/*
+ * operationDivLiteral() implementation
+ *
+ * ( a -- a/n )
+ *
+ * Terminates with error on a zero literal, exactly like "0 /".
+ */
+void operationDivLiteral(tfcontext *context, tfobj *operand) {
+    tfobj **slots = integerOperands(context, 1);
+    if (slots != NULL && getObjectType(operand) == TF_OBJ_INT && getObjectNumber(operand) != 0) {
+        replaceOperands(context, slots, 1, checkedDiv(context, getObjectNumber(slots[0]), getObjectNumber(operand)));
+        return;
+    }
+
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(operand) == TF_OBJ_INT) {
+        if (getObjectNumber(operand) == 0) {
+            decrementReferenceCount(a);
+            runtimeError(context, "Division by zero error.");
+        }
+        tfobj *result = createIntegerObject(checkedDiv(context, getObjectNumber(a), getObjectNumber(operand)));
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+}
+
+
+/*
+ * compareStrings() - Orders two strings bytewise, shorter first on a tie
+ *
+ * Returns -1, 0 or 1. Ropes are flattened.
+ */
+static int compareStrings(tfobj *a, tfobj *b) {
+    size_t len_a = stringLength(a);
+    size_t len_b = stringLength(b);
+    const char *x = flattenString(a);
+    const char *y = flattenString(b);
+    int order = memcmp(x, y, len_a < len_b ? len_a : len_b);
+
+    if (order != 0) return (order > 0) - (order < 0);
+    return (len_a > len_b) - (len_a < len_b);
+}
+
+/*
+ * compareValues() - Shared body of the comparison primitives
+ *
+ * Pops b and a and pushes TRUE when the sign of a compared to b
+ * (-1, 0 or 1) equals wanted. Compares two integers or two strings.
+ */
+static void compareValues(tfcontext *context, int wanted) {
+    stackTop(context, 2);
+    tfobj *b = stackPop(context);
+    tfobj *a = stackPop(context);
+
+    if (getObjectType(a) == TF_OBJ_INT && getObjectType(b) == TF_OBJ_INT) {
+        int64_t x = getObjectNumber(a);
+        int64_t y = getObjectNumber(b);
+        int sign = (x > y) - (x < y);
+        stackPush(context, createBooleanObject(sign == wanted));
+    } else if (isStringObject(a) && isStringObject(b)) {
+        stackPush(context, createBooleanObject(compareStrings(a, b) == wanted));
+    }
+
+    decrementReferenceCount(a);
+    decrementReferenceCount(b);
+}
+
+/*
+ * operationEqual() implementation
+ *
+ * ( a b -- a=b )
+ */
+void operationEqual(tfcontext *context) {
+    compareValues(context, 0);
+}
+
+/*
+ * operationLess() implementation
+ *
+ * ( a b -- a<b )
+ */
+void operationLess(tfcontext *context) {
+    compareValues(context, -1);
+}
+
+/*
+ * operationGreater() implementation
+ *
+ * ( a b -- a>b )
+ */
+void operationGreater(tfcontext *context) {
+    compareValues(context, 1);
+}
+
+
+/*
+ * operationFlush() implementation
+ *
+ * ( -- )
+ */
+void operationFlush(tfcontext *context) {
+    outputFlush(&context->output);
+}
+
+
+/*
+ * operationConcat() implementation
+ *
+ * ( s1 s2 -- s1s2 )
+ */
+void operationConcat(tfcontext *context) {
+    stackTop(context, 2);
+    tfobj *b = stackPop(context);
+    tfobj *a = stackPop(context);
+
+    if (isStringObject(a) && isStringObject(b)) {
+        tfobj *result = createConcatObject(a, b);
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(a);
+    decrementReferenceCount(b);
+}
+
+/*
+ * operationSubstr() implementation
+ *
+ * ( s start len -- slice )
+ *
+ * start and len are clamped to the string, so the slice is empty when
+ * start is past its end.
+ */
+void operationSubstr(tfcontext *context) {
+    stackTop(context, 3);
+    tfobj *len = stackPop(context);
+    tfobj *start = stackPop(context);
+    tfobj *string = stackPop(context);
+
+    if (isStringObject(string) && getObjectType(start) == TF_OBJ_INT && getObjectType(len) == TF_OBJ_INT) {
+        size_t size = stringLength(string);
+        size_t first = getObjectNumber(start) > 0 ? (size_t)getObjectNumber(start) : 0;
+        size_t count = getObjectNumber(len) > 0 ? (size_t)getObjectNumber(len) : 0;
+        if (first > size) first = size;
+        if (count > size - first) count = size - first;
+
+        tfobj *result = createSliceObject(string, first, count);
+        stackPush(context, result);
+        decrementReferenceCount(result);
+    }
+
+    decrementReferenceCount(string);
+    decrementReferenceCount(start);
+    decrementReferenceCount(len);
+}
+
+/*
+ * operationSplit() implementation
+ *
+ * ( s sep -- s1 ... sn n )
+ *
+ * Every part is a slice of s. An empty separator leaves s whole.
+ */
+void operationSplit(tfcontext *context) {
+    stackTop(context, 2);
+    tfobj *separator = stackPop(context);
+    tfobj *string = stackPop(context);
+
+    if (isStringObject(string) && isStringObject(separator)) {
+        size_t size = stringLength(string);
+        size_t sep_len = stringLength(separator);
+        const char *bytes = flattenString(string);
+        const char *sep = flattenString(separator);
+        size_t first = 0, parts = 0;
+
+        for (size_t i = 0; sep_len > 0 && i + sep_len <= size; i++) {
+            if (bytes[i] == sep[0] && memcmp(bytes + i, sep, sep_len) == 0) {
+                tfobj *part = createSliceObject(string, first, i - first);
+                stackPush(context, part);
+                decrementReferenceCount(part);
+                parts++;
+                first = i + sep_len;
+                i = first - 1;
+            }
+        }
+
+        tfobj *last = createSliceObject(string, first, size - first);
+        stackPush(context, last);
+        decrementReferenceCount(last);
+        pushInteger(context, (int64_t)(parts + 1));
+    }
+
+    decrementReferenceCount(string);
+    decrementReferenceCount(separator);
+}
+
+/*
+ * operationStrlen() implementation
+ *
+ * ( s -- n )
+ */
+void operationStrlen(tfcontext *context) {
+    tfobj *string = stackPop(context);
+
+    if (isStringObject(string)) {
+        pushInteger(context, (int64_t)stringLength(string));
+    }
+
+    decrementReferenceCount(string);
+}
+
+
+/*
+ * operationDo() implementation
+ *
+ * ( limit start -- )
+ *
+ * Each loop occupies two loop stack slots: limit, then the index.
+ */
+void operationDo(tfcontext *context) {
+    stackTop(context, 2);
+    tfobj *start = stackPop(context);
+    tfobj *limit = stackPop(context);
+
+    listAppendObject(context->loops, limit);
+    listAppendObject(context->loops, start);
+
+    decrementReferenceCount(start);
+    decrementReferenceCount(limit);
+}
+
+/*
+ * operationLoopIndex() implementation
+ *
+ * ( -- i )
+ */
+void operationLoopIndex(tfcontext *context) {
+    tfobj *loops = context->loops;
+
+    if (loops->list_obj.len < 2) {
+        runtimeError(context, "Loop index used outside of a do loop.");
+    }
+
+    stackPush(context, loops->list_obj.element[loops->list_obj.len - 1]);
+}
+
+
+/*
+ * popFlag() implementation
+ */
+int popFlag(tfcontext *context) {
+    tfobj *flag = stackPop(context);
+    TF_OBJ_TYPE type = getObjectType(flag);
+    int result = !((type == TF_OBJ_INT || type == TF_OBJ_BOOL) && getObjectNumber(flag) == 0);
+
+    decrementReferenceCount(flag);
+    return result;
+}
+
+/*
+ * stepLoop() implementation
+ *
+ * Non-integer bounds end the loop after its first pass. The index is
+ * only incremented once it is known to be below the limit, so it cannot
+ * overflow, even next to INT64_MAX.
+ */
+int stepLoop(tfcontext *context) {
+    tfobj *loops = context->loops;
+    size_t len = loops->list_obj.len;
+    tfobj *limit = loops->list_obj.element[len - 2];
+    tfobj *index = loops->list_obj.element[len - 1];
+
+    if (getObjectType(limit) == TF_OBJ_INT && getObjectType(index) == TF_OBJ_INT &&
+        getObjectNumber(index) < getObjectNumber(limit) &&
+        getObjectNumber(index) + 1 < getObjectNumber(limit)) {
+        loops->list_obj.element[len - 1] = createIntegerObject(getObjectNumber(index) + 1);
+        decrementReferenceCount(index);
+        return 1;
+    }
+
+    loops->list_obj.len = len - 2;
+    decrementReferenceCount(limit);
+    decrementReferenceCount(index);
+    return 0;
 }
\ No newline at end of file
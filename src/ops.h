@@ -1,116 +1,456 @@
-/*
- * Forth Primitive Operations Module
- *
- * Implements built-in Forth words: arithmetic operations, I/O, and stack
- * manipulation. Each operation modifies the execution context (typically by
- * popping operands and pushing results).
- */
-
-#ifndef OPS_H
-#define OPS_H
-
-#include "tforth.h"
-
-
-/*
- * STACK DIAGRAM NOTATION
- *
- * Functions use standard Forth stack notation to document behavior:
- *
- *     ( before -- after )
- *
- * - 'before': Items expected on stack before execution (rightmost = top)
- * - '--':     Execution separator
- * - 'after':  Items left on stack after execution
- *
- * Example: "( a b -- sum )" means pop b, pop a, push a+b
- */
-
-
-/*
- * operationAdd() - Adds two integers
- *
- * ( a b -- a+b )
- *
- * Pops two integers, computes their sum, and pushes the result.
- * No operation is performed if operands are not both integers.
- */
-void operationAdd(tfcontext *context);
-
-/*
- * operationSub() - Subtracts two integers
- *
- * ( a b -- a-b )
- *
- * Pops two integers, computes a minus b, and pushes the result.
- * No operation is performed if operands are not both integers.
- */
-void operationSub(tfcontext *context);
-
-/*
- * operationMul() - Multiplies two integers
- *
- * ( a b -- a*b )
- *
- * Pops two integers, computes their product, and pushes the result.
- * No operation is performed if operands are not both integers.
- */
-void operationMul(tfcontext *context);
-
-/*
- * operationDiv() - Divides two integers with truncation
- *
- * ( a b -- a/b )
- *
- * Pops two integers, computes integer division (truncated toward zero),
- * and pushes the result. Division by zero terminates the program with error.
- * No operation is performed if operands are not both integers.
- */
-void operationDiv(tfcontext *context);
-
-
-/*
- * operationPrint() - Prints and consumes the top of stack
- *
- * ( a -- )
- *
- * Pops one value and prints it to stdout in a human-readable format:
- *  - Integer: decimal representation followed by space
- *  - String: string contents followed by space
- *  - Boolean: "TRUE" or "FALSE" followed by space
- *
- * The popped value is destroyed after printing.
- */
-void operationPrint(tfcontext *context);
-
-
-/*
- * operationDup() - Duplicates the top of stack
- *
- * ( a -- a a )
- *
- * If stack is non-empty, pops the top element and pushes it twice,
- * leaving it duplicated on the stack. Safe no-op if stack is empty.
- */
-void operationDup(tfcontext *context);
-
-/*
- * operationDrop() - Discards the top of stack
- *
- * ( a -- )
- *
- * Pops and immediately destroys the top element.
- */
-void operationDrop(tfcontext *context);
-
-/*
- * operationSwap() - Exchanges the top two stack elements
- *
- * ( a b -- b a )
- *
- * Pops two elements and pushes them back in reverse order.
- */
-void operationSwap(tfcontext *context);
-
-
+/*
+ * Forth Primitive Operations Module
+ *
+ * Implements built-in Forth words: arithmetic operations, I/O, and stack
+ * manipulation. Each operation modifies the execution context (typically by
+ * popping operands and pushing results).
+ */
+
+#ifndef OPS_H
+#define OPS_H
+
+#include "tforth.h"
+
+
+/*
+ * STACK DIAGRAM NOTATION
+ *
+ * Functions use standard Forth stack notation to document behavior:
+ *
+ *     ( before -- after )
+ *
+ * - 'before': Items expected on stack before execution (rightmost = top)
+ * - '--':     Execution separator
+ * - 'after':  Items left on stack after execution
+ *
+ * Example: "( a b -- sum )" means pop b, pop a, push a+b
+ */
+
+
+/*
+ * operationAdd() - Adds two integers
+ *
+ * ( a b -- a+b )
+ *
+ * Pops two integers, computes their sum, and pushes the result.
+ * No operation is performed if operands are not both integers.
+ */
+void operationAdd(tfcontext *context);
+
+/*
+ * operationSub() - Subtracts two integers
+ *
+ * ( a b -- a-b )
+ *
+ * Pops two integers, computes a minus b, and pushes the result.
+ * No operation is performed if operands are not both integers.
+ */
+void operationSub(tfcontext *context);
+
+/*
+ * operationMul() - Multiplies two integers
+ *
+ * ( a b -- a*b )
+ *
+ * Pops two integers, computes their product, and pushes the result.
+ * No operation is performed if operands are not both integers.
+ */
+void operationMul(tfcontext *context);
+
+/*
+ * operationDiv() - Divides two integers with truncation
+ *
+ * ( a b -- a/b )
+ *
+ * Pops two integers, computes integer division (truncated toward zero),
+ * and pushes the result. Division by zero terminates the program with error.
+ * No operation is performed if operands are not both integers.
+ */
+void operationDiv(tfcontext *context);
+
+
+/*
+ * operationPrint() - Prints and consumes the top of stack
+ *
+ * ( a -- )
+ *
+ * Pops one value and prints it to the context's output buffer (see
+ * output.h) in a human-readable format:
+ *  - Integer: decimal representation followed by space
+ *  - String: string contents followed by space
+ *  - Boolean: "TRUE" or "FALSE" followed by space
+ *  - Array: "[ ", each element followed by space, then "] "
+ *
+ * The popped value is destroyed after printing.
+ */
+void operationPrint(tfcontext *context);
+
+
+/*
+ * operationDup() - Duplicates the top of stack
+ *
+ * ( a -- a a )
+ *
+ * If stack is non-empty, pops the top element and pushes it twice,
+ * leaving it duplicated on the stack. Safe no-op if stack is empty.
+ */
+void operationDup(tfcontext *context);
+
+/*
+ * operationDrop() - Discards the top of stack
+ *
+ * ( a -- )
+ *
+ * Pops and immediately destroys the top element.
+ */
+void operationDrop(tfcontext *context);
+
+/*
+ * operationSwap() - Exchanges the top two stack elements
+ *
+ * ( a b -- b a )
+ *
+ * Pops two elements and pushes them back in reverse order.
+ */
+void operationSwap(tfcontext *context);
+
+
+/*
+ * BULK STACK WORDS
+ *
+ * Take an item count from the top of the stack (only rot does not) and
+ * move or release all the items with one memmove() or loop over the
+ * stack array. A count that is not a non-negative integer is dropped
+ * without doing anything; a count deeper than the stack is an underflow.
+ * Except for rot, their stack effects are only known at runtime.
+ */
+
+/*
+ * operationPick() - Copies the item n below the top
+ *
+ * ( xn ... x0 n -- xn ... x0 xn )
+ *
+ * Registered as "pick"; "0 pick" is dup.
+ */
+void operationPick(tfcontext *context);
+
+/*
+ * operationRoll() - Moves the item n below the top to the top
+ *
+ * ( xn xn-1 ... x0 n -- xn-1 ... x0 xn )
+ *
+ * Registered as "roll"; "1 roll" is swap.
+ */
+void operationRoll(tfcontext *context);
+
+/*
+ * operationRot() - Rotates the third item to the top
+ *
+ * ( a b c -- b c a )
+ *
+ * Registered as "rot"; the same as "2 roll".
+ */
+void operationRot(tfcontext *context);
+
+/*
+ * operationNDrop() - Drops n items
+ *
+ * ( xn ... x1 n -- )
+ *
+ * Registered as "ndrop".
+ */
+void operationNDrop(tfcontext *context);
+
+/*
+ * operationNDup() - Duplicates the top n items as a block
+ *
+ * ( xn ... x1 n -- xn ... x1 xn ... x1 )
+ *
+ * Registered as "ndup". Reserves the room once and copies the slots.
+ */
+void operationNDup(tfcontext *context);
+
+
+/*
+ * INTEGER ARRAYS
+ *
+ * TF_OBJ_ARRAY values hold unboxed 32-bit integers. The words below run
+ * one kernel from list.h over the whole array instead of one dispatch per
+ * element. Arithmetic wraps around at 32 bits. Operands of the wrong type
+ * are dropped without a result, like the arithmetic primitives.
+ */
+
+/*
+ * operationArray() - Packs n integers into an array
+ *
+ * ( x1 ... xn n -- array )
+ *
+ * Registered as "array"; x1 becomes element 0. If any item is not an
+ * integer, the items are dropped and nothing is pushed.
+ */
+void operationArray(tfcontext *context);
+
+/*
+ * operationIota() - Creates the array 0 1 ... n-1
+ *
+ * ( n -- array )
+ *
+ * Registered as "iota".
+ */
+void operationIota(tfcontext *context);
+
+/*
+ * operationLength() - Pushes the number of elements of an array
+ *
+ * ( array -- n )
+ *
+ * Registered as "length".
+ */
+void operationLength(tfcontext *context);
+
+/*
+ * operationAt() - Pushes one element of an array
+ *
+ * ( array i -- x )
+ *
+ * Registered as "at". Terminates with an error if i is out of range.
+ */
+void operationAt(tfcontext *context);
+
+/*
+ * operationSum() - Adds up the elements of an array
+ *
+ * ( array -- n )
+ *
+ * Registered as "sum".
+ */
+void operationSum(tfcontext *context);
+
+/*
+ * operationMapAdd() - Adds a value to every element of an array
+ *
+ * ( array k -- array' )
+ *
+ * Registered as "map+". An array referenced only by the stack is updated
+ * in place; a shared one is copied first.
+ */
+void operationMapAdd(tfcontext *context);
+
+/*
+ * operationMapMul() - Multiplies every element of an array by a value
+ *
+ * ( array k -- array' )
+ *
+ * Registered as "map*". Updates in place like map+.
+ */
+void operationMapMul(tfcontext *context);
+
+/*
+ * operationDot() - Computes the dot product of two arrays
+ *
+ * ( a b -- n )
+ *
+ * Registered as "dot". Arrays of different lengths are dropped without a
+ * result.
+ */
+void operationDot(tfcontext *context);
+
+
+/*
+ * FUSED SUPERINSTRUCTIONS
+ *
+ * Produced by fuseSuperinstructions() (see parser.h) from common adjacent
+ * word pairs. Each one behaves exactly like the pair it replaces, including
+ * its underflow and division-by-zero diagnostics, but needs one dispatch
+ * and one push/pop pair less.
+ */
+
+/*
+ * operationSquare() - Squares the top of stack ("dup *")
+ *
+ * ( a -- a*a )
+ *
+ * Registered as "(dup*)". No result is pushed if the operand is not an integer.
+ */
+void operationSquare(tfcontext *context);
+
+/*
+ * operationSwapSub() - Subtracts with swapped operands ("swap -")
+ *
+ * ( a b -- b-a )
+ *
+ * Registered as "(swap-)". No result is pushed unless both are integers.
+ */
+void operationSwapSub(tfcontext *context);
+
+/*
+ * operationDupPrint() - Prints the top of stack without consuming it ("dup .")
+ *
+ * ( a -- a )
+ *
+ * Registered as "(dup.)".
+ */
+void operationDupPrint(tfcontext *context);
+
+/*
+ * operationAddLiteral() - Adds an inline literal ("<n> +")
+ *
+ * ( a -- a+n )
+ *
+ * Registered as "(lit+)". The literal n is the word's operand.
+ */
+void operationAddLiteral(tfcontext *context, tfobj *operand);
+
+/*
+ * operationSubLiteral() - Subtracts an inline literal ("<n> -")
+ *
+ * ( a -- a-n )
+ *
+ * Registered as "(lit-)".
+ */
+void operationSubLiteral(tfcontext *context, tfobj *operand);
+
+/*
+ * operationMulLiteral() - Multiplies by an inline literal ("<n> *")
+ *
+ * ( a -- a*n )
+ *
+ * Registered as "(lit*)".
+ */
+void operationMulLiteral(tfcontext *context, tfobj *operand);
+
+/*
+ * operationDivLiteral() - Divides by an inline literal ("<n> /")
+ *
+ * ( a -- a/n )
+ *
+ * Registered as "(lit/)". A zero literal terminates the program with the
+ * usual division by zero error when executed.
+ */
+void operationDivLiteral(tfcontext *context, tfobj *operand);
+
+
+/*
+ * operationEqual() - Compares two integers or two strings for equality
+ *
+ * ( a b -- flag )
+ *
+ * Pushes TRUE if a equals b, FALSE otherwise. Strings compare bytewise,
+ * and "<" and ">" order them the same way. Other operands are discarded
+ * without a result, like the arithmetic primitives.
+ */
+void operationEqual(tfcontext *context);
+
+/*
+ * operationLess() - Tests whether a is less than b
+ *
+ * ( a b -- flag )
+ */
+void operationLess(tfcontext *context);
+
+/*
+ * operationGreater() - Tests whether a is greater than b
+ *
+ * ( a b -- flag )
+ */
+void operationGreater(tfcontext *context);
+
+/*
+ * operationFlush() - Writes out everything printed so far
+ *
+ * ( -- )
+ *
+ * Registered as "flush". Printing only fills the context's output
+ * buffer (see output.h), which is otherwise written out when it is full
+ * or when the context is reset or freed; flush makes output appear right
+ * away, e.g. before a long computation.
+ */
+void operationFlush(tfcontext *context);
+
+/*
+ * operationConcat() - Concatenates two strings
+ *
+ * ( s1 s2 -- s1s2 )
+ *
+ * Registered as "concat". Copies no bytes: the result is a rope over both
+ * strings (see createConcatObject()), flattened when it is printed or
+ * compared. Non-string operands are discarded without a result.
+ */
+void operationConcat(tfcontext *context);
+
+/*
+ * operationSubstr() - Cuts a substring out of a string
+ *
+ * ( s start len -- slice )
+ *
+ * Registered as "substr". The slice shares the bytes of s; start and len
+ * are clamped to the string. Operands of other types are discarded.
+ */
+void operationSubstr(tfcontext *context);
+
+/*
+ * operationSplit() - Splits a string at every occurrence of a separator
+ *
+ * ( s sep -- s1 ... sn n )
+ *
+ * Registered as "split". Pushes the parts, all slices of s, followed by
+ * their number; its stack effect is therefore only known at runtime.
+ */
+void operationSplit(tfcontext *context);
+
+/*
+ * operationStrlen() - Pushes the length of a string in bytes
+ *
+ * ( s -- n )
+ *
+ * Registered as "strlen".
+ */
+void operationStrlen(tfcontext *context);
+
+/*
+ * operationDo() - Starts a counted loop
+ *
+ * ( limit start -- )
+ *
+ * Moves limit and start onto the context's loop stack. Compiled by "do";
+ * the matching "loop" steps the index and jumps back while it is below
+ * the limit, so the body always runs at least once.
+ */
+void operationDo(tfcontext *context);
+
+/*
+ * operationLoopIndex() - Pushes the index of the innermost do loop
+ *
+ * ( -- i )
+ *
+ * Registered as "i". Terminates with an error outside of any do loop.
+ */
+void operationLoopIndex(tfcontext *context);
+
+/*
+ * popFlag() - Pops the condition of a conditional branch
+ *
+ * ( flag -- )
+ *
+ * FALSE and the integer 0 are false; every other value is true.
+ * Terminates with the usual error if the stack is empty.
+ *
+ * Returns:
+ *   1 if the popped value is true, 0 otherwise
+ */
+int popFlag(tfcontext *context);
+
+/*
+ * stepLoop() - Advances the innermost do loop
+ *
+ * Increments its index and reports whether the loop runs again, i.e.
+ * whether the index is still below the limit. A finished loop is removed
+ * from the loop stack.
+ *
+ * Returns:
+ *   1 if the body must run again, 0 if the loop is done
+ */
+int stepLoop(tfcontext *context);
+
+
 #endif
\ No newline at end of file
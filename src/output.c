@@ -0,0 +1,172 @@
+/*
+ * Output Module Implementation
+ *
+ * A context's output is one fixed buffer. Bytes that do not fit are never
+ * split across flushes: the buffer is written out first, and a chunk
+ * larger than the whole buffer goes out directly after it.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "mem.h"
+
+
+/* Decimal digits of the most negative int64_t, sign included */
+#define INTEGER_CHARS 20
+
+
+/*
+ * writeFailed() - Reports an output error and terminates
+ */
+static void writeFailed(void) {
+    fprintf(stderr, "Error. Couldn't write the program output.\n");
+    exit(EXIT_FAILURE);
+}
+
+
+/*
+ * writeVector() - Writes two chunks to a file descriptor with writev()
+ *
+ * Retries after short writes and interrupted calls until both chunks are
+ * out. Gives up silently if the reader has gone away (EPIPE).
+ */
+static void writeVector(int fd, const char *first, size_t first_len, const char *second, size_t second_len) {
+    struct iovec chunks[2] = {
+        {(void *)first, first_len},
+        {(void *)second, second_len}
+    };
+    struct iovec *next = chunks;
+    int left = 2;
+
+    while (left > 0) {
+        if (next->iov_len == 0) {
+            next++;
+            left--;
+            continue;
+        }
+
+        ssize_t written = writev(fd, next, left);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EPIPE) return;
+            writeFailed();
+        }
+
+        /* Skip the chunks written in full, then the part of the next one */
+        size_t done = (size_t)written;
+        while (left > 0 && done >= next->iov_len) {
+            done -= next->iov_len;
+            next++;
+            left--;
+        }
+        if (left > 0) {
+            next->iov_base = (char *)next->iov_base + done;
+            next->iov_len -= done;
+        }
+    }
+}
+
+
+/*
+ * writeOut() - Writes the buffer followed by extra bytes to the destination
+ */
+static void writeOut(tfoutput *output, const char *extra, size_t extra_len) {
+    if (output->fd == TF_OUTPUT_STDIO) {
+        if (fwrite(output->buffer, 1, output->len, stdout) != output->len ||
+            (extra_len > 0 && fwrite(extra, 1, extra_len, stdout) != extra_len) || fflush(stdout) != 0) {
+            writeFailed();
+        }
+    } else {
+        writeVector(output->fd, output->buffer, output->len, extra, extra_len);
+    }
+
+    output->len = 0;
+}
+
+
+/*
+ * outputInit() implementation
+ */
+void outputInit(tfoutput *output) {
+    output->buffer = wmalloc(TF_OUTPUT_BUFFER_SIZE);
+    output->len = 0;
+    output->fd = TF_OUTPUT_STDIO;
+}
+
+
+/*
+ * outputRelease() implementation
+ */
+void outputRelease(tfoutput *output) {
+    outputFlush(output);
+    free(output->buffer);
+    output->buffer = NULL;
+}
+
+
+/*
+ * outputUseDescriptor() implementation
+ */
+void outputUseDescriptor(tfoutput *output, int fd) {
+    outputFlush(output);
+    output->fd = fd < 0 ? TF_OUTPUT_STDIO : fd;
+}
+
+
+/*
+ * outputFlush() implementation
+ */
+void outputFlush(tfoutput *output) {
+    if (output->len > 0) writeOut(output, NULL, 0);
+}
+
+
+/*
+ * outputBytes() implementation
+ */
+void outputBytes(tfoutput *output, const char *bytes, size_t len) {
+    if (len > TF_OUTPUT_BUFFER_SIZE - output->len) {
+        if (len >= TF_OUTPUT_BUFFER_SIZE) {
+            writeOut(output, bytes, len);
+            return;
+        }
+        outputFlush(output);
+    }
+
+    memcpy(output->buffer + output->len, bytes, len);
+    output->len += len;
+}
+
+
+/*
+ * outputInteger() implementation
+ *
+ * Digits are produced last to first into a small scratch array. The
+ * magnitude is computed unsigned, so INT64_MIN needs no special case.
+ */
+void outputInteger(tfoutput *output, int64_t value) {
+    char digits[INTEGER_CHARS + 1];
+    char *start = digits + sizeof(digits);
+    uint64_t magnitude = value < 0 ? 0u - (uint64_t)value : (uint64_t)value;
+
+    *--start = ' ';
+    do {
+        *--start = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) *--start = '-';
+
+    size_t len = (size_t)(digits + sizeof(digits) - start);
+    if (len > TF_OUTPUT_BUFFER_SIZE - output->len) outputFlush(output);
+
+    memcpy(output->buffer + output->len, start, len);
+    output->len += len;
+}
@@ -0,0 +1,96 @@
+/*
+ * Output Module - Buffered Program Output
+ *
+ * Everything a program prints goes through its context's output buffer,
+ * so printing a value is a copy into memory rather than a stdio call.
+ * The buffer is written out when it fills up, on the "flush" word, when
+ * the context is reset or freed, and before any runtime error message,
+ * so output and diagnostics keep their order.
+ *
+ * By default the buffer is written to stdout through stdio, which lets
+ * embedders mix it with their own printf() calls. A context can instead
+ * write straight to a file descriptor with writev(), bypassing stdio.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tforth.h"
+
+
+/* Bytes buffered per context before they are written out */
+#define TF_OUTPUT_BUFFER_SIZE 65536
+
+/* tfoutput.fd of a context writing to stdout through stdio */
+#define TF_OUTPUT_STDIO (-1)
+
+
+/*
+ * outputInit() - Gives a context an empty output buffer on stdout (stdio)
+ *
+ * Args:
+ *   output - Output of a new context
+ */
+void outputInit(tfoutput *output);
+
+/*
+ * outputRelease() - Flushes a context's output and frees its buffer
+ *
+ * Args:
+ *   output - Output of a context being freed
+ */
+void outputRelease(tfoutput *output);
+
+/*
+ * outputUseDescriptor() - Sends a context's output to a file descriptor
+ *
+ * Whatever is buffered is flushed to the old destination first. Writes
+ * to a descriptor use writev(), so a long string is written together
+ * with the buffer in front of it without being copied. If SIGPIPE is
+ * ignored, output to a pipe or socket whose reader has gone away is
+ * discarded instead of being an error.
+ *
+ * Args:
+ *   output - Output of a context
+ *   fd     - File descriptor to write to, or TF_OUTPUT_STDIO for stdout
+ *            through stdio
+ */
+void outputUseDescriptor(tfoutput *output, int fd);
+
+/*
+ * outputFlush() - Writes out everything buffered
+ *
+ * Terminates with an error message if the destination cannot be written.
+ *
+ * Args:
+ *   output - Output of a context
+ */
+void outputFlush(tfoutput *output);
+
+/*
+ * outputBytes() - Appends bytes to the output
+ *
+ * Args:
+ *   output - Output of a context
+ *   bytes  - Bytes to print (need not be NUL-terminated)
+ *   len    - Number of bytes
+ */
+void outputBytes(tfoutput *output, const char *bytes, size_t len);
+
+/*
+ * outputInteger() - Appends an integer in decimal followed by a space
+ *
+ * Formats the digits by hand, straight into the buffer, which is what
+ * "." does for every integer it prints.
+ *
+ * Args:
+ *   output - Output of a context
+ *   value  - Integer to print
+ */
+void outputInteger(tfoutput *output, int64_t value);
+
+
+#endif
@@ -1,155 +1,1253 @@
-/*
- * Parser and Compiler Implementation
- *
- * Implements an iterative tokenizer/scanner that 
- * converts ToyForth source text into a linear list of 
- * executable objects (integers, symbols).
- * Provides line/column tracking for error diagnostics.
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <stdbool.h>
-
-#include "parser.h"
-#include "dictionary.h"
-#include "tforth.h"
-#include "mem.h"
-#include "list.h"
-
-
-/*
- * parserPeek() implementation
- *
- * Returns the current character without advancing the parser state.
- */
-char parserPeek(tfparser *parser) {
-    return *parser->program;
-}
-
-
-/*
- * parserAdvance() implementation
- *
- * Moves the parser forward by one character, maintaining accurate line/column
- * tracking for error diagnostics. Handles newline characters specially to
- * update line counters.
- */
-void parserAdvance(tfparser *parser) {
-    if (parserPeek(parser) == '\0') return;
-
-    if (parserPeek(parser) == '\n') {
-        parser->line++;
-        parser->column = 1;
-    } else {
-        parser->column++;
-    }
-    parser->program++;
-}
-
-
-/*
- * parserSkipWhiteSpace() implementation
- *
- * Advances past whitespace characters (space, tab, newline, etc.)
- * until a non-whitespace character or EOF is encountered.
- */
-void parserSkipWhiteSpace(tfparser *parser) {
-    while (parserPeek(parser) != '\0' && isspace(parserPeek(parser))) {
-        parserAdvance(parser);
-    }
-}
-
-
-/*
- * parseNumber() implementation
- *
- * Parses a base-10 integer literal (with optional leading '-' sign).
- * Uses strtol() for robust number parsing. Advances the parser past
- * all consumed characters.
- */
-tfobj *parseNumber(tfparser *parser) {
-    char *start = parser->program;
-    char *end;  
-
-    long value = strtol(start, &end, 10);
-    
-    while (parser->program < end) {
-        parserAdvance(parser);
-    }
-    
-    return createIntegerObject(value);
-}
-
-
-/*
- * parseSymbol() implementation
- *
- * Parses a Forth word/symbol name (sequence of non-whitespace characters).
- * Looks up the parsed name in the operation dictionary and returns a symbol
- * object only if it's a known primitive. Returns NULL for unknown symbols.
- */
-tfobj *parseSymbol(tfparser *parser) {
-    char *start = parser->program;
-
-    while (!isspace(parserPeek(parser)) && parserPeek(parser) != '\0') {
-        parserAdvance(parser);
-    }
-
-    size_t len_symbol = parser->program - start;
-    tfobj *new_object = createSymbolObject(start, len_symbol);
-
-    if (lookupOperation(new_object->str_obj.str) == NULL) {
-        decrementReferenceCount(new_object);
-        return NULL;
-    }
-
-    return new_object;
-}
-
-
-/*
- * compile() implementation
- *
- * Main entry point for the compilation phase. Tokenizes the input program
- * text and produces a list of compiled objects (integers, symbols). Performs
- * basic validation by ensuring all symbols are known primitives.
- *
- * Returns NULL on syntax error (prints diagnostic message to stderr).
- */
-tfobj *compile(char *program_txt) {
-    tfobj *program_list = createListObject();
-    tfparser parser;
-    parser.program = program_txt;
-    parser.line = 1;
-    parser.column = 1;
-
-    while (parserPeek(&parser)) {
-        tfobj *new_object = NULL; 
-        parserSkipWhiteSpace(&parser);
-        int line = parser.line;
-        int column = parser.column;
-        char c = parserPeek(&parser);
-
-        if (c == '\0') break;
-
-        if (isdigit(c) || (c == '-' && isdigit(parser.program[1]))) {
-            new_object = parseNumber(&parser);
-        } else {
-            new_object = parseSymbol(&parser);
-        }
-
-        if (new_object == NULL) {
-            fprintf(stderr, "Syntax error. Check line %d column %d.\n", line, column);
-            decrementReferenceCount(program_list); 
-            return NULL;
-        } else {
-            listAppendObject(program_list, new_object);
-            decrementReferenceCount(new_object);
-        }
-    }
-
-    return program_list;
-}
\ No newline at end of file
+/*
+ * Parser and Compiler Implementation
+ *
+ * Implements an iterative tokenizer/scanner that 
+ * converts ToyForth source text into a linear list of 
+ * executable objects (integers, resolved words).
+ * Scanning classifies bytes through one lookup table and tracks nothing
+ * but a pointer; line and column are recovered from it only when an error
+ * is reported.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "dictionary.h"
+#include "tforth.h"
+#include "mem.h"
+#include "list.h"
+#include "ops.h"
+#include "engine.h"
+
+
+/*
+ * Character classes of the tokenizer, indexed by byte
+ *
+ * The end of the text counts as a delimiter, so a token scan needs a
+ * single test per byte. Spaces are the "C" locale isspace() set.
+ */
+#define CHAR_SPACE 0x01
+#define CHAR_END   0x02
+#define CHAR_DIGIT 0x04
+#define CHAR_DELIMITER (CHAR_SPACE | CHAR_END)
+
+static const unsigned char char_class[256] = {
+    ['\0'] = CHAR_END,
+    [' '] = CHAR_SPACE, ['\t'] = CHAR_SPACE, ['\n'] = CHAR_SPACE,
+    ['\v'] = CHAR_SPACE, ['\f'] = CHAR_SPACE, ['\r'] = CHAR_SPACE,
+    ['0'] = CHAR_DIGIT, ['1'] = CHAR_DIGIT, ['2'] = CHAR_DIGIT, ['3'] = CHAR_DIGIT,
+    ['4'] = CHAR_DIGIT, ['5'] = CHAR_DIGIT, ['6'] = CHAR_DIGIT, ['7'] = CHAR_DIGIT,
+    ['8'] = CHAR_DIGIT, ['9'] = CHAR_DIGIT
+};
+
+/*
+ * charIs() - Tells whether a byte belongs to any of the given classes
+ */
+static inline bool charIs(char c, unsigned char classes) {
+    return (char_class[(unsigned char)c] & classes) != 0;
+}
+
+
+/*
+ * parserPeek() implementation
+ *
+ * Returns the current character without advancing the parser state.
+ */
+char parserPeek(tfparser *parser) {
+    return *parser->program;
+}
+
+
+/*
+ * parserAdvance() implementation
+ *
+ * Moves the parser forward by one character. Positions are only turned
+ * into line/column by parserPosition(), so there is nothing to update.
+ */
+void parserAdvance(tfparser *parser) {
+    if (parserPeek(parser) == '\0') return;
+    parser->program++;
+}
+
+
+/*
+ * parserSkipWhiteSpace() implementation
+ *
+ * Advances past whitespace characters (space, tab, newline, etc.)
+ * until a non-whitespace character or EOF is encountered.
+ */
+void parserSkipWhiteSpace(tfparser *parser) {
+    char *p = parser->program;
+
+    while (charIs(*p, CHAR_SPACE)) p++;
+    parser->program = p;
+}
+
+
+/*
+ * parserPosition() implementation
+ *
+ * Counts newlines from the start of the text. Only called on the way to
+ * an error message, so it is fine for it to be linear.
+ */
+void parserPosition(const tfparser *parser, const char *at, int *line, int *column) {
+    const char *line_start = parser->text;
+
+    *line = 1;
+    for (const char *p = parser->text; p < at; p++) {
+        if (*p == '\n') {
+            (*line)++;
+            line_start = p + 1;
+        }
+    }
+    *column = (int)(at - line_start) + 1;
+}
+
+
+/*
+ * parseNumber() implementation
+ *
+ * Parses a base-10 integer literal (with optional leading '-' sign),
+ * accumulating the digits in the same pass that scans them. A literal out
+ * of the int64_t range is rejected rather than saturated, so it is
+ * reported as a syntax error.
+ */
+tfobj *parseNumber(tfparser *parser) {
+    char *p = parser->program;
+    bool negative = *p == '-';
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t magnitude = 0;
+    bool overflow = false;
+
+    if (negative) p++;
+    while (charIs(*p, CHAR_DIGIT)) {
+        uint64_t digit = (uint64_t)(*p++ - '0');
+        overflow |= magnitude > (limit - digit) / 10;
+        magnitude = magnitude * 10 + digit;
+    }
+    parser->program = p;
+    if (overflow) return NULL;
+
+    int64_t value = !negative ? (int64_t)magnitude
+                  : magnitude == 0 ? 0
+                  : -(int64_t)(magnitude - 1) - 1;
+    return createIntegerObject(value);
+}
+
+
+/*
+ * readSymbol() - Reads the next whitespace-delimited token as a symbol
+ *
+ * No dictionary lookup is performed; used for word names and definitions.
+ * Returns the interned symbol, so repeated words share one object. A
+ * speculative parser shares the intern table with other threads, so it
+ * only finds symbols and returns NULL for a name never seen before,
+ * which cannot be a known word.
+ */
+static tfobj *readSymbol(tfparser *parser) {
+    char *start = parser->program;
+    char *end = start;
+
+    while (!charIs(*end, CHAR_DELIMITER)) end++;
+    parser->program = end;
+
+    size_t len_symbol = end - start;
+    return parser->speculative ? findSymbol(start, len_symbol) : internSymbol(start, len_symbol);
+}
+
+
+/*
+ * bindWord() - Compiles a use of an ordinary dictionary word
+ *
+ * Primitives become a word bound to their function pointer, user-defined
+ * words a call bound to the callee's program list.
+ */
+static tfobj *bindWord(tfobj *symbol, tfentry *entry) {
+    return entry->body != NULL
+        ? createOperandWordObject(callWordBody, symbol, entry->body)
+        : createWordObject(entry->op, symbol);
+}
+
+
+/*
+ * parseSymbol() implementation
+ *
+ * Parses a Forth word/symbol name (sequence of non-whitespace characters).
+ * Looks up the parsed name in the dictionary once and binds it. Returns
+ * NULL for unknown symbols and for control words, which only make sense
+ * inside compileWords().
+ */
+tfobj *parseSymbol(tfparser *parser) {
+    tfobj *symbol = readSymbol(parser);
+
+    tfentry *entry = symbol != NULL ? lookupWord(symbol) : NULL;
+    tfobj *new_object = entry != NULL && entry->control == TF_CONTROL_NONE
+        ? bindWord(symbol, entry)
+        : NULL;
+
+    /* The word now holds the only reference to its symbol */
+    decrementReferenceCount(symbol);
+
+    return new_object;
+}
+
+
+/*
+ * atSingleCharToken() - Tells whether the next token is exactly the given character
+ */
+static bool atSingleCharToken(tfparser *parser, char c) {
+    return parserPeek(parser) == c && charIs(parser->program[1], CHAR_DELIMITER);
+}
+
+
+/*
+ * isNumberStart() - Tells whether the parser is at an integer literal
+ */
+static bool isNumberStart(tfparser *parser) {
+    char c = parserPeek(parser);
+    return charIs(c, CHAR_DIGIT) || (c == '-' && charIs(parser->program[1], CHAR_DIGIT));
+}
+
+
+/*
+ * isStringStart() - Tells whether the parser is at a string literal (s")
+ */
+static bool isStringStart(tfparser *parser) {
+    return parser->program[0] == 's' && parser->program[1] == '"' && charIs(parser->program[2], CHAR_SPACE);
+}
+
+
+/*
+ * parseString() - Parses a string literal: s" text"
+ *
+ * The single delimiter after s" is skipped and the text runs up to the
+ * next double quote, which needs no delimiter after it. The bytes are
+ * copied once, here; every later substring shares them. Returns NULL if
+ * the closing quote is missing.
+ */
+static tfobj *parseString(tfparser *parser) {
+    char *start = parser->program + 3;
+    char *end = strchr(start, '"');
+
+    if (end == NULL) return NULL;
+    parser->program = end + 1;
+
+    return createStringObject(start, (size_t)(end - start));
+}
+
+
+/*
+ * syntaxError() - Reports a syntax error at the given position of the text
+ *
+ * Always returns false, so callers can "return syntaxError(...)". A
+ * speculative parser reports nothing: its chunk is compiled again
+ * serially, which reports the error if there is one.
+ */
+static bool syntaxError(const tfparser *parser, const char *at) {
+    int line, column;
+    if (parser->speculative) return false;
+    parserPosition(parser, at, &line, &column);
+    fprintf(stderr, "Syntax error. Check line %d column %d.\n", line, column);
+    return false;
+}
+
+
+/*
+ * underflowError() - Reports a statically detected stack underflow
+ *
+ * Always returns false, like syntaxError().
+ */
+static bool underflowError(const tfparser *parser, const char *at) {
+    int line, column;
+    parserPosition(parser, at, &line, &column);
+    fprintf(stderr, "Stack underflow. Check line %d column %d.\n", line, column);
+    return false;
+}
+
+
+/*
+ * startAnalysis() - Resets an analysis to an empty (or relative) stack
+ */
+static void startAnalysis(tfanalysis *analysis, int relative) {
+    analysis->known = 1;
+    analysis->relative = relative;
+    analysis->depth = 0;
+    analysis->lowest = 0;
+    analysis->highest = 0;
+}
+
+
+/*
+ * objectEffect() - Returns the stack effect of a freshly compiled object
+ *
+ * Literals push one item; words have the effect recorded in their
+ * dictionary entry. dup on an empty stack is a no-op at runtime, so it is
+ * one too when the analysis knows the real stack is empty.
+ */
+static tfeffect objectEffect(tfobj *object, const tfanalysis *analysis) {
+    tfeffect effect = {0, 1, 1};
+
+    if (getObjectType(object) == TF_OBJ_WORD) {
+        effect = lookupWord(object->word_obj.symbol)->effect;
+
+        if (object->word_obj.operand == NULL && object->word_obj.op == operationDup &&
+            !analysis->relative && analysis->depth == 0) {
+            effect.in = effect.out = effect.peak = 0;
+        }
+    }
+
+    return effect;
+}
+
+
+/*
+ * applyEffect() - Advances the simulated stack past one compiled object
+ *
+ * Returns false (after reporting it) if the object would underflow the
+ * real stack at top level.
+ */
+static bool applyEffect(tfanalysis *analysis, tfeffect effect, const tfparser *parser, const char *at) {
+    if (!analysis->known) return true;
+
+    if (effect.in == TF_EFFECT_UNKNOWN) {
+        analysis->known = 0;
+        return true;
+    }
+
+    long entry = analysis->depth - effect.in;
+    if (entry < 0 && !analysis->relative) return underflowError(parser, at);
+
+    if (entry < analysis->lowest) analysis->lowest = entry;
+    if (analysis->depth + effect.peak > analysis->highest) analysis->highest = analysis->depth + effect.peak;
+    analysis->depth = entry + effect.out;
+    if (analysis->depth > analysis->highest) analysis->highest = analysis->depth;
+
+    return true;
+}
+
+
+/*
+ * bodyEffect() - Turns the relative analysis of a body into its stack effect
+ */
+static tfeffect bodyEffect(const tfanalysis *analysis) {
+    tfeffect effect = {TF_EFFECT_UNKNOWN, 0, 0};
+
+    if (analysis->known) {
+        effect.in = (int)-analysis->lowest;
+        effect.out = (int)(analysis->depth - analysis->lowest);
+        effect.peak = (int)analysis->highest;
+    }
+
+    return effect;
+}
+
+
+/*
+ * joinAnalysis() - Merges the analysis of two paths meeting at one point
+ *
+ * The depth stays known only if both paths agree on it.
+ */
+static void joinAnalysis(tfanalysis *into, const tfanalysis *other) {
+    into->known = into->known && other->known && into->depth == other->depth;
+    if (other->lowest < into->lowest) into->lowest = other->lowest;
+    if (other->highest > into->highest) into->highest = other->highest;
+}
+
+
+/*
+ * closeLoop() - Checks the analysis of a loop body when branching back
+ *
+ * A body that changes the depth makes it depend on the trip count, which
+ * is only known at runtime.
+ */
+static void closeLoop(tfanalysis *analysis, const tfanalysis *start) {
+    if (analysis->depth != start->depth) analysis->known = 0;
+}
+
+
+/*
+ * ControlFrame - A control structure opened but not closed yet
+ */
+typedef struct {
+    TF_CONTROL kind;            /* Last word seen: if, else, begin or do */
+    size_t index;               /* Branch to patch (if/else) or loop start (begin/do) */
+    const char *at;             /* Position of the opening word, for diagnostics */
+    tfanalysis saved;           /* Analysis of the other path (if/else) or at the loop start */
+} ControlFrame;
+
+/*
+ * ControlStack - Open control structures of one compileWords() call, innermost last
+ */
+typedef struct {
+    ControlFrame *frame;
+    size_t len;
+    size_t capacity;
+} ControlStack;
+
+
+/*
+ * pushFrame() - Opens a control structure at the given position
+ */
+static void pushFrame(ControlStack *frames, TF_CONTROL kind, size_t index,
+                      const char *at, const tfanalysis *analysis) {
+    if (frames->len == frames->capacity) {
+        frames->capacity = frames->capacity ? frames->capacity * 2 : 8;
+        frames->frame = wrealloc(frames->frame, sizeof(ControlFrame) * frames->capacity);
+    }
+
+    ControlFrame *frame = &frames->frame[frames->len++];
+    frame->kind = kind;
+    frame->index = index;
+    frame->at = at;
+    frame->saved = *analysis;
+}
+
+
+/*
+ * topFrame() - Returns the innermost open structure if it was opened by kind
+ */
+static ControlFrame *topFrame(ControlStack *frames, TF_CONTROL kind) {
+    if (frames->len == 0 || frames->frame[frames->len - 1].kind != kind) return NULL;
+    return &frames->frame[frames->len - 1];
+}
+
+
+/*
+ * emitBranch() - Appends a branch object to a program list
+ */
+static void emitBranch(tfobj *list, TF_BRANCH_KIND kind, tfobj *symbol, size_t target) {
+    tfobj *branch = createBranchObject(kind, symbol);
+    branch->branch_obj.target = target;
+    listAppendObject(list, branch);
+    decrementReferenceCount(branch);
+}
+
+
+/*
+ * compileControl() - Compiles one control word
+ *
+ * Forward branches are emitted with a placeholder target and patched by
+ * the word closing the structure; backward branches get their target
+ * straight from the frame. Words closing nothing, or the wrong thing,
+ * are syntax errors at their own position.
+ */
+static bool compileControl(const tfparser *parser, tfobj *list, tfanalysis *analysis, ControlStack *frames,
+                           tfentry *entry, tfobj *symbol, const char *at) {
+    static const tfeffect pop_flag = {1, 0, 0};
+    tfobj **element = list->list_obj.element;
+    ControlFrame *frame;
+
+    switch (entry->control) {
+    case TF_CONTROL_IF:
+        if (!applyEffect(analysis, pop_flag, parser, at)) return false;
+        pushFrame(frames, TF_CONTROL_IF, list->list_obj.len, at, analysis);
+        emitBranch(list, TF_BRANCH_IF_FALSE, symbol, 0);
+        return true;
+
+    case TF_CONTROL_ELSE: {
+        if ((frame = topFrame(frames, TF_CONTROL_IF)) == NULL) return syntaxError(parser, at);
+        emitBranch(list, TF_BRANCH_ALWAYS, symbol, 0);
+        element = list->list_obj.element;
+        element[frame->index]->branch_obj.target = list->list_obj.len;
+
+        /* Continue on the false path; remember where the true part ended */
+        tfanalysis true_end = *analysis;
+        *analysis = frame->saved;
+        if (true_end.lowest < analysis->lowest) analysis->lowest = true_end.lowest;
+        if (true_end.highest > analysis->highest) analysis->highest = true_end.highest;
+        frame->saved = true_end;
+        frame->kind = TF_CONTROL_ELSE;
+        frame->index = list->list_obj.len - 1;
+        return true;
+    }
+
+    case TF_CONTROL_THEN:
+        if ((frame = topFrame(frames, TF_CONTROL_IF)) == NULL &&
+            (frame = topFrame(frames, TF_CONTROL_ELSE)) == NULL) {
+            return syntaxError(parser, at);
+        }
+        element[frame->index]->branch_obj.target = list->list_obj.len;
+        joinAnalysis(analysis, &frame->saved);
+        frames->len--;
+        return true;
+
+    case TF_CONTROL_BEGIN:
+        pushFrame(frames, TF_CONTROL_BEGIN, list->list_obj.len, at, analysis);
+        return true;
+
+    case TF_CONTROL_UNTIL:
+        if ((frame = topFrame(frames, TF_CONTROL_BEGIN)) == NULL) return syntaxError(parser, at);
+        if (!applyEffect(analysis, pop_flag, parser, at)) return false;
+        emitBranch(list, TF_BRANCH_IF_FALSE, symbol, frame->index);
+        closeLoop(analysis, &frame->saved);
+        frames->len--;
+        return true;
+
+    case TF_CONTROL_DO: {
+        tfobj *word = bindWord(symbol, entry);
+        bool ok = applyEffect(analysis, objectEffect(word, analysis), parser, at);
+        if (ok) {
+            listAppendObject(list, word);
+            pushFrame(frames, TF_CONTROL_DO, list->list_obj.len, at, analysis);
+        }
+        decrementReferenceCount(word);
+        return ok;
+    }
+
+    case TF_CONTROL_LOOP:
+        if ((frame = topFrame(frames, TF_CONTROL_DO)) == NULL) return syntaxError(parser, at);
+        emitBranch(list, TF_BRANCH_LOOP, symbol, frame->index);
+        closeLoop(analysis, &frame->saved);
+        frames->len--;
+        return true;
+
+    default:
+        return syntaxError(parser, at);
+    }
+}
+
+
+static bool compileWords(tfparser *parser, tfobj *list, tfanalysis *analysis,
+                         const char *def_at, size_t max_objects);
+
+
+/*
+ * parseDefinition() - Compiles ": name ... ;" into the dictionary
+ *
+ * The parser is positioned at ':' (at). The body is compiled
+ * into its own program list and bound to the name, together with the
+ * stack effect computed while compiling it; the definition itself emits
+ * no code.
+ */
+static bool parseDefinition(tfparser *parser, const char *at) {
+    parserAdvance(parser);
+    parserSkipWhiteSpace(parser);
+
+    if (parserPeek(parser) == '\0' || isNumberStart(parser) ||
+        atSingleCharToken(parser, ':') || atSingleCharToken(parser, ';')) {
+        return syntaxError(parser, at);
+    }
+
+    tfobj *name = readSymbol(parser);
+    tfobj *body = createListObject();
+    tfanalysis analysis;
+    startAnalysis(&analysis, 1);
+    bool ok = compileWords(parser, body, &analysis, at, SIZE_MAX);
+
+    if (ok) defineWord(name, body, bodyEffect(&analysis));
+
+    decrementReferenceCount(name);
+    decrementReferenceCount(body);
+    return ok;
+}
+
+
+/*
+ * compileTokens() - Body of compileWords(), with its open control structures
+ */
+static bool compileTokens(tfparser *parser, tfobj *list, tfanalysis *analysis, ControlStack *frames,
+                          const char *def_at, size_t max_objects) {
+    bool in_definition = def_at != NULL;
+
+    /* A batch never ends inside a control structure: its branches must resolve */
+    while (list->list_obj.len < max_objects || frames->len > 0) {
+        tfobj *new_object = NULL; 
+        parserSkipWhiteSpace(parser);
+        const char *at = parser->program;
+        char c = parserPeek(parser);
+        ControlFrame *open = frames->len > 0 ? &frames->frame[frames->len - 1] : NULL;
+
+        if (!in_definition && open == NULL && parser->stop != NULL && at >= parser->stop) {
+            return true;
+        }
+
+        if (c == '\0') {
+            if (open != NULL) return syntaxError(parser, open->at);
+            return in_definition ? syntaxError(parser, def_at) : true;
+        }
+
+        if (atSingleCharToken(parser, ';')) {
+            if (!in_definition) return syntaxError(parser, at);
+            if (open != NULL) return syntaxError(parser, open->at);
+            parserAdvance(parser);
+            return true;
+        }
+
+        if (atSingleCharToken(parser, ':')) {
+            /* Definitions do not nest, nor sit inside control structures */
+            if (in_definition || open != NULL) return syntaxError(parser, at);
+            /* Workers never define words: the dictionary is shared */
+            if (parser->speculative) return syntaxError(parser, at);
+            if (!parseDefinition(parser, at)) return false;
+            continue;
+        }
+
+        if (isNumberStart(parser)) {
+            new_object = parseNumber(parser);
+        } else if (isStringStart(parser)) {
+            new_object = parseString(parser);
+        } else {
+            tfobj *symbol = readSymbol(parser);
+            tfentry *entry = symbol != NULL ? lookupWord(symbol) : NULL;
+
+            if (entry != NULL && entry->control != TF_CONTROL_NONE) {
+                bool ok = compileControl(parser, list, analysis, frames, entry, symbol, at);
+                decrementReferenceCount(symbol);
+                if (!ok) return false;
+                continue;
+            }
+
+            new_object = entry != NULL ? bindWord(symbol, entry) : NULL;
+            decrementReferenceCount(symbol);
+        }
+
+        if (new_object == NULL) {
+            return syntaxError(parser, at);
+        }
+
+        if (!applyEffect(analysis, objectEffect(new_object, analysis), parser, at)) {
+            decrementReferenceCount(new_object);
+            return false;
+        }
+
+        listAppendObject(list, new_object);
+        decrementReferenceCount(new_object);
+    }
+
+    return true;
+}
+
+
+/*
+ * compileWords() - Compiles tokens into a program list
+ *
+ * At top level (def_at == NULL) compiles until the end of input, or until
+ * list holds max_objects objects and no control structure is open. Inside
+ * a definition compiles until the closing ';' and reports a missing one at
+ * the position of the opening ':' (def_at); a structure left
+ * open is reported at the word that opened it. Every object is run through
+ * analysis, so static underflows are reported at the position of the
+ * offending token.
+ */
+static bool compileWords(tfparser *parser, tfobj *list, tfanalysis *analysis,
+                         const char *def_at, size_t max_objects) {
+    ControlStack frames = {NULL, 0, 0};
+
+    bool ok = compileTokens(parser, list, analysis, &frames, def_at, max_objects);
+
+    free(frames.frame);
+    return ok;
+}
+
+
+/*
+ * parserInit() implementation
+ */
+void parserInit(tfparser *parser, char *program_text) {
+    parser->text = program_text;
+    parser->program = program_text;
+    startAnalysis(&parser->analysis, 0);
+    parser->stop = NULL;
+    parser->speculative = 0;
+}
+
+
+/*
+ * compileBatch() implementation
+ *
+ * Resumes top-level compilation where the previous batch stopped. Each
+ * definition is compiled whole, however long, and does not count against
+ * the batch, so a batch holds only top-level program objects.
+ */
+tfobj *compileBatch(tfparser *parser, size_t max_objects) {
+    tfobj *batch = createListObject();
+
+    if (!compileWords(parser, batch, &parser->analysis, NULL, max_objects)) {
+        decrementReferenceCount(batch);
+        return NULL;
+    }
+
+    return batch;
+}
+
+
+/*
+ * compile() implementation
+ *
+ * Main entry point for the compilation phase. Tokenizes the input program
+ * text and produces a list of compiled objects (integers, strings, words). Performs
+ * basic validation by ensuring all symbols are known words, and binds
+ * each word to its implementation so execution never searches the dictionary.
+ * Definitions (": name ... ;") are compiled into the dictionary.
+ *
+ * Returns NULL on syntax error (prints diagnostic message to stderr).
+ */
+tfobj *compile(char *program_txt) {
+    tfparser parser;
+    parserInit(&parser, program_txt);
+
+    return compileBatch(&parser, SIZE_MAX);
+}
+
+
+/*
+ * Chunk - A run of whole lines compiled on its own by compileParallel()
+ */
+typedef struct {
+    char *start;                    /* First byte; every chunk but the first follows a '\n' */
+    tfobj *list;                    /* Compiled objects, or NULL if the chunk did not compile */
+    tfanalysis analysis;            /* Relative analysis of the chunk */
+} Chunk;
+
+/*
+ * ChunkWorker - A thread of compileParallel() and its share of the chunks
+ */
+typedef struct {
+    pthread_t thread;
+    char *text;                     /* Whole text, for parserInit() */
+    Chunk *chunks;
+    size_t first;                   /* Compiles chunks first, first + step, ... */
+    size_t step;
+    size_t count;
+} ChunkWorker;
+
+
+/*
+ * compileChunk() - Compiles one chunk speculatively, ended by a '\0'
+ *
+ * The analysis is relative, as in a definition, because the depth the
+ * chunk starts at is not known until the chunks before it are merged.
+ */
+static void compileChunk(char *text, Chunk *chunk) {
+    tfparser parser;
+    parserInit(&parser, text);
+    parser.program = chunk->start;
+    parser.speculative = 1;
+    startAnalysis(&parser.analysis, 1);
+
+    chunk->list = createListObject();
+    if (!compileWords(&parser, chunk->list, &parser.analysis, NULL, SIZE_MAX)) {
+        decrementReferenceCount(chunk->list);
+        chunk->list = NULL;
+    }
+    chunk->analysis = parser.analysis;
+}
+
+
+/*
+ * chunkWorkerMain() - Body of every compileParallel() thread
+ *
+ * Each thread allocates from the pool of a context of its own; freeing
+ * the context only orphans the pool while the compiled objects live.
+ */
+static void *chunkWorkerMain(void *argument) {
+    ChunkWorker *worker = argument;
+    tfcontext *context = createContext();
+
+    for (size_t i = worker->first; i < worker->count; i += worker->step) {
+        compileChunk(worker->text, &worker->chunks[i]);
+    }
+
+    freeContext(context);
+    return NULL;
+}
+
+
+/*
+ * mergeChunk() - Appends a compiled chunk to the program, if it is valid there
+ *
+ * The relative analysis of a chunk equals the serial one, shifted by the
+ * depth the chunk starts at, unless the chunk got below that depth: that
+ * is a static underflow, or a dup on an empty stack, which the relative
+ * analysis cannot tell apart. Returns false, leaving the chunk's list
+ * alone, if the chunk failed or went that low; otherwise moves its
+ * objects to the end of the program and retargets its branches.
+ */
+static bool mergeChunk(tfobj *program, tfanalysis *analysis, Chunk *chunk) {
+    tfobj *list = chunk->list;
+    const tfanalysis *relative = &chunk->analysis;
+
+    if (list == NULL) return false;
+
+    if (analysis->known) {
+        if (analysis->depth + relative->lowest < 0) return false;
+        if (analysis->depth + relative->highest > analysis->highest) {
+            analysis->highest = analysis->depth + relative->highest;
+        }
+        analysis->known = relative->known;
+        analysis->depth += relative->depth;
+    }
+
+    size_t offset = program->list_obj.len;
+    size_t len = list->list_obj.len;
+    listReserve(program, offset + len);
+
+    for (size_t i = 0; i < len; i++) {
+        tfobj *object = list->list_obj.element[i];
+        if (getObjectType(object) == TF_OBJ_BRANCH) object->branch_obj.target += offset;
+        program->list_obj.element[offset + i] = object;
+    }
+    program->list_obj.len += len;
+
+    /* The program now owns the objects */
+    list->list_obj.len = 0;
+    decrementReferenceCount(list);
+    chunk->list = NULL;
+    return true;
+}
+
+
+/*
+ * lastDefinitionEnd() - Returns the position just past the last ';' token
+ *
+ * Returns text if there is none. A ';' inside a string literal counts
+ * too, which only moves the position later than needed.
+ */
+static char *lastDefinitionEnd(char *text, char *end) {
+    for (char *p = end - 1; p >= text; p--) {
+        if (*p == ';' && charIs(p[1], CHAR_DELIMITER) && (p == text || charIs(p[-1], CHAR_SPACE))) {
+            return p + 1;
+        }
+    }
+
+    return text;
+}
+
+
+/*
+ * splitChunks() - Cuts a text into up to count chunks of whole lines
+ *
+ * Every cut is at the start of a line, starting the search for it at an
+ * even share of the text. Returns the number of chunks made, which is
+ * smaller when lines are long.
+ */
+static size_t splitChunks(char *text, char *end, Chunk *chunks, size_t count) {
+    size_t len = (size_t)(end - text);
+    size_t made = 1;
+
+    chunks[0].start = text;
+    for (size_t i = 1; i < count; i++) {
+        char *from = text + len / count * i;
+        if (from <= chunks[made - 1].start) continue;
+
+        char *newline = memchr(from, '\n', (size_t)(end - from));
+        if (newline == NULL) break;
+        if (newline + 1 < end) chunks[made++].start = newline + 1;
+    }
+
+    return made;
+}
+
+
+/*
+ * compileParallel() implementation
+ *
+ * Definitions are compiled first, serially: the text up to the first
+ * top-level token past the last ';' token is compiled as usual. Nothing
+ * after that can define a word, so the dictionary stays unchanged while
+ * the rest is cut into chunks at line starts, each terminated by
+ * overwriting the newline before the next one with a '\0', and compiled
+ * on the worker threads.
+ *
+ * A chunk that compiles speculatively consists of the same tokens the
+ * serial compiler would see, since each cut is a delimiter and a token
+ * running across it (a string literal) or a structure left open fails
+ * the chunk. The chunks are merged in order; from the first one that
+ * failed or could not be merged, the original text is compiled serially,
+ * which also reports the error at its line and column, if there is one.
+ */
+tfobj *compileParallel(tfparser *parser, unsigned int workers, size_t chunk_size) {
+    char *end = parser->program + strlen(parser->program);
+
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (unsigned int)cpus : 1;
+    }
+    if (chunk_size == 0) chunk_size = 1;
+    if (workers < 2 || (size_t)(end - parser->program) / chunk_size < 2) {
+        return compileBatch(parser, SIZE_MAX);
+    }
+
+    parser->stop = lastDefinitionEnd(parser->program, end);
+    tfobj *program = compileBatch(parser, SIZE_MAX);
+    parser->stop = NULL;
+    if (program == NULL) return NULL;
+
+    size_t count = (size_t)(end - parser->program) / chunk_size;
+    Chunk *chunks = wmalloc(sizeof(Chunk) * (count > 0 ? count : 1));
+    if (count >= 2) count = splitChunks(parser->program, end, chunks, count);
+    if (count < 2) count = 0;
+
+    if (count > 0) {
+        if (workers > count) workers = (unsigned int)count;
+        ChunkWorker *pool = wmalloc(sizeof(ChunkWorker) * workers);
+
+        /* The workers only read the dictionary and the intern table */
+        freezeDictionary();
+        for (size_t i = 1; i < count; i++) chunks[i].start[-1] = '\0';
+
+        for (unsigned int w = 0; w < workers; w++) {
+            pool[w].text = parser->text;
+            pool[w].chunks = chunks;
+            pool[w].first = w;
+            pool[w].step = workers;
+            pool[w].count = count;
+            if (pthread_create(&pool[w].thread, NULL, chunkWorkerMain, &pool[w]) != 0) {
+                fprintf(stderr, "Error. Couldn't start compiler thread %u.\n", w);
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (unsigned int w = 0; w < workers; w++) {
+            pthread_join(pool[w].thread, NULL);
+        }
+
+        for (size_t i = 1; i < count; i++) chunks[i].start[-1] = '\n';
+        free(pool);
+    }
+
+    size_t merged = 0;
+    while (merged < count && mergeChunk(program, &parser->analysis, &chunks[merged])) merged++;
+
+    if (merged < count) parser->program = chunks[merged].start;
+    for (size_t i = merged; i < count; i++) decrementReferenceCount(chunks[i].list);
+    free(chunks);
+
+    if (count > 0 && merged == count) {
+        parser->program = end;
+        return program;
+    }
+
+    if (!compileWords(parser, program, &parser->analysis, NULL, SIZE_MAX)) {
+        decrementReferenceCount(program);
+        return NULL;
+    }
+    return program;
+}
+
+
+/*
+ * branchTargets() - Flags every index a branch of the program jumps to
+ *
+ * Returns a zeroed array of len + 1 flags (targets may be len, the end of
+ * the program), or NULL if the program has no branches, so the passes can
+ * skip all target bookkeeping for straight-line code.
+ */
+static bool *branchTargets(tfobj *program_list) {
+    size_t len = program_list->list_obj.len;
+    tfobj **element = program_list->list_obj.element;
+    bool *target = NULL;
+
+    for (size_t i = 0; i < len; i++) {
+        if (getObjectType(element[i]) != TF_OBJ_BRANCH) continue;
+        if (target == NULL) {
+            target = wmalloc(sizeof(bool) * (len + 1));
+            memset(target, 0, sizeof(bool) * (len + 1));
+        }
+        target[element[i]->branch_obj.target] = true;
+    }
+
+    return target;
+}
+
+
+/*
+ * retargetBranches() - Rewrites branch targets after a pass moved objects
+ *
+ * remap gives the new index of every old branch target.
+ */
+static void retargetBranches(tfobj **element, size_t len, const size_t *remap) {
+    for (size_t i = 0; i < len; i++) {
+        if (getObjectType(element[i]) == TF_OBJ_BRANCH) {
+            element[i]->branch_obj.target = remap[element[i]->branch_obj.target];
+        }
+    }
+}
+
+
+/*
+ * foldWord() - Applies a pure primitive to the simulated literal stack
+ *
+ * Only the primitives listed here are folded, and only when the simulated
+ * stack holds every operand as an integer literal and the operation cannot
+ * fail. Anything else (underflow into runtime values, zero divisors) is left
+ * for the engine, so diagnostics are reported at runtime exactly as before.
+ *
+ * Returns true if the word was folded into the simulated stack.
+ */
+static bool foldWord(Operation op, tfobj **sim, size_t *depth) {
+    size_t d = *depth;
+
+    if (op == operationDup || op == operationDrop || op == operationSquare) {
+        if (d < 1) return false;
+    } else if (op == operationSwap || op == operationAdd || op == operationSub ||
+               op == operationMul || op == operationDiv || op == operationSwapSub) {
+        if (d < 2) return false;
+    } else {
+        return false;
+    }
+
+    if (op == operationDup) {
+        sim[d] = sim[d - 1];
+        incrementReferenceCount(sim[d]);
+        *depth = d + 1;
+        return true;
+    }
+    if (op == operationDrop) {
+        decrementReferenceCount(sim[d - 1]);
+        *depth = d - 1;
+        return true;
+    }
+    if (op == operationSwap) {
+        tfobj *top = sim[d - 1];
+        sim[d - 1] = sim[d - 2];
+        sim[d - 2] = top;
+        return true;
+    }
+    /* Overflows are left for the runtime to report, like division by zero */
+    if (op == operationSquare) {
+        int64_t a = getObjectNumber(sim[d - 1]);
+        int64_t result;
+        if (__builtin_mul_overflow(a, a, &result)) return false;
+        decrementReferenceCount(sim[d - 1]);
+        sim[d - 1] = createIntegerObject(result);
+        return true;
+    }
+
+    int64_t a = getObjectNumber(sim[d - 2]);
+    int64_t b = getObjectNumber(sim[d - 1]);
+    int64_t result;
+    bool overflow;
+
+    if (op == operationAdd) overflow = __builtin_add_overflow(a, b, &result);
+    else if (op == operationSub) overflow = __builtin_sub_overflow(a, b, &result);
+    else if (op == operationMul) overflow = __builtin_mul_overflow(a, b, &result);
+    else if (op == operationSwapSub) overflow = __builtin_sub_overflow(b, a, &result);
+    else if (b == 0 || (b == -1 && a == INT64_MIN)) return false;
+    else {
+        overflow = false;
+        result = a / b;
+    }
+    if (overflow) return false;
+
+    decrementReferenceCount(sim[d - 2]);
+    decrementReferenceCount(sim[d - 1]);
+    sim[d - 2] = createIntegerObject(result);
+    *depth = d - 1;
+    return true;
+}
+
+
+/*
+ * foldConstants() implementation
+ *
+ * Walks the program once, keeping a simulated stack of literals that have
+ * not been emitted yet. Foldable words operate on it; any other object
+ * first flushes the pending literals, in order, then is emitted unchanged.
+ * Branches are never folded, and branch targets flush the pending
+ * literals too, since other paths join the code there. Each object adds
+ * at most one literal, so the simulated stack never exceeds the program
+ * length.
+ */
+void foldConstants(tfobj *program_list) {
+    if (program_list == NULL) return;
+
+    size_t len = program_list->list_obj.len;
+    tfobj **element = program_list->list_obj.element;
+    tfobj **sim = wmalloc(sizeof(tfobj *) * (len + 1));
+    tfobj **folded = wmalloc(sizeof(tfobj *) * (len + 1));
+    bool *target = branchTargets(program_list);
+    size_t *remap = target != NULL ? wmalloc(sizeof(size_t) * (len + 1)) : NULL;
+    size_t depth = 0, out = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        tfobj *object = element[i];
+
+        if (target != NULL && target[i]) {
+            memcpy(folded + out, sim, sizeof(tfobj *) * depth);
+            out += depth;
+            depth = 0;
+            remap[i] = out;
+        }
+
+        if (getObjectType(object) == TF_OBJ_INT) {
+            /* The simulated stack takes over the list's reference */
+            sim[depth++] = object;
+            continue;
+        }
+
+        if (getObjectType(object) == TF_OBJ_WORD && object->word_obj.operand == NULL &&
+            foldWord(object->word_obj.op, sim, &depth)) {
+            decrementReferenceCount(object);
+            continue;
+        }
+
+        memcpy(folded + out, sim, sizeof(tfobj *) * depth);
+        out += depth;
+        depth = 0;
+        folded[out++] = object;
+    }
+
+    memcpy(folded + out, sim, sizeof(tfobj *) * depth);
+    out += depth;
+
+    if (target != NULL) {
+        remap[len] = out;
+        retargetBranches(folded, out, remap);
+        free(target);
+        free(remap);
+    }
+
+    /* References moved from the old array to the folded one unchanged */
+    free(sim);
+    free(program_list->list_obj.element);
+    program_list->list_obj.element = folded;
+    program_list->list_obj.capacity = len + 1;
+    program_list->list_obj.len = out;
+}
+
+
+/*
+ * FusionRule - An adjacent word pair rewritten into one superinstruction
+ *
+ * A NULL first word matches any integer literal, which becomes the inline
+ * operand of the fused word. Fused names are internal and never in the
+ * dictionary, so programs cannot name the fused words directly.
+ */
+typedef struct {
+    const char *first;      /* First word, or NULL for an integer literal */
+    const char *second;     /* Word executed right after it */
+    const char *fused;      /* Internal name of the replacement */
+} FusionRule;
+
+static const FusionRule fusion_rules[] = {
+    {NULL, "+", "(lit+)"},
+    {NULL, "-", "(lit-)"},
+    {NULL, "*", "(lit*)"},
+    {NULL, "/", "(lit/)"},
+    {"dup", "*", "(dup*)"},
+    {"swap", "-", "(swap-)"},
+    {"dup", ".", "(dup.)"}
+};
+
+#define FUSION_RULE_COUNT (sizeof(fusion_rules) / sizeof(fusion_rules[0]))
+
+
+/*
+ * isPlainWord() - Tells whether an object is a word bound to a given primitive
+ */
+static bool isPlainWord(tfobj *object, Operation op) {
+    return getObjectType(object) == TF_OBJ_WORD &&
+           object->word_obj.operand == NULL &&
+           object->word_obj.op == op;
+}
+
+
+/*
+ * fuseSuperinstructions() implementation
+ *
+ * Single greedy left-to-right pass: the first rule matching the pair at
+ * the current position wins, and fused words are not fused again. A pair
+ * whose second object is a branch target is left alone, since a jump must
+ * still land on it. The list is compacted in place.
+ */
+void fuseSuperinstructions(tfobj *program_list) {
+    if (program_list == NULL) return;
+
+    /* Rules are matched on the resolved primitives, not on names */
+    Operation first_ops[FUSION_RULE_COUNT];
+    Operation second_ops[FUSION_RULE_COUNT];
+    for (size_t r = 0; r < FUSION_RULE_COUNT; r++) {
+        first_ops[r] = fusion_rules[r].first ? lookupOperation(fusion_rules[r].first) : NULL;
+        second_ops[r] = lookupOperation(fusion_rules[r].second);
+    }
+
+    tfobj **element = program_list->list_obj.element;
+    size_t len = program_list->list_obj.len;
+    bool *target = branchTargets(program_list);
+    size_t *remap = target != NULL ? wmalloc(sizeof(size_t) * (len + 1)) : NULL;
+    size_t out = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        tfobj *object = element[i];
+        tfobj *fused = NULL;
+        bool fusable = i + 1 < len && (target == NULL || !target[i + 1]);
+
+        if (remap != NULL) remap[i] = out;
+
+        for (size_t r = 0; r < FUSION_RULE_COUNT && fusable; r++) {
+            const FusionRule *rule = &fusion_rules[r];
+
+            if (!isPlainWord(element[i + 1], second_ops[r])) continue;
+
+            if (rule->first == NULL && getObjectType(object) == TF_OBJ_INT) {
+                tfobj *symbol = internSymbol(rule->fused, strlen(rule->fused));
+                fused = createOperandWordObject(lookupOperandOperation(rule->fused), symbol, object);
+                decrementReferenceCount(symbol);
+            } else if (rule->first != NULL && isPlainWord(object, first_ops[r])) {
+                tfobj *symbol = internSymbol(rule->fused, strlen(rule->fused));
+                fused = createWordObject(lookupFusedOperation(rule->fused), symbol);
+                decrementReferenceCount(symbol);
+            }
+
+            if (fused != NULL) break;
+        }
+
+        if (fused != NULL) {
+            /* The list's references to the pair are replaced by the fused word */
+            decrementReferenceCount(element[i]);
+            decrementReferenceCount(element[i + 1]);
+            element[out++] = fused;
+            i++;
+        } else {
+            element[out++] = object;
+        }
+    }
+
+    if (target != NULL) {
+        remap[len] = out;
+        retargetBranches(element, out, remap);
+        free(target);
+        free(remap);
+    }
+
+    program_list->list_obj.len = out;
+}
+
+
+/*
+ * pinLiterals() implementation
+ *
+ * Words and branches are never refcounted while running; immediates need
+ * nothing. A body is pinned along with its literals, which also marks it
+ * as done: bodies are shared through the dictionary and may be called
+ * from many places.
+ */
+void pinLiterals(tfobj *program_list) {
+    if (program_list == NULL) return;
+
+    for (size_t i = 0; i < program_list->list_obj.len; i++) {
+        tfobj *object = program_list->list_obj.element[i];
+        TF_OBJ_TYPE type = getObjectType(object);
+
+        if (type == TF_OBJ_INT || type == TF_OBJ_BOOL || type == TF_OBJ_STR) {
+            pinObject(object);
+        } else if (type == TF_OBJ_WORD && object->word_obj.operand != NULL) {
+            tfobj *operand = object->word_obj.operand;
+
+            if (object->word_obj.operand_op != callWordBody) {
+                pinObject(operand);
+            } else if (operand->refcount != TF_REFCOUNT_PINNED) {
+                pinObject(operand);
+                pinLiterals(operand);
+            }
+        }
+    }
+}
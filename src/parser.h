@@ -1,104 +1,246 @@
-/*
- * Parser Module - Tokenization and Compilation
- *
- * Implements an iterative tokenizer/scanner that converts ToyForth source
- * text into a compiled linear list of executable objects (integers, symbols, etc.).
- * Maintains position tracking for human-friendly error reporting.
- */
-
-#ifndef PARSER_H
-#define PARSER_H
-
-#include "tforth.h"
-
-/*
- * parserPeek() - Returns the current character without advancing
- *
- * Returns the character at the parser's current position. Returns '\0' if
- * the parser has reached the end of the program text.
- *
- * Args:
- *   parser - Parser state to examine
- *
- * Returns:
- *   Current character or '\0' at end of input
- */
-char parserPeek(tfparser *parser);
-
-/*
- * parserAdvance() - Moves the parser forward by one character
- *
- * Updates the parser position and maintains line/column tracking for error
- * reporting. Handles newlines to correctly track line breaks. Safe no-op
- * when at end of input.
- *
- * Args:
- *   parser - Parser state to advance
- */
-void parserAdvance(tfparser *parser);
-
-/*
- * parserSkipWhiteSpace() - Skips all whitespace characters
- *
- * Advances the parser past spaces, tabs, newlines, and other isspace()
- * characters. Correctly updates line/column counters for newlines.
- *
- * Args:
- *   parser - Parser state to advance
- */
-void parserSkipWhiteSpace(tfparser *parser);
-
-
-/*
- * parseNumber() - Parses a base-10 integer literal
- *
- * Recognizes optional leading '-' sign followed by decimal digits. Uses
- * strtol() for parsing, handling overflow/underflow as per strtol semantics.
- * Advances the parser past all consumed characters.
- *
- * Args:
- *   parser - Parser positioned at first digit or '-' sign
- *
- * Returns:
- *   New TF_OBJ_INT with value from parsed decimal number (refcount=1)
- */
-tfobj *parseNumber(tfparser *parser);
-
-/*
- * parseSymbol() - Parses a Forth word/symbol name
- *
- * Reads characters until whitespace or end-of-input. The resulting string
- * is looked up in the operation dictionary; returns NULL if not found.
- * Advances the parser past the parsed symbol.
- *
- * Args:
- *   parser - Parser positioned at first character of symbol
- *
- * Returns:
- *   New TF_OBJ_SYMBOL if found in dictionary (refcount=1), or
- *   NULL if the symbol is not a known operation
- */
-tfobj *parseSymbol(tfparser *parser);
-
-
-/*
- * compile() - Compiles ToyForth source code into executable objects
- *
- * Tokenizes the input program text and produces a list of compiled objects
- * (integers, symbols, etc.). Performs basic syntax validation by checking
- * that each symbol is a known Forth operation.
- *
- * On successful compilation, returns a TF_OBJ_LIST containing the compiled
- * program with refcount=1. On syntax error, prints error location and
- * returns NULL.
- *
- * Args:
- *   program_text - NUL-terminated source code string
- *
- * Returns:
- *   New TF_OBJ_LIST (refcount=1) containing compiled program objects, or
- *   NULL if a syntax error is detected
- */
-tfobj *compile(char *program_text);
-
+/*
+ * Parser Module - Tokenization and Compilation
+ *
+ * Implements an iterative tokenizer/scanner that converts ToyForth source
+ * text into a compiled linear list of executable objects (integers, symbols, etc.).
+ * Positions are plain pointers into the text, turned into line and column
+ * numbers only for error reporting.
+ */
+
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+
+#include "tforth.h"
+
+/*
+ * parserPeek() - Returns the current character without advancing
+ *
+ * Returns the character at the parser's current position. Returns '\0' if
+ * the parser has reached the end of the program text.
+ *
+ * Args:
+ *   parser - Parser state to examine
+ *
+ * Returns:
+ *   Current character or '\0' at end of input
+ */
+char parserPeek(tfparser *parser);
+
+/*
+ * parserAdvance() - Moves the parser forward by one character
+ *
+ * Safe no-op when at end of input.
+ *
+ * Args:
+ *   parser - Parser state to advance
+ */
+void parserAdvance(tfparser *parser);
+
+/*
+ * parserSkipWhiteSpace() - Skips all whitespace characters
+ *
+ * Advances the parser past spaces, tabs, newlines, and the other
+ * characters isspace() accepts in the "C" locale.
+ *
+ * Args:
+ *   parser - Parser state to advance
+ */
+void parserSkipWhiteSpace(tfparser *parser);
+
+/*
+ * parserPosition() - Computes the line and column of a position in the text
+ *
+ * Args:
+ *   parser - Parser the position belongs to
+ *   at     - Pointer into the parser's program text
+ *   line   - Receives the 1-based line number
+ *   column - Receives the 1-based column number
+ */
+void parserPosition(const tfparser *parser, const char *at, int *line, int *column);
+
+
+/*
+ * parseNumber() - Parses a base-10 integer literal
+ *
+ * Recognizes optional leading '-' sign followed by decimal digits, which
+ * are converted while they are scanned. Advances the parser past all
+ * consumed characters.
+ *
+ * Args:
+ *   parser - Parser positioned at first digit or '-' sign
+ *
+ * Returns:
+ *   New TF_OBJ_INT with value from parsed decimal number (refcount=1), or
+ *   NULL if it does not fit in an int64_t
+ */
+tfobj *parseNumber(tfparser *parser);
+
+/*
+ * parseSymbol() - Parses a Forth word/symbol name
+ *
+ * Reads characters until whitespace or end-of-input. The resulting string
+ * is looked up in the dictionary; returns NULL if not found.
+ * Advances the parser past the parsed symbol.
+ *
+ * Args:
+ *   parser - Parser positioned at first character of symbol
+ *
+ * Returns:
+ *   New TF_OBJ_WORD bound to the resolved primitive or to the body of a
+ *   user-defined word (refcount=1), or NULL if the symbol is unknown
+ */
+tfobj *parseSymbol(tfparser *parser);
+
+
+/*
+ * parserInit() - Positions a parser at the start of a program text
+ *
+ * Args:
+ *   parser       - Parser state to initialize
+ *   program_text - NUL-terminated source code string
+ */
+void parserInit(tfparser *parser, char *program_text);
+
+/*
+ * compileBatch() - Compiles the next batch of a program
+ *
+ * Streaming counterpart of compile(): compiles at most max_objects
+ * top-level objects and leaves the parser after the last one, so the
+ * caller can run and free each batch before compiling the next and peak
+ * memory is bounded by the batch size rather than the program size.
+ * Line and column numbers keep counting across batches, so diagnostics
+ * report positions in the whole text. Definitions are compiled whole
+ * into the dictionary and emit no objects. After each batch,
+ * parser->analysis.highest is the deepest the stack gets so far, which
+ * lets the caller size the stack once.
+ *
+ * Args:
+ *   parser      - Parser initialized with parserInit()
+ *   max_objects - Maximum number of objects in the batch (at least 1)
+ *
+ * Returns:
+ *   New TF_OBJ_LIST (refcount=1), empty once the input is exhausted, or
+ *   NULL if a syntax error is detected
+ */
+tfobj *compileBatch(tfparser *parser, size_t max_objects);
+
+/*
+ * compileParallel() - Compiles the rest of a long program on several threads
+ *
+ * Same result as compileBatch(parser, SIZE_MAX), diagnostics included,
+ * for texts of at least two chunks. Definitions are compiled serially
+ * first; the top-level code after the last of them is cut at line
+ * starts into chunks of about chunk_size bytes, which worker threads
+ * compile independently, and the chunk lists are concatenated. A chunk
+ * the workers cannot compile on their own, such as one a string literal
+ * or a control structure runs out of, is compiled serially instead,
+ * along with everything after it. Shorter texts are simply compiled
+ * serially.
+ *
+ * The text is written to (and restored) while the workers run, so it
+ * must be writable. The bodies of all user words are pinned (see
+ * freezeDictionary()), so only use it for programs that live until exit.
+ *
+ * Args:
+ *   parser     - Parser initialized with parserInit()
+ *   workers    - Number of threads, or 0 for one per CPU
+ *   chunk_size - Approximate size of a chunk in bytes
+ *
+ * Returns:
+ *   New TF_OBJ_LIST (refcount=1), or NULL if a syntax error is detected
+ */
+tfobj *compileParallel(tfparser *parser, unsigned int workers, size_t chunk_size);
+
+/*
+ * compile() - Compiles ToyForth source code into executable objects
+ *
+ * Tokenizes the input program text and produces a list of compiled objects
+ * (integers, words, etc.). Performs basic syntax validation by checking
+ * that each symbol is a known Forth word, resolving it to its
+ * implementation in the same step.
+ *
+ * Definitions of the form ": name ... ;" are compiled into the dictionary
+ * and emit no code. Later uses of name compile to a call bound to its
+ * body; definitions do not nest, and a word cannot call itself.
+ *
+ * Control words (if/else/then, begin/until, do/loop) compile to
+ * TF_OBJ_BRANCH objects whose targets are absolute indices into the
+ * enclosing list, resolved as soon as the structure is closed.
+ * Structures cannot span a definition boundary.
+ *
+ * s" text" compiles to a TF_OBJ_STR literal holding the bytes between
+ * the delimiter after s" and the next double quote; a missing closing
+ * quote is a syntax error at s".
+ *
+ * Every word's stack effect is checked while compiling: primitives use
+ * the effects documented in ops.h, and each definition gets its effect
+ * computed from its body. A token that would pop more items than the
+ * stack holds at that point is rejected as a static underflow, reported
+ * at its line and column.
+ *
+ * On successful compilation, returns a TF_OBJ_LIST containing the compiled
+ * program with refcount=1. On syntax error, prints error location and
+ * returns NULL.
+ *
+ * Args:
+ *   program_text - NUL-terminated source code string
+ *
+ * Returns:
+ *   New TF_OBJ_LIST (refcount=1) containing compiled program objects, or
+ *   NULL if a syntax error is detected
+ */
+tfobj *compile(char *program_text);
+
+/*
+ * foldConstants() - Evaluates literal-only arithmetic at compile time
+ *
+ * Simulates the data stack over runs of integer literals and the pure
+ * primitives + - * / dup swap drop (and their fused forms (dup*) and (swap-)),
+ * replacing each run with the literals it leaves behind: "10 5 - 2 *"
+ * compiles to "10". Words that would underflow into runtime values or
+ * divide by zero are left in place, so runtime diagnostics are unchanged.
+ * Runs never extend across a branch target, and branches are retargeted
+ * to the compacted program. Run it after compile() and before
+ * fuseSuperinstructions().
+ *
+ * Args:
+ *   program_list - Program returned by compile() (may be NULL; no-op if so)
+ */
+void foldConstants(tfobj *program_list);
+
+/*
+ * fuseSuperinstructions() - Peephole pass fusing common word pairs
+ *
+ * Rewrites a compiled program in place, replacing adjacent pairs such as
+ * "<lit> +", "dup *", "swap -" and "dup ." with a single fused primitive
+ * from the dictionary (see ops.h). Run it after compile(); programs behave
+ * exactly the same, with one dispatch and one push/pop pair less per fusion.
+ * Branch targets are never fused into the word before them.
+ *
+ * Args:
+ *   program_list - Program returned by compile() (may be NULL; no-op if so)
+ */
+void fuseSuperinstructions(tfobj *program_list);
+
+/*
+ * pinLiterals() - Makes the boxed literals of a program immortal
+ *
+ * Pins (see pinObject()) every boxed literal the program can push,
+ * including those in the bodies of the user words it calls. The data
+ * stack then holds borrowed references to them: pushing and dropping a
+ * literal never writes to it, so the program can be shared by threads
+ * without refcount traffic on its cache lines, and a literal that escapes
+ * into another value (a slice or a rope) stays valid however long that
+ * value lives. The price is that pinned literals are never freed, so
+ * only programs that live until exit should be pinned; streamed batches,
+ * which are freed while their values stay on the stack, keep counting.
+ * Run it after the other passes, which may replace literals.
+ *
+ * Args:
+ *   program_list - Optimized program (may be NULL; no-op if so)
+ */
+void pinLiterals(tfobj *program_list);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,194 @@
+/*
+ * Parallel Runner Implementation
+ *
+ * Each worker's share of the jobs is a contiguous range [next, end) of
+ * job indices guarded by its own mutex. The owner takes jobs from the
+ * front; a thief takes the back half of a victim's range and makes it its
+ * own, so contention is limited to one lock per steal. Ranges only ever
+ * shrink or move between workers, so a worker that finds every range
+ * empty can stop: each job not yet started belongs to some live worker.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "runner.h"
+#include "mem.h"
+#include "stack.h"
+
+
+/*
+ * WorkQueue - Jobs not yet started by one worker
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next;                    /* Next job the owner runs */
+    size_t end;                     /* One past the last job */
+} WorkQueue;
+
+/*
+ * RunState - Shared by all workers of one tfrunParallel() call
+ */
+typedef struct {
+    const tfjob *jobs;
+    WorkQueue *queues;              /* One per worker */
+    unsigned int workers;
+    tfjobDone done;
+    void *user;
+} RunState;
+
+/*
+ * Worker - Thread argument: the run and this worker's queue
+ */
+typedef struct {
+    RunState *run;
+    unsigned int id;
+    pthread_t thread;
+} Worker;
+
+
+/*
+ * takeJob() - Takes the next job from a worker's own queue
+ *
+ * Returns 1 and stores the job index, or 0 if the queue is empty.
+ */
+static int takeJob(WorkQueue *queue, size_t *job) {
+    int found = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->next < queue->end) {
+        *job = queue->next++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return found;
+}
+
+
+/*
+ * stealJobs() - Refills an empty queue with half of another worker's jobs
+ *
+ * Victims are tried in order starting after the thief. The victim's lock
+ * is released before the thief's own is taken, so two thieves can never
+ * wait on each other.
+ *
+ * Returns 1 if jobs were stolen, 0 if every other queue is empty.
+ */
+static int stealJobs(RunState *run, unsigned int thief) {
+    for (unsigned int k = 1; k < run->workers; k++) {
+        WorkQueue *victim = &run->queues[(thief + k) % run->workers];
+        size_t begin = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->next < victim->end) {
+            begin = victim->next + (victim->end - victim->next) / 2;
+            end = victim->end;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (begin < end) {
+            WorkQueue *own = &run->queues[thief];
+            pthread_mutex_lock(&own->lock);
+            own->next = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * runJob() - Pushes a job's parameters, runs it and resets the context
+ */
+static void runJob(RunState *run, size_t index, tfcontext *context) {
+    const tfjob *job = &run->jobs[index];
+
+    for (size_t i = 0; i < job->param_count; i++) {
+        tfobj *param = createIntegerObject(job->params[i]);
+        stackPush(context, param);
+        decrementReferenceCount(param);
+    }
+
+    tfprogramRun(job->program, context);
+    if (run->done != NULL) run->done(index, context, run->user);
+    resetContext(context);
+}
+
+
+/*
+ * workerMain() - Body of every worker thread
+ *
+ * The context is created on the worker's own thread, so its pool becomes
+ * that thread's active pool.
+ */
+static void *workerMain(void *argument) {
+    Worker *worker = argument;
+    RunState *run = worker->run;
+    tfcontext *context = createContext();
+    size_t job;
+
+    do {
+        while (takeJob(&run->queues[worker->id], &job)) {
+            runJob(run, job, context);
+        }
+    } while (stealJobs(run, worker->id));
+
+    freeContext(context);
+    return NULL;
+}
+
+
+/*
+ * tfrunParallel() implementation
+ *
+ * The calling thread works as worker 0, so a single worker starts no
+ * thread at all.
+ */
+void tfrunParallel(const tfjob *jobs, size_t count, unsigned int workers, tfjobDone done, void *user) {
+    if (count == 0) return;
+
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (unsigned int)cpus : 1;
+    }
+    if (workers > count) workers = (unsigned int)count;
+
+    RunState run = {jobs, wmalloc(sizeof(WorkQueue) * workers), workers, done, user};
+    Worker *pool = wmalloc(sizeof(Worker) * workers);
+
+    /* Even split up front; stealing evens out jobs of unequal length */
+    for (unsigned int w = 0; w < workers; w++) {
+        pthread_mutex_init(&run.queues[w].lock, NULL);
+        run.queues[w].next = count * w / workers;
+        run.queues[w].end = count * (w + 1) / workers;
+        pool[w].run = &run;
+        pool[w].id = w;
+    }
+
+    for (unsigned int w = 1; w < workers; w++) {
+        if (pthread_create(&pool[w].thread, NULL, workerMain, &pool[w]) != 0) {
+            fprintf(stderr, "Error. Couldn't start worker thread %u.\n", w);
+            exit(EXIT_FAILURE);
+        }
+    }
+    workerMain(&pool[0]);
+
+    for (unsigned int w = 1; w < workers; w++) {
+        pthread_join(pool[w].thread, NULL);
+    }
+
+    for (unsigned int w = 0; w < workers; w++) {
+        pthread_mutex_destroy(&run.queues[w].lock);
+    }
+    free(run.queues);
+    free(pool);
+}
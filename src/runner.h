@@ -0,0 +1,69 @@
+/*
+ * Parallel Runner Module
+ *
+ * Runs many jobs (a compiled program, optionally with parameters) across
+ * a pool of worker threads. Each worker owns one context, and with it an
+ * allocator pool, for its whole life and resets it between jobs. Jobs are
+ * split evenly up front; a worker that runs out steals half of the
+ * remaining jobs of another one.
+ *
+ * Programs are shared between workers without synchronisation: compiled
+ * programs are immutable and their boxed literals pinned (see toyforth.h),
+ * so running them never writes to shared memory. Compile every program
+ * before starting a run, since the dictionary is not thread-safe.
+ */
+
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "toyforth.h"
+
+
+/*
+ * tfjob - One unit of work for tfrunParallel()
+ *
+ * The parameters are pushed in order (the last one ends up on top)
+ * before the program runs, so one program can be run over many inputs.
+ * The program must not expect more than param_count inputs.
+ */
+typedef struct {
+    const tfprogram *program;       /* Program to run */
+    const int64_t *params;             /* Integers pushed before running, or NULL */
+    size_t param_count;             /* Number of params */
+} tfjob;
+
+/*
+ * tfjobDone - Called on the worker thread once a job has run
+ *
+ * The context still holds the job's results; it is reset afterwards.
+ *
+ * Args:
+ *   job     - Index of the job in the array given to tfrunParallel()
+ *   context - The worker's context
+ *   user    - Pointer passed to tfrunParallel()
+ */
+typedef void (*tfjobDone)(size_t job, tfcontext *context, void *user);
+
+
+/*
+ * tfrunParallel() - Runs jobs on a pool of worker threads
+ *
+ * Returns once every job has run. Jobs start in no particular order, and
+ * output printed by jobs running at the same time interleaves. As in
+ * the executable, a runtime error terminates the process.
+ *
+ * Args:
+ *   jobs    - Jobs to run
+ *   count   - Number of jobs
+ *   workers - Number of threads, or 0 for one per online CPU; never more
+ *             than count
+ *   done    - Callback run after each job, or NULL
+ *   user    - Passed through to done
+ */
+void tfrunParallel(const tfjob *jobs, size_t count, unsigned int workers, tfjobDone done, void *user);
+
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * Server Module Implementation
+ *
+ * A request costs a compile of its own text and nothing else: no process,
+ * no file and no dictionary rebuild. Request programs are not pinned,
+ * since they are freed right after running (see pinLiterals()).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "list.h"
+#include "mem.h"
+#include "output.h"
+#include "parser.h"
+
+
+/*
+ * Request - What runRequest() needs to run one compiled request
+ */
+typedef struct {
+    tfobj *program;                 /* Optimized program list */
+    tfbytecode *bytecode;           /* Its bytecode, or NULL for the list engine */
+} Request;
+
+
+/*
+ * runRequest() - Runs a compiled request, under executeRecovering()
+ */
+static void runRequest(tfcontext *context, void *argument) {
+    Request *request = argument;
+
+    if (request->bytecode != NULL) {
+        executeBytecode(request->bytecode, context);
+    } else {
+        execute(request->program, context);
+    }
+}
+
+
+/*
+ * serveRequest() implementation
+ *
+ * The static analysis starts from the items left by earlier requests, so
+ * a request may consume them without being reported as an underflow.
+ */
+int serveRequest(char *text, tfcontext *context, int threaded) {
+    tfparser parser;
+    size_t depth = context->stack->list_obj.len;
+
+    activateContext(context);
+    parserInit(&parser, text);
+    parser.analysis.depth = (long)depth;
+
+    Request request = {compileBatch(&parser, SIZE_MAX), NULL};
+    if (request.program == NULL) return 0;
+
+    foldConstants(request.program);
+    fuseSuperinstructions(request.program);
+    if (threaded) request.bytecode = compileBytecode(request.program);
+
+    int ok = !threaded || request.bytecode != NULL;
+    if (ok) {
+        listReserve(context->stack, depth + (size_t)parser.analysis.highest);
+        ok = executeRecovering(context, runRequest, &request);
+        if (!ok) resetContext(context);
+    }
+
+    freeBytecode(request.bytecode);
+    decrementReferenceCount(request.program);
+
+    if (ok) outputBytes(&context->output, "\n", 1);
+    outputFlush(&context->output);
+    return ok;
+}
+
+
+/*
+ * serveLines() implementation
+ *
+ * stderr is unbuffered, so once the output is flushed, a diagnostic is
+ * written right after what the request printed.
+ */
+void serveLines(FILE *input, int reply_fd, tfcontext *context, int threaded) {
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+
+    fflush(stderr);
+    int log = dup(STDERR_FILENO);
+    dup2(reply_fd, STDERR_FILENO);
+
+    while ((len = getline(&line, &size, input)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        serveRequest(line, context, threaded);
+    }
+
+    dup2(log, STDERR_FILENO);
+    close(log);
+    free(line);
+}
+
+
+/*
+ * openSocket() - Creates, binds and listens on a Unix domain socket
+ *
+ * Returns the listening descriptor, or -1 after reporting the error.
+ */
+static int openSocket(const char *path) {
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error. Socket path %s is too long.\n", path);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        fprintf(stderr, "Error. Couldn't create a socket: %s.\n", strerror(errno));
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error. Couldn't listen on %s: %s.\n", path, strerror(errno));
+        close(listener);
+        return -1;
+    }
+
+    return listener;
+}
+
+
+/*
+ * serveSocket() implementation
+ *
+ * A client that hangs up early must not kill the server, so SIGPIPE is
+ * ignored and writes to a closed connection are dropped (see output.h).
+ * Connections are served one at a time, so pointing stderr at the one
+ * being served (see serveLines()) is safe.
+ */
+int serveSocket(const char *path, tfcontext *context, int threaded) {
+    int listener = openSocket(path);
+    if (listener < 0) return 0;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    while (1) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error. Couldn't accept a connection on %s: %s.\n", path, strerror(errno));
+            break;
+        }
+
+        FILE *input = fdopen(client, "r");
+        if (input == NULL) {
+            close(client);
+            continue;
+        }
+
+        outputUseDescriptor(&context->output, client);
+        serveLines(input, client, context, threaded);
+        outputUseDescriptor(&context->output, TF_OUTPUT_STDIO);
+        fclose(input);
+        resetContext(context);
+    }
+
+    close(listener);
+    return 0;
+}
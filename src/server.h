@@ -0,0 +1,80 @@
+/*
+ * Server Module - Long-Lived Interpreter Sessions
+ *
+ * Keeps one context and the dictionary warm across many requests, so a
+ * caller pays for process startup once instead of once per snippet. Each
+ * request is one line of ToyForth: it is compiled on its own, straight
+ * into the existing dictionary (words defined by earlier requests can be
+ * called, and a definition made now is kept for later ones), optimized,
+ * run and freed.
+ *
+ * The stack carries over from one request to the next, as in a Forth
+ * REPL. Every request is answered with one line: its output followed by
+ * a newline, so requests that print nothing get an empty line. Errors do
+ * not end the session. The reply of a failed request is whatever it
+ * printed followed by the diagnostic, which ends the line instead. A
+ * syntax error only skips the request; a runtime error (see
+ * executeRecovering()) also empties the stack.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+
+#include "tforth.h"
+
+
+/*
+ * serveRequest() - Compiles and runs one request on a session's context
+ *
+ * Whatever the request prints is flushed, followed by the newline that
+ * ends the reply if it succeeded. Diagnostics go to stderr.
+ *
+ * Args:
+ *   text     - NUL-terminated request, without its newline
+ *   context  - Context of the session
+ *   threaded - Nonzero to run on the bytecode engine, 0 for the list engine
+ *
+ * Returns:
+ *   1 if the request compiled and ran, 0 after a diagnostic
+ */
+int serveRequest(char *text, tfcontext *context, int threaded);
+
+/*
+ * serveLines() - Serves every line read from a stream as a request
+ *
+ * Meanwhile stderr points at reply_fd, so each diagnostic ends up in the
+ * reply it belongs to. Replies go wherever the context's output goes,
+ * which should be reply_fd as well. Returns once the stream is exhausted.
+ *
+ * Args:
+ *   input    - Stream of requests, one per line
+ *   reply_fd - File descriptor the replies are written to
+ *   context  - Context of the session
+ *   threaded - Engine choice, as for serveRequest()
+ */
+void serveLines(FILE *input, int reply_fd, tfcontext *context, int threaded);
+
+/*
+ * serveSocket() - Serves requests arriving on a Unix domain socket
+ *
+ * Creates the socket at path (replacing a stale one) and serves its
+ * connections one at a time, on one context: the dictionary is shared
+ * by all connections, and each connection starts with an empty stack.
+ * Replies of a connection are written to the connection. Runs until the
+ * process is killed.
+ *
+ * Args:
+ *   path     - File system path of the socket
+ *   context  - Context to run every request on
+ *   threaded - Engine choice, as for serveRequest()
+ *
+ * Returns:
+ *   0 (after reporting why) if the socket cannot be set up or accepting
+ *   connections fails
+ */
+int serveSocket(const char *path, tfcontext *context, int threaded);
+
+
+#endif
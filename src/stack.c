@@ -1,58 +1,269 @@
-/*
- * Data Stack Implementation
- *
- * Provides push/pop operations for the ToyForth data stack, which is
- * implemented as a dynamically resizing list. Handles reference counting
- * for proper memory management.
- *
- * OWNERSHIP SEMANTICS:
- *   - stackPush(): Stack acquires a new reference (increments refcount)
- *   - stackPop():  Caller acquires the reference (stack does NOT decrement)
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-
-#include "stack.h"
-#include "list.h"
-#include "mem.h"
-
-
-/*
- * stackPush() implementation
- *
- * Adds an object to the top of the stack. The stack acquires a new
- * reference (increments refcount), so listAppendObject() is used directly.
- */
-void stackPush(tfcontext *context, tfobj *object) {
-    /* Reuse list utility for stack operations; it handles resizing and refcounting */
-    listAppendObject(context->stack, object);
-}
-
-
-/*
- * stackPop() implementation
- *
- * Removes and returns the top of the stack. The caller acquires ownership
- * of the returned reference and must decrement it when done. The stack does
- * NOT decrement the refcount here.
- *
- * Terminates with error message if the stack is empty (underflow).
- */
-tfobj *stackPop(tfcontext *context) {
-    if (context->stack->list_obj.len == 0) {
-        fprintf(stderr, "Stack underflow error.\n");
-        exit(EXIT_FAILURE);
-    }
-
-    size_t top_index = context->stack->list_obj.len - 1;
-    tfobj *object = context->stack->list_obj.element[top_index];
-    context->stack->list_obj.len--;
-
-    /* 
-     * IMPORTANT: We do NOT decrement the reference count here.
-     * The list no longer owns this reference, but the caller now does.
-     * The caller is responsible for decrementing when done.
-     */
-    return object;
-}
\ No newline at end of file
+/*
+ * Data Stack Implementation
+ *
+ * Provides push/pop operations for the ToyForth data stack, which is
+ * implemented as a dynamically resizing list. Handles reference counting
+ * for proper memory management.
+ *
+ * OWNERSHIP SEMANTICS:
+ *   - stackPush(): Stack acquires a new reference (increments refcount)
+ *   - stackPop():  Caller acquires the reference (stack does NOT decrement)
+ *
+ * GUARDED STACKS:
+ *   The region of a guarded stack is its limit in slots, rounded up to
+ *   whole pages, followed by a guard just as large mapped PROT_NONE. The
+ *   array is placed to end where the guard starts. The
+ *   guard costs address space only, and being as large as the stack means
+ *   no single operation can write past it: the bulkiest, ndup, copies at
+ *   most the whole stack. The stack list reports a capacity it can never
+ *   reach, so listAppendObject(), listReserve() and the engine's RESERVE()
+ *   never grow it, and the first write past the limit faults.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "stack.h"
+#include "engine.h"
+#include "list.h"
+#include "mem.h"
+#include "output.h"
+
+
+/* Capacity reported by guarded stacks, so that no capacity check fires */
+#define GUARDED_CAPACITY (SIZE_MAX / sizeof(tfobj *) / 2)
+
+/* Policy for stacks of new contexts, see setStackPolicy() */
+static tfstackpolicy default_policy = {INITIAL_STACK_CAPACITY, 0, 0};
+
+/* Context whose guard page a fault on this thread is checked against */
+static TF_THREAD_LOCAL tfcontext *guarded_context;
+
+
+/*
+ * roundToPages() - Rounds a byte count up to whole pages
+ */
+static size_t roundToPages(size_t bytes) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (bytes + page - 1) / page * page;
+}
+
+
+/*
+ * writeAll() - write() that retries short writes, for the fault handler
+ */
+static void writeAll(int fd, const char *bytes, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, bytes, len);
+        if (written <= 0) return;
+        bytes += written;
+        len -= (size_t)written;
+    }
+}
+
+
+/*
+ * overflowHandler() - SIGSEGV handler telling guard page hits from crashes
+ *
+ * A fault inside the guard of the running context is a stack overflow:
+ * the output buffered so far is written out and the error reported, then
+ * the program is abandoned as for any runtime error (see runtimeError()).
+ * Only async-signal-safe calls are used, so stdio is bypassed. The bytecode
+ * engine may not have spilled its stack when the fault hits, so the slots
+ * are abandoned, not released: a recovering context leaks them rather than
+ * releasing stale ones. Any other fault restores the default action, and
+ * returning retries the access, which then crashes as usual.
+ */
+static void overflowHandler(int signal_number, siginfo_t *info, void *unused) {
+    static const char message[] = "Stack overflow error.\n";
+    tfcontext *context = guarded_context;
+    char *address = info->si_addr;
+    (void)unused;
+
+    if (context != NULL && address >= context->stack_map + context->stack_map_size &&
+        address < context->stack_map + 2 * context->stack_map_size) {
+        int fd = context->output.fd == TF_OUTPUT_STDIO ? STDOUT_FILENO : context->output.fd;
+        writeAll(fd, context->output.buffer, context->output.len);
+        writeAll(STDERR_FILENO, message, sizeof(message) - 1);
+        context->output.len = 0;
+        context->stack->list_obj.len = 0;
+        recoverContext(context);
+        _exit(EXIT_FAILURE);
+    }
+
+    signal(signal_number, SIG_DFL);
+}
+
+
+/*
+ * stackPush() implementation
+ *
+ * Adds an object to the top of the stack. The stack acquires a new
+ * reference (increments refcount), so listAppendObject() is used directly.
+ */
+void stackPush(tfcontext *context, tfobj *object) {
+    /* Reuse list utility for stack operations; it handles resizing and refcounting */
+    listAppendObject(context->stack, object);
+}
+
+
+/*
+ * stackPop() implementation
+ *
+ * Removes and returns the top of the stack. The caller acquires ownership
+ * of the returned reference and must decrement it when done. The stack does
+ * NOT decrement the refcount here.
+ *
+ * Terminates with error message if the stack is empty (underflow).
+ */
+tfobj *stackPop(tfcontext *context) {
+    if (context->stack->list_obj.len == 0) {
+        runtimeError(context, "Stack underflow error.");
+    }
+
+    size_t top_index = context->stack->list_obj.len - 1;
+    tfobj *object = context->stack->list_obj.element[top_index];
+    context->stack->list_obj.len--;
+
+    /* 
+     * IMPORTANT: We do NOT decrement the reference count here.
+     * The list no longer owns this reference, but the caller now does.
+     * The caller is responsible for decrementing when done.
+     */
+    return object;
+}
+
+
+/*
+ * stackPeek() implementation
+ *
+ * Returns the top of the stack as a borrowed reference. Reports underflow
+ * exactly like stackPop().
+ */
+tfobj *stackPeek(tfcontext *context) {
+    if (context->stack->list_obj.len == 0) {
+        runtimeError(context, "Stack underflow error.");
+    }
+
+    return context->stack->list_obj.element[context->stack->list_obj.len - 1];
+}
+
+
+/*
+ * stackTop() implementation
+ */
+tfobj **stackTop(tfcontext *context, size_t count) {
+    if (context->stack->list_obj.len < count) {
+        runtimeError(context, "Stack underflow error.");
+    }
+
+    return context->stack->list_obj.element + context->stack->list_obj.len - count;
+}
+
+
+/*
+ * setStackPolicy() implementation
+ *
+ * The fault handler is installed with the first policy asking for guarded
+ * stacks, while the program is still single-threaded.
+ */
+void setStackPolicy(const tfstackpolicy *policy) {
+    default_policy = *policy;
+    if (default_policy.initial == 0) default_policy.initial = INITIAL_STACK_CAPACITY;
+
+    if (default_policy.limit > 0) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = overflowHandler;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, NULL);
+    }
+}
+
+
+/*
+ * stackInit() implementation
+ */
+void stackInit(tfcontext *context) {
+    tfobj *stack = context->stack;
+
+    context->stack_policy = default_policy;
+    context->stack_map = NULL;
+    context->stack_map_size = 0;
+
+    if (default_policy.limit == 0) {
+        listReserve(stack, default_policy.initial);
+        return;
+    }
+
+    size_t size = roundToPages(default_policy.limit * sizeof(tfobj *));
+    void *map = mmap(NULL, 2 * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED || mprotect((char *)map + size, size, PROT_NONE) != 0) {
+        fprintf(stderr, "Error. Couldn't map a stack of %zu slots.\n", default_policy.limit);
+        exit(EXIT_FAILURE);
+    }
+
+    /* The array ends right at the guard, so the limit is exact */
+    free(stack->list_obj.element);
+    stack->list_obj.element = (tfobj **)((char *)map + size) - default_policy.limit;
+    stack->list_obj.capacity = GUARDED_CAPACITY;
+    context->stack_map = map;
+    context->stack_map_size = size;
+    stackActivate(context);
+}
+
+
+/*
+ * stackRelease() implementation
+ *
+ * The emptied list is left without an array, which the pool allocates
+ * afresh if it recycles the header (see createListObject()).
+ */
+void stackRelease(tfcontext *context) {
+    if (context->stack_map == NULL) return;
+
+    if (guarded_context == context) guarded_context = NULL;
+    listClear(context->stack);
+    munmap(context->stack_map, 2 * context->stack_map_size);
+    context->stack->list_obj.element = NULL;
+    context->stack->list_obj.capacity = 0;
+    context->stack_map = NULL;
+}
+
+
+/*
+ * stackIdle() implementation
+ */
+void stackIdle(tfcontext *context) {
+    tfobj *stack = context->stack;
+    size_t initial = context->stack_policy.initial;
+
+    if (context->stack_policy.shrink_above == 0) return;
+
+    if (context->stack_map != NULL) {
+        size_t start = (size_t)((char *)stack->list_obj.element - context->stack_map);
+        size_t keep = roundToPages(start + initial * sizeof(tfobj *));
+        if (keep < context->stack_map_size) {
+            madvise(context->stack_map + keep, context->stack_map_size - keep, MADV_DONTNEED);
+        }
+    } else if (stack->list_obj.capacity > context->stack_policy.shrink_above && stack->list_obj.capacity > initial) {
+        stack->list_obj.capacity = initial;
+        stack->list_obj.element = wrealloc(stack->list_obj.element, sizeof(tfobj *) * initial);
+    }
+}
+
+
+/*
+ * stackActivate() implementation
+ */
+void stackActivate(tfcontext *context) {
+    guarded_context = context != NULL && context->stack_map != NULL ? context : NULL;
+}
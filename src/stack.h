@@ -1,44 +1,150 @@
-/*
- * Stack Module - Data Stack Operations
- *
- * Provides push/pop operations for the ToyForth data stack (implemented as
- * a dynamically resizing list). Handles reference counting automatically.
- */
-
-#ifndef STACK_H
-#define STACK_H
-
-#include "tforth.h"
-
-/*
- * stackPush() - Pushes an object onto the data stack
- *
- * Appends the object to the context's stack list. The stack takes a new
- * reference to the object and increments its refcount. The caller retains
- * their original reference and must decrement it when done (or transfer
- * ownership if appropriate).
- *
- * Args:
- *   context - Execution context
- *   object  - Object to push onto the stack
- */
-void stackPush(tfcontext *context, tfobj *object);
-
-/*
- * stackPop() - Pops the topmost object from the data stack
- *
- * Removes the top element and returns a reference to it. The stack releases
- * its reference to the object (does NOT decrement refcount). The caller
- * acquires ownership and must decrement the refcount when done.
- *
- * Terminates with "Stack underflow error" if the stack is empty.
- *
- * Args:
- *   context - Execution context
- *
- * Returns:
- *   The popped object (caller takes ownership of the reference)
- */
-tfobj *stackPop(tfcontext *context);
-
+/*
+ * Stack Module - Data Stack Operations
+ *
+ * Provides push/pop operations for the ToyForth data stack (implemented as
+ * a dynamically resizing list). Handles reference counting automatically.
+ *
+ * A stack policy (tfstackpolicy) decides how the stacks of new contexts
+ * are sized. By default a stack starts at INITIAL_STACK_CAPACITY slots and
+ * doubles when full. A policy can preallocate more slots, or back the
+ * stack with a fixed mmap() region that ends in an inaccessible guard page:
+ * such a stack never reallocates, its capacity checks never fire, and
+ * pushing past its limit faults on the guard page, which is reported as
+ * "Stack overflow error". A context that is reset can also give back the
+ * memory of a stack that spiked.
+ */
+
+#ifndef STACK_H
+#define STACK_H
+
+#include "tforth.h"
+
+/*
+ * stackPush() - Pushes an object onto the data stack
+ *
+ * Appends the object to the context's stack list. The stack takes a new
+ * reference to the object and increments its refcount. The caller retains
+ * their original reference and must decrement it when done (or transfer
+ * ownership if appropriate).
+ *
+ * Args:
+ *   context - Execution context
+ *   object  - Object to push onto the stack
+ */
+void stackPush(tfcontext *context, tfobj *object);
+
+/*
+ * stackPop() - Pops the topmost object from the data stack
+ *
+ * Removes the top element and returns a reference to it. The stack releases
+ * its reference to the object (does NOT decrement refcount). The caller
+ * acquires ownership and must decrement the refcount when done.
+ *
+ * Terminates with "Stack underflow error" if the stack is empty.
+ *
+ * Args:
+ *   context - Execution context
+ *
+ * Returns:
+ *   The popped object (caller takes ownership of the reference)
+ */
+tfobj *stackPop(tfcontext *context);
+
+/*
+ * stackPeek() - Returns the topmost object without removing it
+ *
+ * The stack keeps its reference; the caller must not decrement it.
+ *
+ * Terminates with "Stack underflow error" if the stack is empty.
+ *
+ * Args:
+ *   context - Execution context
+ *
+ * Returns:
+ *   The top object (borrowed reference)
+ */
+tfobj *stackPeek(tfcontext *context);
+
+/*
+ * stackTop() - Returns the topmost count slots of the stack
+ *
+ * Lets bulk words move or release many items with one memmove() or loop
+ * instead of a pop and a push each. The slots stay owned by the stack.
+ *
+ * Terminates with "Stack underflow error" if the stack holds fewer than
+ * count items.
+ *
+ * Args:
+ *   context - Execution context
+ *   count   - Number of slots
+ *
+ * Returns:
+ *   Pointer to the deepest of the slots, valid until the stack grows
+ */
+tfobj **stackTop(tfcontext *context, size_t count);
+
+/*
+ * setStackPolicy() - Sets the policy for the stacks of contexts created later
+ *
+ * Existing contexts keep the policy they were created with. Meant to be
+ * called once, before any context is created (in particular before worker
+ * threads start).
+ *
+ * Args:
+ *   policy - New policy; a zero field keeps its default (see tfstackpolicy)
+ */
+void setStackPolicy(const tfstackpolicy *policy);
+
+/*
+ * stackInit() - Sizes the data stack of a new context by the current policy
+ *
+ * Called by createContext(). Either reserves policy.initial slots on the
+ * growable stack, or replaces its array with a guarded region of
+ * policy.limit slots, in which case the context also becomes the one
+ * whose guard page this thread watches (see stackActivate()).
+ *
+ * Terminates with an error message if the region cannot be mapped.
+ *
+ * Args:
+ *   context - Context being created, with an empty stack
+ */
+void stackInit(tfcontext *context);
+
+/*
+ * stackRelease() - Frees what stackInit() mapped for a context's stack
+ *
+ * Called by freeContext() before the stack list is released. Empties the
+ * stack first, since a guarded array goes away with its region.
+ *
+ * Args:
+ *   context - Context being freed
+ */
+void stackRelease(tfcontext *context);
+
+/*
+ * stackIdle() - Shrinks an empty stack that grew past the policy's limit
+ *
+ * Called by resetContext(). A growable stack above shrink_above slots is
+ * reallocated back to its initial size; the pages of a guarded stack
+ * beyond its initial size are handed back to the kernel with madvise(),
+ * and are mapped in again, zeroed, if the stack grows back into them.
+ * Does nothing when the policy has no shrink_above.
+ *
+ * Args:
+ *   context - Context with an empty stack
+ */
+void stackIdle(tfcontext *context);
+
+/*
+ * stackActivate() - Makes a context's guard page the one this thread watches
+ *
+ * Called by activateContext(). A fault on the guard page of the active
+ * context is reported as a stack overflow; any other fault is left to
+ * the default action.
+ *
+ * Args:
+ *   context - Context about to run, or NULL
+ */
+void stackActivate(tfcontext *context);
+
 #endif 
\ No newline at end of file
@@ -1,87 +1,254 @@
-/*
- * ToyForth - A minimal Forth interpreter implementation in C
- *
- * This header defines the core data structures and types for the ToyForth VM.
- * The implementation uses reference counting for automatic memory management
- * of dynamically allocated objects.
- */
-
-#ifndef TFORTH_H
-#define TFORTH_H
-
-#include <stddef.h>
-
-/* Initial capacity for newly allocated stacks and lists */
-#define INITIAL_STACK_CAPACITY 16
-
-
-/*
- * TF_OBJ_TYPE - Enumeration of all object types in the ToyForth system
- *
- * TF_OBJ_INT:    Integer value (32-bit signed integer)
- * TF_OBJ_STR:    String value (NUL-terminated)
- * TF_OBJ_BOOL:   Boolean value (true/false)
- * TF_OBJ_LIST:   List/array container containing pointers to other tfobj instances
- * TF_OBJ_SYMBOL: Forth word/operation name (stored as string, resolved at execution)
- */
-typedef enum {
-    TF_OBJ_INT,
-    TF_OBJ_STR,
-    TF_OBJ_BOOL,
-    TF_OBJ_LIST,
-    TF_OBJ_SYMBOL
-} TF_OBJ_TYPE;
-
-/*
- * tfobj - The primary value type for the ToyForth system
- *
- * This structure represents any value in the language: integers, strings,
- * symbols, booleans, and lists. Uses a tagged union pattern for type safety.
- *
- * Memory Management:
- *   - All tfobj instances use automatic reference counting
- *   - type:    Determines which union member is active
- *   - refcount: Number of active references; object is freed when refcount == 0
- *   - union:   Tagged union containing the actual value data
- */
-typedef struct tfobj {
-    TF_OBJ_TYPE type;               /* Distinguishes which union member is active */
-    int refcount;                   /* Reference count for automatic memory deallocation */
-    union {
-        int number;                 /* For TF_OBJ_INT and TF_OBJ_BOOL */
-        struct {
-            char *str;              /* NUL-terminated string data (heap-allocated) */
-            size_t len;             /* Length of string (excluding NUL terminator) */
-        } str_obj;                  /* For TF_OBJ_STR and TF_OBJ_SYMBOL */
-        struct {
-            struct tfobj **element; /* Array of pointers to other tfobj instances */
-            size_t len;             /* Current number of elements in the list */
-            size_t capacity;        /* Allocated space for elements (>= len) */
-        } list_obj;                 /* For TF_OBJ_LIST */
-    };
-} tfobj;
-
-/*
- * tfparser - Parser state for tokenizing and compiling program text
- *
- * Maintains position information (line, column) for accurate error reporting
- * during the compilation phase.
- */
-typedef struct {
-    char *program;                  /* Pointer to current position in program text */
-    int line;                       /* 1-based line number for error diagnostics */
-    int column;                     /* 1-based column number for error diagnostics */
-} tfparser;
-
-/*
- * tfcontext - Execution context for the ToyForth virtual machine
- *
- * Encapsulates the runtime state of a ToyForth program. Currently contains
- * only the data stack, but extensible for future features (return stack,
- * locals, etc.).
- */
-typedef struct {
-    tfobj *stack;                   /* The primary data stack (implemented as TF_OBJ_LIST) */
-} tfcontext;
-
+/*
+ * ToyForth - A minimal Forth interpreter implementation in C
+ *
+ * This header defines the core data structures and types for the ToyForth VM.
+ * The implementation uses reference counting for automatic memory management
+ * of dynamically allocated objects.
+ */
+
+#ifndef TFORTH_H
+#define TFORTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Initial capacity for newly allocated stacks and lists */
+#define INITIAL_STACK_CAPACITY 16
+
+/* Per-thread state: each thread allocates from, and runs, its own context */
+#if defined(__GNUC__)
+#define TF_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define TF_THREAD_LOCAL _Thread_local
+#else
+#define TF_THREAD_LOCAL
+#endif
+
+
+/*
+ * TF_OBJ_TYPE - Enumeration of all object types in the ToyForth system
+ *
+ * TF_OBJ_INT:    Integer value (64-bit signed integer, an immediate whenever it fits)
+ * TF_OBJ_STR:    String value: its own NUL-terminated bytes, or a slice of another string's
+ * TF_OBJ_BOOL:   Boolean value (true/false, stored as an immediate)
+ * TF_OBJ_LIST:   List/array container containing pointers to other tfobj instances
+ * TF_OBJ_SYMBOL: Forth word/operation name (interned string, resolved by the compiler)
+ * TF_OBJ_WORD:   Compiled word with its primitive already resolved to a function pointer
+ * TF_OBJ_BRANCH: Compiled control-flow jump with its target resolved to a program index
+ * TF_OBJ_ROPE:   Concatenation of two strings whose bytes have not been copied yet
+ * TF_OBJ_ARRAY:  List variant holding unboxed 64-bit integers, for the array kernels
+ */
+typedef enum {
+    TF_OBJ_INT,
+    TF_OBJ_STR,
+    TF_OBJ_BOOL,
+    TF_OBJ_LIST,
+    TF_OBJ_SYMBOL,
+    TF_OBJ_WORD,
+    TF_OBJ_BRANCH,
+    TF_OBJ_ROPE,
+    TF_OBJ_ARRAY
+} TF_OBJ_TYPE;
+
+/*
+ * TF_BRANCH_KIND - What decides whether a TF_OBJ_BRANCH jumps
+ *
+ * TF_BRANCH_ALWAYS:   Unconditional jump ("else" skipping the else part)
+ * TF_BRANCH_IF_FALSE: Pops a flag and jumps if it is false or 0 ("if", "until")
+ * TF_BRANCH_LOOP:     Steps the innermost do loop and jumps back while it runs ("loop")
+ */
+typedef enum {
+    TF_BRANCH_ALWAYS,
+    TF_BRANCH_IF_FALSE,
+    TF_BRANCH_LOOP
+} TF_BRANCH_KIND;
+
+
+struct tfobj;
+struct tfcontext;
+
+/*
+ * Operation - Function pointer type for built-in Forth operations
+ *
+ * All Forth primitives have the same signature: they take a context pointer
+ * and modify the VM state (typically by popping operands, computing, and
+ * pushing results onto the stack).
+ */
+typedef void (*Operation)(struct tfcontext *context);
+
+/*
+ * OperandOperation - Function pointer type for primitives with an operand
+ *
+ * Used by fused superinstructions that carry an inline literal taken from
+ * the program (e.g. "10 +" compiled into a single add-immediate word).
+ */
+typedef void (*OperandOperation)(struct tfcontext *context, struct tfobj *operand);
+
+/*
+ * tfobj - The primary value type for the ToyForth system
+ *
+ * This structure represents any value in the language: integers, strings,
+ * symbols, booleans, and lists. Uses a tagged union pattern for type safety.
+ *
+ * Memory Management:
+ *   - All tfobj instances use automatic reference counting
+ *   - type:    Determines which union member is active
+ *   - refcount: Number of active references; object is freed when refcount == 0
+ *   - union:   Tagged union containing the actual value data
+ */
+typedef struct tfobj {
+    TF_OBJ_TYPE type;               /* Distinguishes which union member is active */
+    int refcount;                   /* Reference count for automatic memory deallocation */
+    union {
+        int64_t number;             /* For boxed TF_OBJ_INT (and TF_OBJ_BOOL) */
+        struct {
+            char *str;              /* String data, NUL-terminated unless a slice */
+            size_t len;             /* Length of string (excluding NUL terminator) */
+            union {
+                unsigned int hash;  /* Precomputed hashString() (TF_OBJ_SYMBOL only) */
+                struct tfobj *owner; /* TF_OBJ_STR only: string whose bytes a slice
+                                        points into, or NULL if str is its own */
+            };
+        } str_obj;                  /* For TF_OBJ_STR and TF_OBJ_SYMBOL */
+        struct {
+            struct tfobj **element; /* Array of pointers to other tfobj instances */
+            size_t len;             /* Current number of elements in the list */
+            size_t capacity;        /* Allocated space for elements (>= len) */
+        } list_obj;                 /* For TF_OBJ_LIST */
+        struct {
+            int64_t *element;       /* Unboxed elements, never tagged or refcounted */
+            size_t len;             /* Number of elements (fixed when created) */
+        } array_obj;                /* For TF_OBJ_ARRAY */
+        struct {
+            union {
+                Operation op;       /* Primitive resolved once by the compiler */
+                OperandOperation operand_op; /* Used instead when operand != NULL */
+            };
+            struct tfobj *symbol;   /* TF_OBJ_SYMBOL the word was compiled from */
+            struct tfobj *operand;  /* Inline literal of a fused word, or NULL */
+        } word_obj;                 /* For TF_OBJ_WORD */
+        struct {
+            TF_BRANCH_KIND kind;    /* Condition of the jump */
+            size_t target;          /* Absolute index in the program list to jump to */
+            struct tfobj *symbol;   /* TF_OBJ_SYMBOL the branch was compiled from */
+        } branch_obj;               /* For TF_OBJ_BRANCH */
+        struct {
+            struct tfobj *left;     /* First part (TF_OBJ_STR or TF_OBJ_ROPE) */
+            struct tfobj *right;    /* Second part */
+            uint32_t len;           /* Total length */
+            uint32_t depth;         /* Rope nodes on the longest path to a string */
+        } rope_obj;                 /* For TF_OBJ_ROPE, until flattenString() */
+    };
+} tfobj;
+
+/*
+ * Immediate values - Integers and booleans encoded inside the pointer
+ *
+ * Heap objects are always at least 4-byte aligned, so the two low bits of a
+ * real tfobj pointer are zero. Scalars use those bits as a tag and keep the
+ * value in the remaining bits, so they never touch the allocator and carry
+ * no reference count. Code must inspect values through getObjectType() and
+ * getObjectNumber() (see mem.h) instead of dereferencing them directly.
+ *
+ *   ...vvvvvvvv00  Pointer to a heap tfobj
+ *   ...vvvvvvvv01  TF_OBJ_INT  (value in the upper bits)
+ *   ...vvvvvvvv10  TF_OBJ_BOOL (0 or 1 in the upper bits)
+ */
+#define TF_TAG_MASK   ((uintptr_t)3)
+#define TF_TAG_INT    ((uintptr_t)1)
+#define TF_TAG_BOOL   ((uintptr_t)2)
+#define TF_TAG_SHIFT  2
+
+/* Range of integers that fit in an immediate (62 bits on 64-bit hosts); others are boxed */
+#define TF_IMMEDIATE_MAX  (INTPTR_MAX >> TF_TAG_SHIFT)
+#define TF_IMMEDIATE_MIN  (INTPTR_MIN >> TF_TAG_SHIFT)
+
+/* Refcount of pinned objects: shared for the process lifetime, never counted or freed */
+#define TF_REFCOUNT_PINNED (-1)
+
+
+/*
+ * tfeffect - Static stack effect of a word, ( in -- out )
+ *
+ * peak is how far above its entry depth the stack gets while the word
+ * runs, callees included. in is TF_EFFECT_UNKNOWN when the effect cannot
+ * be determined at compile time.
+ */
+typedef struct {
+    int in;                         /* Items consumed, or TF_EFFECT_UNKNOWN */
+    int out;                        /* Items left in their place */
+    int peak;                       /* Growth above the entry depth while running */
+} tfeffect;
+
+#define TF_EFFECT_UNKNOWN (-1)
+
+/*
+ * tfanalysis - Simulated data stack depth during compilation
+ *
+ * At top level depth is the real stack depth, starting from empty, and a
+ * word consuming more items than that is a static underflow. In a
+ * definition body depth is relative to the unknown caller depth and may
+ * go negative; the lowest point reached gives the body's inputs. Once a
+ * word with an unknown effect is compiled, known drops to 0 and the rest
+ * is left to the runtime checks.
+ */
+typedef struct {
+    int known;                      /* Depth is statically known (verified region) */
+    int relative;                   /* Analysing a definition body */
+    long depth;                     /* Current depth */
+    long lowest;                    /* Lowest depth reached (relative only) */
+    long highest;                   /* Highest depth reached, callees included */
+} tfanalysis;
+
+/*
+ * tfparser - Parser state for tokenizing and compiling program text
+ *
+ * Keeps the start of the text along with the current position, so line
+ * and column can be recovered for error reporting, and the stack-effect
+ * analysis of the top-level program, which carries over between batches.
+ */
+typedef struct {
+    char *text;                     /* Start of the program text */
+    char *program;                  /* Pointer to current position in program text */
+    tfanalysis analysis;            /* Stack depth of the top-level program so far */
+    char *stop;                     /* Batches end at the first top-level token at or past it, or NULL */
+    int speculative;                /* Compiling a chunk of compileParallel() on a worker thread */
+} tfparser;
+
+/*
+ * tfstackpolicy - How the data stacks of new contexts are sized (see stack.h)
+ */
+typedef struct {
+    size_t initial;                 /* Slots allocated up front, 0 for INITIAL_STACK_CAPACITY */
+    size_t limit;                   /* Slots of a fixed stack ending in a guard page, 0 to grow on demand */
+    size_t shrink_above;            /* resetContext() shrinks a stack bigger than this many slots, 0 never */
+} tfstackpolicy;
+
+/*
+ * tfoutput - Buffered output of one context (see output.h)
+ */
+typedef struct {
+    char *buffer;                   /* TF_OUTPUT_BUFFER_SIZE bytes */
+    size_t len;                     /* Bytes not yet written out */
+    int fd;                         /* File descriptor, or TF_OUTPUT_STDIO */
+} tfoutput;
+
+/*
+ * tfcontext - Execution context for the ToyForth virtual machine
+ *
+ * Encapsulates the runtime state of a ToyForth program: the data stack,
+ * the loop stack of the active do loops and the buffered output.
+ * Extensible for future features (return stack, locals, etc.).
+ */
+typedef struct tfcontext {
+    tfobj *stack;                   /* The primary data stack (implemented as TF_OBJ_LIST) */
+    tfobj *loops;                   /* Limit and index of each active do loop, innermost last */
+    struct tfpool *pool;            /* Slab allocator for objects created while running */
+    tfoutput output;                /* Everything the program prints, until flushed */
+    struct tfrecovery *recovery;    /* Where runtime errors return to, NULL to exit (see engine.h) */
+    tfstackpolicy stack_policy;     /* How stack was sized, fixed when the context was created */
+    char *stack_map;                /* mmap() region of a guarded stack, or NULL */
+    size_t stack_map_size;          /* Bytes of stack_map before its guard page */
+} tfcontext;
+
 #endif  
\ No newline at end of file
@@ -0,0 +1,132 @@
+/*
+ * ToyForth Library API Implementation
+ *
+ * Thin layer over the compiler and the bytecode engine: a tfprogram is a
+ * folded and fused program list together with its bytecode and the stack
+ * depth the compiler computed for it.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "toyforth.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "list.h"
+#include "mem.h"
+#include "output.h"
+#include "parser.h"
+#include "stack.h"
+
+
+struct tfprogram {
+    tfobj *list;                    /* Optimized program list, owned */
+    tfbytecode *bytecode;           /* Bytecode translated from list */
+    size_t depth;                   /* Deepest stack the program reaches, per the compiler */
+};
+
+
+/*
+ * tfprogramCompile() implementation
+ *
+ * Allocates from the global pool, so the program does not keep any
+ * context's pool alive and does not depend on which context is active.
+ */
+tfprogram *tfprogramCompile(char *program_text, size_t inputs) {
+    tfparser parser;
+
+    activateContext(NULL);
+    parserInit(&parser, program_text);
+    parser.analysis.depth = (long)inputs;
+    tfobj *list = compileBatch(&parser, SIZE_MAX);
+    if (list == NULL) return NULL;
+
+    foldConstants(list);
+    fuseSuperinstructions(list);
+    pinLiterals(list);
+
+    tfbytecode *bytecode = compileBytecode(list);
+    if (bytecode == NULL) {
+        decrementReferenceCount(list);
+        return NULL;
+    }
+
+    tfprogram *program = wmalloc(sizeof(tfprogram));
+    program->list = list;
+    program->bytecode = bytecode;
+    program->depth = (size_t)parser.analysis.highest;
+
+    return program;
+}
+
+
+/*
+ * tfprogramRun() implementation
+ *
+ * Sizes the stack from the compile-time depth, then runs the bytecode.
+ */
+void tfprogramRun(const tfprogram *program, tfcontext *context) {
+    activateContext(context);
+    listReserve(context->stack, context->stack->list_obj.len + program->depth);
+    executeBytecode(program->bytecode, context);
+}
+
+
+/*
+ * tfprogramFree() implementation
+ */
+void tfprogramFree(tfprogram *program) {
+    if (program == NULL) return;
+
+    freeBytecode(program->bytecode);
+    decrementReferenceCount(program->list);
+    free(program);
+}
+
+
+/*
+ * tfsetStackPolicy() implementation
+ */
+void tfsetStackPolicy(const tfstackpolicy *policy) {
+    setStackPolicy(policy);
+}
+
+
+/*
+ * tfcontextCreate() implementation
+ */
+tfcontext *tfcontextCreate(void) {
+    return createContext();
+}
+
+
+/*
+ * tfcontextReset() implementation
+ */
+void tfcontextReset(tfcontext *context) {
+    resetContext(context);
+}
+
+
+/*
+ * tfcontextSetOutput() implementation
+ */
+void tfcontextSetOutput(tfcontext *context, int fd) {
+    outputUseDescriptor(&context->output, fd);
+}
+
+
+/*
+ * tfcontextFlush() implementation
+ */
+void tfcontextFlush(tfcontext *context) {
+    outputFlush(&context->output);
+}
+
+
+/*
+ * tfcontextFree() implementation
+ */
+void tfcontextFree(tfcontext *context) {
+    freeContext(context);
+}
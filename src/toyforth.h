@@ -0,0 +1,143 @@
+/*
+ * ToyForth Library API
+ *
+ * Entry points for embedding the interpreter (libtoyforth.a): compile a
+ * program once, then run it any number of times on reusable contexts.
+ *
+ *   tfprogram *program = tfprogramCompile(text, 0);
+ *   tfcontext *context = tfcontextCreate();
+ *   for (...) {
+ *       tfprogramRun(program, context);
+ *       ... inspect context->stack ...
+ *       tfcontextReset(context);
+ *   }
+ *   tfcontextFree(context);
+ *   tfprogramFree(program);
+ *
+ * Diagnostics are printed to stderr. Compile errors are returned as NULL;
+ * runtime errors (underflow, overflow of a guarded stack, division by
+ * zero) terminate the process, as they do in the toyforth executable.
+ */
+
+#ifndef TOYFORTH_H
+#define TOYFORTH_H
+
+#include "tforth.h"
+
+
+/*
+ * tfprogram - A compiled, optimized program ready to run (opaque)
+ *
+ * Immutable once compiled: running it never writes to the program, so one
+ * program can be run by several contexts, including concurrently.
+ */
+typedef struct tfprogram tfprogram;
+
+
+/*
+ * tfprogramCompile() - Compiles program text for repeated execution
+ *
+ * Compiles, folds, fuses and translates the program to bytecode once.
+ * Definitions in the text are added to the (process-wide) dictionary.
+ * The program's objects are allocated outside of any context, and boxed
+ * literals are pinned so executions never update their refcounts (they
+ * stay allocated until the process exits).
+ *
+ * Args:
+ *   program_text - NUL-terminated source code
+ *   inputs       - Items the program expects on the stack when it
+ *                  starts; the static underflow check counts them
+ *
+ * Returns:
+ *   New program (free with tfprogramFree()), or NULL on a compile error
+ */
+tfprogram *tfprogramCompile(char *program_text, size_t inputs);
+
+/*
+ * tfprogramRun() - Runs a compiled program on a context
+ *
+ * The program starts from whatever the context holds, so results of a
+ * previous run stay on the stack unless the context was reset.
+ *
+ * Args:
+ *   program - Program returned by tfprogramCompile()
+ *   context - Context to run on; a context must not be run concurrently
+ */
+void tfprogramRun(const tfprogram *program, tfcontext *context);
+
+/*
+ * tfprogramFree() - Releases a compiled program
+ *
+ * Args:
+ *   program - Program to free (may be NULL; no-op if so)
+ */
+void tfprogramFree(tfprogram *program);
+
+
+/*
+ * tfsetStackPolicy() - Chooses how the stacks of new contexts are sized
+ *
+ * With policy.limit set, every context created afterwards gets a fixed
+ * stack of that many slots ending in a guard page, so its memory is
+ * bounded and known up front, and overflowing it is a runtime error.
+ * Call it before creating contexts and before starting any thread.
+ *
+ * Args:
+ *   policy - Initial size, limit and shrink threshold, in slots (see
+ *            tfstackpolicy); zero fields keep their defaults
+ */
+void tfsetStackPolicy(const tfstackpolicy *policy);
+
+/*
+ * tfcontextCreate() - Creates an empty execution context
+ *
+ * Returns:
+ *   New context with its own stacks and allocator pool
+ */
+tfcontext *tfcontextCreate(void);
+
+/*
+ * tfcontextReset() - Empties a context for the next run
+ *
+ * Keeps the stack capacity (unless the stack policy's shrink_above asks
+ * for it to be shrunk) and the allocator pool, so a reset is much cheaper
+ * than tfcontextFree() followed by tfcontextCreate().
+ *
+ * Args:
+ *   context - Context to reset
+ */
+void tfcontextReset(tfcontext *context);
+
+/*
+ * tfcontextSetOutput() - Chooses where a context's output goes
+ *
+ * Output is buffered per context and goes to stdout through stdio by
+ * default. With a file descriptor it is written there directly with
+ * writev(), bypassing stdio.
+ *
+ * Args:
+ *   context - Context to configure
+ *   fd      - File descriptor to write to, or -1 for stdout through stdio
+ */
+void tfcontextSetOutput(tfcontext *context, int fd);
+
+/*
+ * tfcontextFlush() - Writes out whatever a context has printed so far
+ *
+ * tfcontextReset() and tfcontextFree() flush as well.
+ *
+ * Args:
+ *   context - Context to flush
+ */
+void tfcontextFlush(tfcontext *context);
+
+/*
+ * tfcontextFree() - Destroys a context and whatever is left on its stacks
+ *
+ * Args:
+ *   context - Context to free (may be NULL; no-op if so)
+ */
+void tfcontextFree(tfcontext *context);
+
+
+#endif
@@ -0,0 +1,6 @@
+5 iota dup . dup sum . dup length . 10 map+ dup . 3 at .
+4 3 2 3 array dup dot . 4 iota dup 2 map* . .
+1 2 3 3 array 1 2 2 array dot 0 iota dup . sum .
+1 s" x" 2 array
+100000 iota dup sum . dup dot .
+3 iota 3 at
\ No newline at end of file
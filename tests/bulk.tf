@@ -0,0 +1,5 @@
+1 2 3 2 pick . . . . 1 2 3 0 pick . . . .
+1 2 3 4 3 roll . . . . 1 2 3 rot . . .
+1 2 3 4 5 3 ndrop . . 1 2 3 2 ndup . . . . . 7 0 ndup 0 ndrop .
+: third 2 pick ; 4 5 6 third . . . .
+1 5 pick
\ No newline at end of file
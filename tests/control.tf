@@ -0,0 +1,11 @@
+1 if 10 . else 20 . then
+0 if 30 . else 40 . then
+2 3 < if 50 . then
+5 begin dup . 1 - dup 0 = until drop
+3 0 do 2 0 do i . loop i . loop
+4 4 = . 4 5 > .
+: countdown begin dup . 1 - dup 1 < until drop ;
+3 countdown
+: sum 0 swap 0 do i + loop ;
+10 sum . 1 0 do 99 . loop
+7 dup . 1 if 1 2 + else 3 4 * then .
\ No newline at end of file
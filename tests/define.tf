@@ -0,0 +1,6 @@
+: square dup * ;
+: cube dup square * ;
+3 square . 2 cube .
+: square 100 ;
+4 cube . 5 square . . 
+: ten 5 5 + ; ten 2 * .
\ No newline at end of file
@@ -1,2 +1,2 @@
-20 4 / .
+20 4 / .
 21 4 / .
\ No newline at end of file
@@ -1,2 +1,2 @@
-99 dup . .
+99 dup . .
 -5 dup . .
\ No newline at end of file
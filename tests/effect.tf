@@ -0,0 +1,4 @@
+: add3 + + ;
+: pair dup dup ;
+1 pair add3 drop
+5 6 add3 .
\ No newline at end of file
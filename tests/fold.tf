@@ -0,0 +1,5 @@
+10 5 - 2 * .
+1 2 3 drop swap - .
+4 dup dup * * .
+7 0 swap / .
+20 3 / 2 dup * + . 
\ No newline at end of file
@@ -0,0 +1,5 @@
+3 dup * .
+10 4 swap - .
+7 dup . .
+5 3 + . 5 3 - . 5 3 * . 7 2 / . 7 -2 / .
+6 dup * . 2 9 swap - . 4 dup . drop 
\ No newline at end of file
@@ -0,0 +1,13 @@
+4611686018427387903 1 + .
+9223372036854775807 dup . 1 - .
+-9223372036854775808 .
+3037000499 dup * .
+2147483648 dup * . -2147483648 dup * 1 - .
+: big 1000000000 * ; 1000000000 big . 9 big .
+-4611686018427387904 -1 / .
+4000000000 dup dup 3 array dup sum . 2 map* . 2000000000 dup 2 array dup dot .
+4611686018427387904 2 - 2 / .
+9223372036854775806 9223372036854775807 do i . loop
+9223372036854775807 9223372036854775805 do i . loop
+0 2305843009213693951 do i . loop 7 .
+9223372036854775807 1 + .
@@ -1,2 +1,2 @@
-6 7 * .
+6 7 * .
 -2 4 * .
\ No newline at end of file
@@ -0,0 +1,3 @@
+-7 2 / .
+-100 -3 * .
+0 -1 - . 
\ No newline at end of file
@@ -0,0 +1,3 @@
+1 . -25 . 0 . 100000 . 1 0 > . 0 1 > . flush
+s" done" . flush 7 dup . drop
+1 . 2 . s" a" s" ," split drop drop drop
\ No newline at end of file
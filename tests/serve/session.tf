@@ -0,0 +1,14 @@
+: sq dup * ;
+3 sq .
+4 5
++ .
+7
+5 iota 9 at
+.
+9223372036854775807 0 /
+9223372036854775807 1 array 1 map+
+1 2 + .
+nosuch
+3 dup* .
+: broken 1 +
+2 sq . s" done" .
@@ -1,3 +1,3 @@
-42 dup . .
-10 99 drop .
+42 dup . .
+10 99 drop .
 1 2 swap . .
\ No newline at end of file
@@ -0,0 +1,7 @@
+s" hello world" . s" abc" s" def" concat .
+s" a,b,,c" s" ," split . . . . .
+s" hello" 1 3 substr . s" hello" 3 99 substr . s" hi" 5 2 substr strlen .
+s" abc" strlen . s" abc" s" abd" < . s" ab" s" ab" = . s" b" s" abc" > . s" ab" s" abc" < .
+: greet s" hi, " swap concat . ;
+s" there" greet
+s" " 100 0 do s" abcdefgh" concat loop dup strlen . dup 396 4 substr . s" " 100 0 do s" abcdefgh" concat loop = .
\ No newline at end of file
@@ -1,2 +1,2 @@
-50 15 - .
+50 15 - .
 -5 10 - .
\ No newline at end of file
@@ -1,2 +1,2 @@
-1 2 swap . .
+1 2 swap . .
 10 20 30 swap . . .
\ No newline at end of file